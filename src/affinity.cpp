@@ -0,0 +1,29 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "affinity.h"
+#include <cstring>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+
+
+void pin_thread(std::thread& thread, int cpu, const char *name, int verbose)
+{
+    if (cpu < 0)
+        return;
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    auto err = pthread_setaffinity_np(thread.native_handle(), sizeof(cpuset), &cpuset);
+    if (err != 0) {
+        std::cerr << "pthread_setaffinity_np(" << name << ", cpu " << cpu << ") failed: " << strerror(err) << std::endl;
+        return;
+    }
+    if (verbose >= 1)
+        std::cerr << name << " pinned to cpu " << cpu << std::endl;
+}
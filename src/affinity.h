@@ -0,0 +1,17 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_AFFINITY_H
+#define INCLUDED_RSP_SND_AFFINITY_H
+
+#include <thread>
+
+// pin a thread to one CPU (cpu < 0 leaves it to the scheduler)
+// a failure is reported but not fatal, since the stream still works
+void pin_thread(std::thread& thread, int cpu, const char *name, int verbose = 0);
+
+#endif /* INCLUDED_RSP_SND_AFFINITY_H */
@@ -8,26 +8,30 @@
 #ifndef INCLUDED_RSP_SND_AGC_H
 #define INCLUDED_RSP_SND_AGC_H
 
-#include "rsp.h"
+#include "in.h"
+#include "metadata.h"
+#include "ringbuffer.h"
 
 class Agc {
 
 public:
-    Agc(int verbose = 0): rsp(nullptr), verbose(verbose) {}
-    ~Agc() {}
+    Agc(int verbose = 0): in(nullptr), verbose(verbose) {}
+    virtual ~Agc() {}
 
     // setters
-    virtual void setRsp(Rsp* rsp) { this->rsp = rsp; }
+    virtual void setIn(In* in) { this->in = in; }
+    void setMetadata(RingBuffer<BlockInfo> *metadata) { this->metadata = metadata; }
 
     virtual void setup() {}
 
     // streaming
-    virtual void start(RingBuffer<short[2]> *buffer) {}
+    virtual void start(RingBuffer<short[2]> * /* buffer */) {}
     virtual void stop() {}
 
 protected:
-    Rsp *rsp;
+    In *in;
     int verbose;
+    RingBuffer<BlockInfo> *metadata = nullptr;
 };
 
 #endif /* INCLUDED_RSP_SND_AGC_H */
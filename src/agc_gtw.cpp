@@ -6,7 +6,10 @@
  */
 
 #include "agc_gtw.h"
+#include "metadata.h"
 #include "ringbuffer.h"
+#include "simd.h"
+#include <algorithm>
 #include <climits>
 #include <iostream>
 
@@ -33,8 +36,10 @@ AgcGtw::~AgcGtw()
 
 void AgcGtw::setup()
 {
-    gain_reduction = rsp->getIFGainReduction();
-    samples_per_millis = rsp->getSamplerate() / 1000;
+    gain_reduction = in->getIFGainReduction();
+    samples_per_millis = in->getSamplerate() / 1000;
+    if (samples_per_millis <= 0)
+        throw AgcGtw::Exception("sample rate too low for AGC GTW");
     if (verbose >= 1) {
         std::cerr << "enabled AGC GTW with" << std::endl;
         std::cerr << "  AGC1increaseThreshold=" << agc1_increase_threshold << std::endl;
@@ -71,28 +76,47 @@ void AgcGtw::stop()
 
 void AgcGtw::agc_loop(RingBuffer<short[2]> *buffer)
 {
-    auto read_ptr = buffer->next_read_ptr(nullptr);
+    auto reader = buffer->add_reader();
+    // no decision can be made before the end of the current millisecond
+    if (agc3_min_time_ms >= 0)
+        buffer->set_watermark(reader, samples_per_millis);
+    auto read_ptr = buffer->next_read_ptr(reader);
+    MetadataReader blocks(metadata);
     while (run) {
-        auto max_read_size = buffer->next_read_max_size(read_ptr, true);
+        auto max_read_size = buffer->next_read_max_size(reader, true);
+        // an overrun moves the read pointer
+        read_ptr = buffer->next_read_ptr(reader);
+        bool gain_changed = false;
 
         // AGC logic here
-        for (int i = 0; i < max_read_size; ++i) {
-            if (--samples_left == 0) {
+        // the millisecond counters only change at the end of each
+        // millisecond, so the samples up to there are measured in one go
+        // and the decision logic only runs at the millisecond boundaries
+        // (or at every sample if agc3_min_time_ms is negative)
+        size_t i = 0;
+        while (i < max_read_size) {
+            size_t block_size = agc3_min_time_ms < 0 ? 1 :
+                                std::min(static_cast<size_t>(samples_left), max_read_size - i);
+            int block_max_iq;
+            int block_above_threshold;
+            max_abs_iq(read_ptr + i, block_size, agc1_increase_threshold,
+                       block_max_iq, block_above_threshold);
+            i += block_size;
+            samples_left -= block_size;
+            if (samples_left == 0) {
                 millis_since_last_agc_check++;
                 millis_since_last_gain_change++;
                 samples_left = samples_per_millis;
             }
-            auto iq = std::max(abs(read_ptr[i][0]), abs(read_ptr[i][1]));
 
             // high water mark
-            max_iq = std::max(iq, max_iq);
+            max_iq = std::max(block_max_iq, max_iq);
 
-            // how long above high threshold
-            if (iq > agc1_increase_threshold) {
-                // prevent overflow
-                if (millis_iq_above_threshold < INT_MAX)
-                    millis_iq_above_threshold++;
-            }
+            // how long above high threshold (prevent overflow)
+            if (millis_iq_above_threshold > INT_MAX - block_above_threshold)
+                millis_iq_above_threshold = INT_MAX;
+            else
+                millis_iq_above_threshold += block_above_threshold;
 
             // check AGC only after agc3_min_time_ms have elapsed
             if (millis_since_last_agc_check <= agc3_min_time_ms)
@@ -111,19 +135,29 @@ void AgcGtw::agc_loop(RingBuffer<short[2]> *buffer)
             millis_iq_above_threshold = 0;
 
             // change IF gain reduction?
-            if (gain_reduction != rsp->getIFGainReduction()) {
+            if (gain_reduction != in->getIFGainReduction()) {
                 if (verbose >= 1)
-                    std::cerr << "updating gain_reduction from " << rsp->getIFGainReduction() << " to " << gain_reduction << std::endl;
-                rsp->setIFGainReduction(gain_reduction, true);
+                    std::cerr << "updating gain_reduction from " << in->getIFGainReduction() << " to " << gain_reduction << std::endl;
+                in->setIFGainReduction(gain_reduction, true);
                 millis_since_last_gain_change = 0;
-                // reset read_ptr
-                read_ptr = buffer->next_read_ptr(nullptr);
                 // skip the rest of the samples (they are from before the
                 // gain change) and go back to the main loop
+                gain_changed = true;
                 break;
             }
         }
 
-        read_ptr = buffer->next_read_ptr(read_ptr, max_read_size);
+        if (gain_changed) {
+            // reset read_ptr
+            read_ptr = buffer->reset_read_ptr(reader);
+        } else {
+            read_ptr = buffer->next_read_ptr(reader, max_read_size);
+        }
+
+        blocks.check(buffer->get_read_seq(reader), [this](const BlockInfo& block, const char *type, int64_t gap) {
+            if (verbose >= 1 && (block.flags & BLOCK_GAIN_CHANGED) == 0)
+                std::cerr << "AGC GTW stream " << type << " - gap: " << gap << std::endl;
+        });
     }
+    buffer->remove_reader(reader);
 }
@@ -10,7 +10,6 @@
 
 #include "agc.h"
 #include "ringbuffer.h"
-#include "rsp.h"
 #include <stdexcept>
 #include <thread>
 
@@ -26,6 +26,9 @@ AgcRsp::~AgcRsp()
 
 void AgcRsp::setup()
 {
+    auto rsp = dynamic_cast<Rsp *>(in);
+    if (rsp == nullptr)
+        throw AgcRsp::Exception("AGC RSP model requires an RSP input");
     rsp->setIFAgc(mode, setPoint_dBfs, attack_ms, decay_ms, decay_delay_ms,
                   decay_threshold_dB);
 }
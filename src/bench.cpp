@@ -0,0 +1,572 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// rsp_snd_bench - end-to-end throughput and latency benchmark
+// drives the ring buffer, the file sink, the GTW AGC, and the software
+// NCO, decimator and spectrum tap with a producer thread that writes callback sized
+// blocks like the SDRplay API does
+
+#include "agc_gtw.h"
+#include "capture.h"
+#include "decimator.h"
+#include "file.h"
+#include "in.h"
+#include "nco.h"
+#include "ringbuffer.h"
+#include "simd.h"
+#include "spectrum.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+
+class BenchConfig {
+public:
+    double sample_rate;
+    unsigned int block_size;
+    double duration;
+    bool paced;
+    bool agc;
+    int decimation;
+    double nco_frequency;
+    bool fuse;
+    size_t min_write_size;
+    SampleFormat format;
+    std::string format_name;
+    bool direct_io;
+    bool splice;
+    bool wav;
+    unsigned int compression_threads;
+    uint64_t rotate_size;
+    std::string spectrum_name;
+    std::string capture_name;
+    std::string out_name;
+    std::string json_name;
+    int verbose;
+};
+
+// producer that behaves like Rsp::stream_callback(); it measures how long
+// each 'callback' takes to hand its block over to the ring buffer
+class BenchSource: public In {
+
+public:
+    BenchSource(const BenchConfig& config):
+        In(config.verbose),
+        sample_rate(config.sample_rate),
+        block_size(config.block_size),
+        paced(config.paced),
+        gRdB(40),
+        xi(config.block_size),
+        xq(config.block_size)
+    {
+        for (unsigned int k = 0; k < block_size; k++) {
+            xi[k] = static_cast<short>(8192 * cos(0.01 * k));
+            xq[k] = static_cast<short>(8192 * sin(0.01 * k));
+        }
+        latencies.reserve(static_cast<size_t>(config.duration * sample_rate / block_size) + 1);
+    }
+
+    // setters
+    void setIFGainReduction(int gRdB, bool /* wait */ = false) override { this->gRdB = gRdB; }
+
+    // getters
+    double getSamplerate() const override { return sample_rate; }
+    int getIFGainReduction() const override { return gRdB; }
+
+    // streaming
+    void start(RingBuffer<short[2]> *buffer) override
+    {
+        this->buffer = buffer;
+        run = true;
+        thread = std::thread([this, buffer] { produce_loop(buffer); });
+    }
+
+    void stop() override
+    {
+        if (run) {
+            run = false;
+            if (thread.joinable())
+                thread.join();
+        }
+        buffer->stop();
+    }
+
+    uint64_t total_samples = 0;
+    std::vector<uint32_t> latencies;    // ns
+
+private:
+    void produce_loop(RingBuffer<short[2]> *buffer)
+    {
+        auto start_time = std::chrono::steady_clock::now();
+        auto write_ptr = buffer->next_write_ptr();
+        while (run) {
+            auto t0 = std::chrono::steady_clock::now();
+            interleave(write_ptr, xi.data(), xq.data(), block_size);
+            write_ptr = buffer->next_write_ptr(block_size);
+            auto t1 = std::chrono::steady_clock::now();
+            if (latencies.size() < latencies.capacity())
+                latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+            total_samples += block_size;
+            if (paced) {
+                auto elapsed = std::chrono::nanoseconds(static_cast<int64_t>(1e9 * total_samples / sample_rate));
+                std::this_thread::sleep_until(start_time + elapsed);
+            }
+        }
+    }
+
+    RingBuffer<short[2]> *buffer = nullptr;
+    double sample_rate;
+    unsigned int block_size;
+    bool paced;
+    int gRdB;
+    std::vector<short> xi;
+    std::vector<short> xq;
+    std::thread thread;
+    bool run = false;
+};
+
+class ReaderResult {
+public:
+    int reader;
+    uint64_t max_lag;
+    double mean_lag;
+    size_t max_read_size;
+    uint64_t overruns;
+    uint64_t lost_samples;
+    uint64_t wakeups;
+};
+
+static long context_switches()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) < 0)
+        return 0;
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+static void usage(const char* progname)
+{
+    std::cerr << "usage: " << progname << " [options...]" << std::endl;
+    std::cerr << "options:" << std::endl;
+    std::cerr << "    -a       also run the GTW AGC reader" << std::endl;
+    std::cerr << "    -b size  samples per producer block (default 1344)" << std::endl;
+    std::cerr << "    -c name  also run the pre-trigger capture (2s before, 1s after a trigger half way)" << std::endl;
+    std::cerr << "    -d dec   decimate by dec (a power of 2 from 2 to 32) in software before the file sink" << std::endl;
+    std::cerr << "    -F fmt   file sink sample format: s16 (default), s24_3le, s32, cf32" << std::endl;
+    std::cerr << "    -f       run the decimator on the NCO thread (with -n and -d)" << std::endl;
+    std::cerr << "    -h       show usage" << std::endl;
+    std::cerr << "    -n freq  shift by freq (in Hz) with the NCO before the file sink" << std::endl;
+    std::cerr << "    -j file  write the results as JSON to file ('-' for stdout)" << std::endl;
+    std::cerr << "    -o file  file sink output (default /dev/null)" << std::endl;
+    std::cerr << "    -p       pace the producer to the sample rate (default: as fast as possible)" << std::endl;
+    std::cerr << "    -R size  start a new file sink output file every size bytes" << std::endl;
+    std::cerr << "    -r rate  sample rate (in Hz) for the paced producer (default 10e6)" << std::endl;
+    std::cerr << "    -S       vmsplice() the file sink output when it is a pipe" << std::endl;
+    std::cerr << "    -s name  also run the spectrum tap, publishing to shared memory 'name'" << std::endl;
+    std::cerr << "    -t secs  duration (default 10)" << std::endl;
+    std::cerr << "    -u       write the file sink output with O_DIRECT through io_uring" << std::endl;
+    std::cerr << "    -v       enable verbose output" << std::endl;
+    std::cerr << "    -W       write the file sink output as WAV/RF64" << std::endl;
+    std::cerr << "    -w size  file sink minimum write size in samples (default 16384)" << std::endl;
+    std::cerr << "    -Z n     compress the file sink output with n threads" << std::endl;
+}
+
+static uint32_t percentile(const std::vector<uint32_t>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    auto idx = static_cast<size_t>(ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(sorted.size() - 1, idx > 0 ? idx - 1 : 0)];
+}
+
+int main(int argc, char *argv[])
+{
+    constexpr size_t RING_BUFFER_SIZE = 65536;
+    constexpr auto LAG_SAMPLE_INTERVAL = std::chrono::milliseconds(1);
+
+    BenchConfig config;
+    config.sample_rate = 10e6;
+    config.block_size = 1344;
+    config.duration = 10;
+    config.paced = false;
+    config.agc = false;
+    config.decimation = 1;
+    config.nco_frequency = 0;
+    config.fuse = false;
+    config.min_write_size = 16384;
+    config.format = SAMPLE_S16;
+    config.format_name = "s16";
+    config.direct_io = false;
+    config.splice = false;
+    config.wav = false;
+    config.compression_threads = 0;
+    config.rotate_size = 0;
+    config.out_name = "/dev/null";
+    config.verbose = 0;
+
+    int c;
+    while ((c = getopt(argc, argv, "ab:c:d:F:fhj:n:o:pR:r:Ss:t:uvWw:Z:")) != -1) {
+        switch (c) {
+            case 'a':
+                config.agc = true;
+                break;
+            case 'b':
+                config.block_size = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));
+                break;
+            case 'd':
+                config.decimation = atoi(optarg);
+                break;
+            case 'F':
+                config.format_name = optarg;
+                if (config.format_name == "s16") {
+                    config.format = SAMPLE_S16;
+                } else if (config.format_name == "s24_3le") {
+                    config.format = SAMPLE_S24_3LE;
+                } else if (config.format_name == "s32") {
+                    config.format = SAMPLE_S32;
+                } else if (config.format_name == "cf32") {
+                    config.format = SAMPLE_CF32;
+                } else {
+                    std::cerr << "invalid sample format: " << optarg << std::endl;
+                    exit(1);
+                }
+                break;
+            case 'f':
+                config.fuse = true;
+                break;
+            case 'j':
+                config.json_name = optarg;
+                break;
+            case 'n':
+                config.nco_frequency = strtod(optarg, nullptr);
+                break;
+            case 'o':
+                config.out_name = optarg;
+                break;
+            case 'p':
+                config.paced = true;
+                break;
+            case 'R':
+                config.rotate_size = strtoull(optarg, nullptr, 10);
+                break;
+            case 'r':
+                config.sample_rate = strtod(optarg, nullptr);
+                break;
+            case 's':
+                config.spectrum_name = optarg;
+                break;
+            case 'c':
+                config.capture_name = optarg;
+                break;
+            case 't':
+                config.duration = strtod(optarg, nullptr);
+                break;
+            case 'S':
+                config.splice = true;
+                break;
+            case 'u':
+                config.direct_io = true;
+                break;
+            case 'v':
+                config.verbose++;
+                break;
+            case 'W':
+                config.wav = true;
+                break;
+            case 'w':
+                config.min_write_size = strtoul(optarg, nullptr, 10);
+                break;
+            case 'Z':
+                config.compression_threads = strtoul(optarg, nullptr, 10);
+                break;
+            case 'h':
+                usage(argv[0]);
+                exit(0);
+            case '?':
+            default:
+                usage(argv[0]);
+                exit(1);
+        }
+    }
+    if (config.block_size == 0 || config.block_size >= RING_BUFFER_SIZE ||
+        // the decimator takes powers of 2 up to 32 (1 = no decimator)
+        config.decimation < 1 || config.decimation > 32 ||
+        (config.decimation & (config.decimation - 1)) != 0 ||
+        config.sample_rate <= 0 || config.duration <= 0) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    RingBuffer<short[2]> ringbuffer(RING_BUFFER_SIZE, config.verbose);
+    BenchSource source(config);
+
+    // each stage writes to its own ring buffer; the file sink reads the last one
+    Nco *nco = nullptr;
+    Decimator *decimator = nullptr;
+    std::vector<Stage *> stages;
+    if (config.nco_frequency != 0) {
+        nco = new Nco(config.nco_frequency, config.sample_rate, config.verbose);
+        stages.push_back(nco);
+    }
+    if (config.decimation > 1) {
+        DecimatorConfig decimator_config;
+        decimator_config.factor = config.decimation;
+        decimator_config.attenuation = 80;
+        decimator_config.passband = 0.9;
+        decimator = new Decimator(decimator_config, config.sample_rate, config.verbose);
+        if (nco != nullptr && config.fuse)
+            nco->addFused(decimator);
+        stages.push_back(decimator);
+    }
+    std::vector<RingBuffer<short[2]> *> stage_ringbuffers;
+    for (size_t i = 0; i < stages.size(); i++)
+        stage_ringbuffers.push_back(new RingBuffer<short[2]>(RING_BUFFER_SIZE, config.verbose));
+    RingBuffer<short[2]> *file_ringbuffer = stages.empty() ? &ringbuffer : stage_ringbuffers.back();
+
+    FileConfig file_config;
+    file_config.name = config.out_name;
+    file_config.overrun_policy = OVERRUN_RESYNC;
+    file_config.min_write_size = config.min_write_size;
+    file_config.format = config.format;
+    file_config.scale = 1;
+    file_config.max_wait_ms = 100;
+    file_config.direct_io = config.direct_io;
+    file_config.io_buffer_size = 1048576;
+    file_config.io_queue_depth = 8;
+    file_config.preallocate = 268435456;
+    file_config.container = config.compression_threads > 0 ? CONTAINER_COMPRESSED : config.wav ? CONTAINER_WAV : CONTAINER_RAW;
+    file_config.header_update_ms = 1000;
+    file_config.rotate_size = config.rotate_size;
+    file_config.rotate_interval = 0;
+    file_config.sigmf = config.rotate_size > 0;
+    file_config.splice = config.splice;
+    file_config.pipe_size = 0;
+    file_config.sample_rate = stages.empty() ? config.sample_rate : stages.back()->getSamplerate();
+    file_config.frequency = 0;
+    file_config.gain_reduction = 40;
+    file_config.lna_state = 0;
+    file_config.compression_block_size = 16384;
+    file_config.compression_threads = config.compression_threads;
+    file_config.lpc_order = 8;
+    File<short[2]> file(file_config, config.verbose);
+
+    AgcGtw *agc = nullptr;
+    if (config.agc) {
+        AgcGtwConfig agc_gtw_config;
+        agc_gtw_config.agc1_increase_threshold = 16384;
+        agc_gtw_config.agc2_decrease_threshold = 8192;
+        agc_gtw_config.agc3_min_time_ms = 500;
+        agc_gtw_config.min_gain_reduction = 30;
+        agc_gtw_config.max_gain_reduction = 59;
+        agc_gtw_config.gainstep_dec = 1;
+        agc_gtw_config.gainstep_inc = 1;
+        agc_gtw_config.agc4_a = 4096;
+        agc_gtw_config.agc5_b = 1000;
+        agc_gtw_config.agc6_c = 5000;
+        agc = new AgcGtw(agc_gtw_config, config.verbose);
+        agc->setIn(&source);
+        agc->setup();
+    }
+
+    Spectrum *spectrum = nullptr;
+    if (!config.spectrum_name.empty()) {
+        SpectrumConfig spectrum_config;
+        spectrum_config.name = config.spectrum_name;
+        spectrum_config.fft_size = 1024;
+        spectrum_config.averaging = 4;
+        spectrum_config.frame_rate = 10;
+        spectrum = new Spectrum(spectrum_config, config.sample_rate, 0, config.verbose);
+    }
+
+    Capture *capture = nullptr;
+    if (!config.capture_name.empty()) {
+        CaptureConfig capture_config;
+        capture_config.name = config.capture_name;
+        capture_config.input = "";
+        capture_config.pre_trigger = 2;
+        capture_config.post_trigger = 1;
+        capture_config.huge_pages = true;
+        capture_config.control_socket = "";
+        capture_config.trigger_level = 0;
+        capture_config.cpu = -1;
+        FileConfig capture_file_config = file_config;
+        capture_file_config.rotate_size = 0;
+        capture_file_config.sigmf = true;
+        capture = new Capture(capture_config, capture_file_config, config.sample_rate, 0, config.verbose);
+    }
+
+    // start the readers first, so they see the whole stream (and a fused
+    // stage before the stage that drives it)
+    file.start(file_ringbuffer);
+    for (size_t i = stages.size(); i-- > 0; )
+        stages[i]->start(i == 0 ? &ringbuffer : stage_ringbuffers[i - 1],
+                         stage_ringbuffers[i]);
+    if (agc != nullptr)
+        agc->start(&ringbuffer);
+    if (spectrum != nullptr)
+        spectrum->start(&ringbuffer);
+    if (capture != nullptr)
+        capture->start(&ringbuffer);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // sample the reader lag while the benchmark runs
+    uint64_t max_lag[RingBuffer<short[2]>::MAX_READERS] = {};
+    double sum_lag[RingBuffer<short[2]>::MAX_READERS] = {};
+    uint64_t nlag = 0;
+
+    auto start_context_switches = context_switches();
+    auto start_time = std::chrono::steady_clock::now();
+    auto end_time = start_time + std::chrono::nanoseconds(static_cast<int64_t>(config.duration * 1e9));
+    auto trigger_time = start_time + (end_time - start_time) / 2;
+    source.start(&ringbuffer);
+    while (std::chrono::steady_clock::now() < end_time) {
+        std::this_thread::sleep_for(LAG_SAMPLE_INTERVAL);
+        if (capture != nullptr && std::chrono::steady_clock::now() >= trigger_time) {
+            capture->trigger("bench");
+            trigger_time = std::chrono::steady_clock::time_point::max();
+        }
+        for (int i = 0; i < RingBuffer<short[2]>::MAX_READERS; i++) {
+            if (!ringbuffer.is_active(i))
+                continue;
+            auto lag = ringbuffer.get_lag(i);
+            max_lag[i] = std::max(max_lag[i], lag);
+            sum_lag[i] += lag;
+        }
+        nlag++;
+    }
+
+    // collect the reader statistics before the readers go away
+    std::vector<ReaderResult> readers;
+    for (int i = 0; i < RingBuffer<short[2]>::MAX_READERS; i++) {
+        if (!ringbuffer.is_active(i))
+            continue;
+        ReaderResult r;
+        r.reader = i;
+        r.max_lag = max_lag[i];
+        r.mean_lag = nlag > 0 ? sum_lag[i] / nlag : 0;
+        r.max_read_size = ringbuffer.get_max_read_size(i);
+        r.overruns = ringbuffer.get_overruns(i);
+        r.lost_samples = ringbuffer.get_lost_samples(i);
+        r.wakeups = ringbuffer.get_wakeups(i);
+        readers.push_back(r);
+    }
+
+    source.stop();
+    for (auto stage : stages)
+        stage->stop();
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    auto switch_rate = (context_switches() - start_context_switches) / elapsed;
+    if (agc != nullptr) {
+        agc->stop();
+        delete agc;
+        agc = nullptr;
+    }
+    file.stop();
+    double capture_cpu = 0;
+    if (capture != nullptr) {
+        capture->stop();
+        capture_cpu = 100 * capture->getCpuTime() / elapsed;
+        delete capture;
+        capture = nullptr;
+    }
+    double spectrum_cpu = 0;
+    if (spectrum != nullptr) {
+        spectrum->stop();
+        spectrum_cpu = 100 * spectrum->getCpuTime() / elapsed;
+        delete spectrum;
+        spectrum = nullptr;
+    }
+    double nco_cpu = nco != nullptr ? 100 * nco->getCpuTime() / elapsed : 0;
+    double decimator_cpu = decimator != nullptr ? 100 * decimator->getCpuTime() / elapsed : 0;
+    for (auto stage : stages)
+        delete stage;
+    for (auto stage_ringbuffer : stage_ringbuffers)
+        delete stage_ringbuffer;
+
+    auto latencies = source.latencies;
+    std::sort(latencies.begin(), latencies.end());
+    auto rate = source.total_samples / elapsed;
+
+    std::ostringstream results;
+    results << std::fixed << std::setprecision(3);
+    results << "{" << std::endl;
+    results << "  \"sample_rate\": " << (config.paced ? config.sample_rate : 0) << "," << std::endl;
+    results << "  \"paced\": " << (config.paced ? "true" : "false") << "," << std::endl;
+    results << "  \"block_size\": " << config.block_size << "," << std::endl;
+    results << "  \"format\": \"" << config.format_name << "\"," << std::endl;
+    results << "  \"rotate_size\": " << config.rotate_size << "," << std::endl;
+    results << "  \"wav\": " << (config.wav ? "true" : "false") << "," << std::endl;
+    results << "  \"compression_threads\": " << config.compression_threads << "," << std::endl;
+    results << "  \"splice\": " << (config.splice ? "true" : "false") << "," << std::endl;
+    results << "  \"direct_io\": " << (config.direct_io ? "true" : "false") << "," << std::endl;
+    results << "  \"duration\": " << elapsed << "," << std::endl;
+    results << "  \"simd\": \"" << simd_isa() << "\"," << std::endl;
+    results << "  \"total_samples\": " << source.total_samples << "," << std::endl;
+    results << "  \"throughput_msps\": " << rate / 1e6 << "," << std::endl;
+    results << "  \"write_latency_ns\": { \"p50\": " << percentile(latencies, 50)
+            << ", \"p99\": " << percentile(latencies, 99)
+            << ", \"p99.9\": " << percentile(latencies, 99.9)
+            << ", \"max\": " << (latencies.empty() ? 0 : latencies.back()) << " }," << std::endl;
+    results << "  \"context_switches_per_sec\": " << switch_rate << "," << std::endl;
+    results << "  \"decimation\": " << config.decimation << "," << std::endl;
+    results << "  \"decimator_cpu_percent\": " << decimator_cpu << "," << std::endl;
+    results << "  \"nco_frequency\": " << config.nco_frequency << "," << std::endl;
+    results << "  \"nco_cpu_percent\": " << nco_cpu << "," << std::endl;
+    results << "  \"fused\": " << (config.fuse ? "true" : "false") << "," << std::endl;
+    results << "  \"spectrum_cpu_percent\": " << spectrum_cpu << "," << std::endl;
+    results << "  \"capture_cpu_percent\": " << capture_cpu << "," << std::endl;
+    results << "  \"readers\": [" << std::endl;
+    for (size_t i = 0; i < readers.size(); i++) {
+        auto& r = readers[i];
+        results << "    { \"reader\": " << r.reader
+                << ", \"max_lag\": " << r.max_lag
+                << ", \"mean_lag\": " << r.mean_lag
+                << ", \"max_read_size\": " << r.max_read_size
+                << ", \"overruns\": " << r.overruns
+                << ", \"lost_samples\": " << r.lost_samples
+                << ", \"wakeups_per_sec\": " << r.wakeups / elapsed
+                << " }" << (i + 1 < readers.size() ? "," : "") << std::endl;
+    }
+    results << "  ]" << std::endl;
+    results << "}" << std::endl;
+
+    std::cerr << std::fixed << std::setprecision(3);
+    std::cerr << "throughput: " << rate / 1e6 << " MS/s (" << (config.paced ? "paced" : "unpaced") << ", " << config.block_size << " samples/block, " << config.format_name << ", " << simd_isa() << ")" << std::endl;
+    std::cerr << "write latency (ns) - p50: " << percentile(latencies, 50) << " - p99: " << percentile(latencies, 99) << " - p99.9: " << percentile(latencies, 99.9) << std::endl;
+    std::cerr << "context switches: " << switch_rate << "/s" << std::endl;
+    if (config.decimation > 1)
+        std::cerr << "decimator (by " << config.decimation << "): " << decimator_cpu << "% of a core" << std::endl;
+    if (nco != nullptr)
+        std::cerr << "NCO (" << config.nco_frequency << " Hz): " << nco_cpu << "% of a core" << (config.fuse && decimator != nullptr ? " (including the fused decimator)" : "") << std::endl;
+    if (!config.spectrum_name.empty())
+        std::cerr << "spectrum tap: " << spectrum_cpu << "% of a core" << std::endl;
+    if (!config.capture_name.empty())
+        std::cerr << "capture: " << capture_cpu << "% of a core" << std::endl;
+    for (auto& r : readers)
+        std::cerr << "reader " << r.reader << " - lag max: " << r.max_lag << " - mean: " << r.mean_lag << " - overruns: " << r.overruns << " - lost samples: " << r.lost_samples << " - wakeups: " << r.wakeups / elapsed << "/s" << std::endl;
+
+    if (config.json_name == "-") {
+        std::cout << results.str();
+    } else if (!config.json_name.empty()) {
+        std::ofstream json_file(config.json_name);
+        if (!json_file) {
+            std::cerr << "cannot write " << config.json_name << std::endl;
+            return 1;
+        }
+        json_file << results.str();
+    }
+    return 0;
+}
@@ -0,0 +1,377 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "affinity.h"
+#include "capture.h"
+#include "sample_format.h"
+#include "segment.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+static constexpr size_t CAPTURE_MIN_READ_SIZE = 16384;
+static constexpr unsigned int CAPTURE_MAX_WAIT_MS = 50;
+// samples per write() of a dump
+static constexpr size_t CAPTURE_DUMP_CHUNK = 262144;
+// room in the store for the dump to fall behind the incoming samples
+static constexpr double CAPTURE_SLACK = 1.0;     // s
+static constexpr double CAPTURE_LEVEL_WINDOW = 0.01;    // s
+static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+static constexpr double FULL_SCALE = 32768;
+
+
+Capture::Capture(const CaptureConfig& config, const FileConfig& file_config,
+                 double sample_rate, double frequency, int verbose):
+    file_config(file_config),
+    sample_rate(sample_rate),
+    pre_samples(static_cast<uint64_t>(config.pre_trigger * sample_rate)),
+    post_samples(static_cast<uint64_t>(config.post_trigger * sample_rate)),
+    verbose(verbose),
+    cpu(config.cpu),
+    store(nullptr),
+    store_bytes(0),
+    capacity(0),
+    write_seq(0),
+    level_window(std::max(static_cast<size_t>(CAPTURE_LEVEL_WINDOW * sample_rate), static_cast<size_t>(1))),
+    level_threshold(0),
+    level_sum(0),
+    level_count(0),
+    level_armed(true),
+    has_pending(false),
+    capturing(false),
+    dumps(0),
+    control_socket(config.control_socket),
+    listen_fd(-1),
+    run(false)
+{
+    if (config.pre_trigger < 0 || config.post_trigger < 0 || pre_samples + post_samples == 0)
+        throw Capture::Exception("invalid capture window");
+    if (file_config.container == CONTAINER_COMPRESSED && file_config.format != SAMPLE_S16)
+        throw Capture::Exception("compressed files are S16 only");
+    this->file_config.name = config.name;
+    this->file_config.sample_rate = sample_rate;
+    this->file_config.frequency = frequency;
+    // 0 dBFS is a full scale complex tone (I^2 + Q^2 = FULL_SCALE^2), as
+    // in the spectrum tap
+    if (config.trigger_level < 0)
+        level_threshold = pow(10, config.trigger_level / 10) * FULL_SCALE * FULL_SCALE * level_window;
+
+    // the whole store is faulted in here, so the capture thread never
+    // waits for a page fault
+    auto slack = static_cast<uint64_t>(CAPTURE_SLACK * sample_rate);
+    store_bytes = (pre_samples + post_samples + slack) * sizeof(short[2]);
+    store_bytes = (store_bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    void *addr = MAP_FAILED;
+    if (config.huge_pages) {
+        addr = mmap(nullptr, store_bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        if (addr == MAP_FAILED)
+            std::cerr << "capture store: no huge pages (" << strerror(errno) << ") - using transparent huge pages" << std::endl;
+    }
+    if (addr == MAP_FAILED) {
+        addr = mmap(nullptr, store_bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED)
+            throw Capture::Exception("mmap() capture store failed");
+        if (config.huge_pages)
+            madvise(addr, store_bytes, MADV_HUGEPAGE);
+        memset(addr, 0, store_bytes);
+    }
+    store = static_cast<short (*)[2]>(addr);
+    capacity = store_bytes / sizeof(short[2]);
+
+    if (!control_socket.empty()) {
+        struct sockaddr_un sun;
+        if (control_socket.size() >= sizeof(sun.sun_path)) {
+            munmap(store, store_bytes);
+            throw Capture::Exception("capture control socket path too long");
+        }
+        memset(&sun, 0, sizeof(sun));
+        sun.sun_family = AF_UNIX;
+        strcpy(sun.sun_path, control_socket.c_str());
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        unlink(control_socket.c_str());
+        if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<struct sockaddr *>(&sun), sizeof(sun)) < 0 ||
+            listen(listen_fd, 4) < 0) {
+            std::cerr << "capture control socket " << control_socket << " failed: " << strerror(errno) << std::endl;
+            if (listen_fd >= 0)
+                close(listen_fd);
+            munmap(store, store_bytes);
+            throw Capture::Exception("capture control socket failed");
+        }
+    }
+    if (verbose >= 1)
+        std::cerr << "capture " << config.name << " - pre-trigger: " << config.pre_trigger << "s - post-trigger: " << config.post_trigger << "s - store: " << store_bytes << " bytes" << std::endl;
+}
+
+Capture::~Capture()
+{
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(control_socket.c_str());
+    }
+    if (store != nullptr)
+        munmap(store, store_bytes);
+}
+
+
+// any thread
+std::string Capture::trigger(const std::string& source)
+{
+    return trigger_at(source, write_seq.load(std::memory_order_acquire));
+}
+
+std::string Capture::trigger_at(const std::string& source, uint64_t trigger)
+{
+    std::string name;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (capturing || !run)
+            return "";
+        name = get_segment_name(file_config.name, dumps++);
+        pending = { name, source, trigger - std::min(trigger, pre_samples),
+                    trigger, trigger + post_samples, std::chrono::system_clock::now() };
+        has_pending = true;
+        capturing = true;
+        current_name = name;
+    }
+    cond.notify_all();
+    if (verbose >= 1)
+        std::cerr << "capture triggered (" << source << ") - dumping to " << name << std::endl;
+    return name;
+}
+
+
+// streaming
+void Capture::start(RingBuffer<short[2]> *buffer)
+{
+    run = true;
+    write_seq = 0;
+    dump_thread = std::thread([this] { dump_loop(); });
+    if (listen_fd >= 0)
+        control_thread = std::thread([this] { control_loop(); });
+    thread = std::thread([this, buffer] { capture_loop(buffer); });
+    pin_thread(thread, cpu, "capture", verbose);
+}
+
+// a dump in progress is cut short at the last captured sample
+void Capture::stop()
+{
+    if (run) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            run = false;
+        }
+        cond.notify_all();
+        if (thread.joinable())
+            thread.join();
+        if (dump_thread.joinable())
+            dump_thread.join();
+        if (control_thread.joinable())
+            control_thread.join();
+    }
+    if (verbose >= 1)
+        std::cerr << "capture samples: " << write_seq << " - dumps: " << dumps << " - cpu time: " << cpu_time << "s" << std::endl;
+}
+
+void Capture::capture_loop(RingBuffer<short[2]> *buffer)
+{
+    auto reader = buffer->add_reader(OVERRUN_RESYNC);
+    buffer->set_watermark(reader, CAPTURE_MIN_READ_SIZE, CAPTURE_MAX_WAIT_MS);
+    auto read_ptr = buffer->next_read_ptr(reader);
+    uint64_t total_lost_samples = 0;
+    while (run) {
+        auto count = buffer->next_read_max_size(reader, true);
+        auto lost_samples = buffer->get_lost_samples(reader);
+        if (lost_samples != total_lost_samples) {
+            // the read pointer has moved
+            read_ptr = buffer->next_read_ptr(reader);
+            std::lock_guard<std::mutex> lock(mutex);
+            events.emplace_back(write_seq.load(std::memory_order_relaxed), "overrun " + std::to_string(lost_samples - total_lost_samples));
+            total_lost_samples = lost_samples;
+        }
+        if (count == 0)
+            continue;
+
+        // the store is not mirrored, so a chunk may wrap around its end
+        auto seq = write_seq.load(std::memory_order_relaxed);
+        auto pos = seq % capacity;
+        auto first = std::min(static_cast<uint64_t>(count), capacity - pos);
+        memcpy(store + pos, read_ptr, first * sizeof(short[2]));
+        if (first < count)
+            memcpy(store, read_ptr + first, (count - first) * sizeof(short[2]));
+        write_seq.store(seq + count, std::memory_order_release);
+        if (level_threshold > 0)
+            detect(read_ptr, count, seq);
+        read_ptr = buffer->next_read_ptr(reader, count);
+    }
+    buffer->remove_reader(reader);
+
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        cpu_time = ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// the detector triggers at the end of the first window whose average power
+// is above the level, and is armed again once it has gone below; 'seq' is
+// the store position of in[0]
+void Capture::detect(const short (*in)[2], size_t count, uint64_t seq)
+{
+    for (size_t k = 0; k < count; k++) {
+        // each square fits in an int, their sum may not
+        level_sum += in[k][0] * in[k][0];
+        level_sum += in[k][1] * in[k][1];
+        if (++level_count < level_window)
+            continue;
+        bool above = level_sum > level_threshold;
+        if (above && level_armed && !trigger_at("level", seq + k + 1).empty())
+            level_armed = false;
+        else if (!above)
+            level_armed = true;
+        level_sum = 0;
+        level_count = 0;
+    }
+}
+
+
+// dumps
+void Capture::dump_loop()
+{
+    while (true) {
+        Dump job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [this] { return has_pending || !run; });
+            if (!has_pending)
+                break;
+            job = pending;
+            has_pending = false;
+        }
+        dump(job);
+        std::lock_guard<std::mutex> lock(mutex);
+        capturing = false;
+        current_name.clear();
+        // older overruns can't be in a dump any more
+        auto oldest = write_seq.load(std::memory_order_relaxed);
+        oldest = oldest > capacity ? oldest - capacity : 0;
+        events.erase(std::remove_if(events.begin(), events.end(),
+                                    [oldest](const std::pair<uint64_t, std::string>& e) { return e.first < oldest; }),
+                     events.end());
+    }
+}
+
+void Capture::dump(const Dump& job)
+{
+    FileSegment *segment;
+    try {
+        segment = new FileSegment(file_config, job.name, verbose);
+    } catch (const std::runtime_error& e) {
+        std::cerr << "capture dump " << job.name << " failed: " << e.what() << std::endl;
+        return;
+    }
+    auto pre = std::chrono::duration<double>((job.trigger - job.start) / sample_rate);
+    segment->begin(0, nullptr, job.trigger_time - std::chrono::duration_cast<std::chrono::system_clock::duration>(pre));
+    segment->annotate(job.trigger - job.start, "trigger " + job.source);
+
+    SampleConverter converter(file_config.format, file_config.scale);
+    auto frame_size = converter.getFrameSize();
+    auto seq = job.start;
+    bool lost = false;
+    while (seq < job.end) {
+        auto available = write_seq.load(std::memory_order_acquire);
+        if (available - seq > capacity) {
+            lost = true;
+            break;
+        }
+        auto count = std::min(available, job.end) - seq;
+        if (count == 0) {
+            if (!run)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(CAPTURE_MAX_WAIT_MS));
+            continue;
+        }
+        auto pos = seq % capacity;
+        count = std::min(std::min(count, static_cast<uint64_t>(CAPTURE_DUMP_CHUNK)), capacity - pos);
+        auto data = converter.convert(store + pos, count);
+        auto bytecount = count * frame_size;
+        auto nwritten = segment->write(data, bytecount);
+        if (nwritten != static_cast<ssize_t>(bytecount)) {
+            std::cerr << "capture dump " << job.name << " write() failed: " << (nwritten < 0 ? strerror(errno) : "incomplete") << std::endl;
+            break;
+        }
+        // the capture thread may have overwritten what was just written
+        if (write_seq.load(std::memory_order_acquire) - seq > capacity) {
+            lost = true;
+            break;
+        }
+        seq += count;
+    }
+    if (lost)
+        std::cerr << "capture dump " << job.name << " fell behind the incoming samples - cut short" << std::endl;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& event : events)
+            if (event.first >= job.start && event.first < seq)
+                segment->annotate(event.first - job.start, event.second);
+    }
+    segment->finish();
+    delete segment;
+    if (verbose >= 1)
+        std::cerr << "capture dump " << job.name << " done - samples: " << seq - job.start << std::endl;
+}
+
+
+// control socket: one command per connection, one line of reply
+void Capture::control_loop()
+{
+    while (run) {
+        struct pollfd pfd = { listen_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, CAPTURE_MAX_WAIT_MS) <= 0)
+            continue;
+        auto fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+            continue;
+        struct timeval timeout = { 1, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        char buf[256];
+        auto n = read(fd, buf, sizeof(buf) - 1);
+        if (n > 0) {
+            buf[n] = '\0';
+            std::string line(buf);
+            line.erase(std::find_if(line.rbegin(), line.rend(),
+                                    [](unsigned char c) { return !std::isspace(c); }).base(),
+                       line.end());
+            auto reply = command(line) + "\n";
+            if (write(fd, reply.c_str(), reply.size()) < 0 && verbose >= 1)
+                std::cerr << "capture control socket write() failed: " << strerror(errno) << std::endl;
+        }
+        close(fd);
+    }
+}
+
+std::string Capture::command(const std::string& line)
+{
+    if (line == "trigger") {
+        auto name = trigger("socket");
+        return name.empty() ? "busy" : "ok " + name;
+    } else if (line == "status") {
+        std::lock_guard<std::mutex> lock(mutex);
+        return capturing ? "capturing " + current_name : "idle";
+    }
+    return "unknown command: " + line;
+}
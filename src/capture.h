@@ -0,0 +1,130 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_CAPTURE_H
+#define INCLUDED_RSP_SND_CAPTURE_H
+
+#include "file.h"
+#include "ringbuffer.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class CaptureConfig {
+public:
+    std::string name;                // dump file name ("" = off); dumps are name-000000.ext, ...
+    std::string input;               // ring buffer to capture ("" = the input)
+    double pre_trigger;              // s kept before a trigger
+    double post_trigger;             // s recorded after a trigger
+    bool huge_pages;                 // back the store with huge pages
+    std::string control_socket;      // Unix socket for commands ("" = none)
+    double trigger_level;            // dBFS (10 ms average) that triggers a dump (0 = off)
+    int cpu;                         // CPU to pin the capture thread to (-1 = any)
+};
+
+// pre-trigger capture ("time machine")
+// the capture thread copies every sample of its ring buffer into a large
+// circular store in memory, which always holds the last pre_trigger +
+// post_trigger seconds; a trigger (trigger(), the control socket, or the
+// level detector) has the dump thread write the window from pre_trigger
+// seconds before the trigger to post_trigger seconds after it to a new
+// file, with the [file] settings (format, container, SigMF, direct I/O)
+// the dump reads the store while the capture thread goes on writing it;
+// the store has room for the whole window plus some slack, so the dump
+// only loses samples if the disk is slower than the samples come in
+// only one dump at a time: a trigger during a dump is ignored
+class Capture {
+
+public:
+    Capture(const CaptureConfig& config, const FileConfig& file_config,
+            double sample_rate, double frequency, int verbose = 0);
+    ~Capture();
+
+    // getters
+    double getCpuTime() const { return cpu_time; }  // s (after stop())
+
+    // any thread; returns the name of the dump file, or "" if a dump is
+    // already in progress
+    std::string trigger(const std::string& source);
+
+    // streaming
+    void start(RingBuffer<short[2]> *buffer);
+    void stop();
+
+    class Exception: public std::runtime_error {
+    public:
+        Exception(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+private:
+    // one dump: store positions [start, end), triggered at 'trigger'
+    struct Dump {
+        std::string name;
+        std::string source;
+        uint64_t start;
+        uint64_t trigger;
+        uint64_t end;
+        std::chrono::system_clock::time_point trigger_time;
+    };
+
+    void capture_loop(RingBuffer<short[2]> *buffer);
+    std::string trigger_at(const std::string& source, uint64_t trigger);
+    void detect(const short (*in)[2], size_t count, uint64_t seq);
+    void dump_loop();
+    void dump(const Dump& job);
+    void control_loop();
+    std::string command(const std::string& line);
+
+    FileConfig file_config;
+    double sample_rate;
+    uint64_t pre_samples;
+    uint64_t post_samples;
+    int verbose;
+    int cpu;
+
+    // the store; write_seq counts the samples written since start()
+    short (*store)[2];
+    size_t store_bytes;
+    uint64_t capacity;               // samples
+    std::atomic<uint64_t> write_seq;
+
+    // level detector: power summed over windows of level_window samples
+    size_t level_window;
+    double level_threshold;          // sum of I^2 + Q^2 over a window (0 = off)
+    int64_t level_sum;
+    size_t level_count;
+    bool level_armed;
+
+    // dumps
+    std::mutex mutex;
+    std::condition_variable cond;
+    Dump pending;
+    bool has_pending;
+    bool capturing;
+    std::string current_name;
+    unsigned int dumps;
+    // ring buffer overruns at store positions, for the SigMF annotations
+    std::vector<std::pair<uint64_t, std::string>> events;
+
+    std::string control_socket;
+    int listen_fd;
+
+    std::thread thread;
+    std::thread dump_thread;
+    std::thread control_thread;
+    std::atomic<bool> run;
+    double cpu_time = 0;
+};
+
+#endif /* INCLUDED_RSP_SND_CAPTURE_H */
@@ -0,0 +1,224 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "channelizer.h"
+#include "filter.h"
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <iostream>
+
+
+static constexpr size_t MAX_BRANCHES = 4096;
+// a channel must fit within this fraction of the bin spacing from the bin
+// center; the prototype filter is flat up to there, and the 2x oversampled
+// outputs are alias free up to there too
+static constexpr double BIN_PASSBAND = 0.75;
+static constexpr size_t CHANNELIZER_MIN_READ_SIZE = 1024;
+static constexpr unsigned int CHANNELIZER_MAX_WAIT_MS = 5;
+static constexpr size_t CHANNELIZER_MAX_CHUNK = 8192;
+
+// the largest number of branches that keeps every channel inside one bin
+static size_t choose_branches(const ChannelizerConfig& config, double input_rate)
+{
+    if (config.channels.empty())
+        throw Channelizer::Exception("no channels");
+    for (const auto& channel : config.channels) {
+        if (channel.sample_rate <= 0)
+            throw Channelizer::Exception("invalid channel sample rate");
+        if (std::abs(channel.offset) + channel.sample_rate / 2 > input_rate / 2)
+            throw Channelizer::Exception("channel outside the input band");
+    }
+    for (size_t m = MAX_BRANCHES; m >= 2; m /= 2) {
+        double spacing = input_rate / m;
+        bool fits = true;
+        for (const auto& channel : config.channels) {
+            double residual = channel.offset - spacing * std::round(channel.offset / spacing);
+            fits = fits && std::abs(residual) + channel.sample_rate / 2 <= spacing * BIN_PASSBAND;
+        }
+        if (fits)
+            return m;
+    }
+    throw Channelizer::Exception("channel is too wide for the channelizer");
+}
+
+Channelizer::Channelizer(const ChannelizerConfig& config, double input_rate, int verbose):
+    verbose(verbose),
+    input_rate(input_rate),
+    nbranches(choose_branches(config, input_rate)),
+    fft(nbranches)
+{
+    // prototype lowpass: flat to BIN_PASSBAND bins, stopband from
+    // 2 - BIN_PASSBAND bins (where the images of the decimation start)
+    double spacing = 1.0 / nbranches;
+    double transition = (2 - 2 * BIN_PASSBAND) * spacing;
+    int ntaps = kaiser_ntaps(config.attenuation, transition);
+    taps = (ntaps + nbranches - 1) / nbranches;
+    ntaps = taps * nbranches;
+    auto h = kaiser_lowpass(ntaps, spacing, kaiser_beta(config.attenuation));
+
+    // branch i of group r is h[r * M + M - 1 - i], so that polyphase_iq()
+    // walks the input forward; the FFT of the reversed branches is the
+    // wanted (inverse) transform times exp(-2 pi j k / M)
+    coeffs.resize(ntaps);
+    for (size_t r = 0; r < taps; r++)
+        for (size_t i = 0; i < nbranches; i++)
+            coeffs[r * nbranches + i] = static_cast<float>(h[r * nbranches + nbranches - 1 - i]);
+
+    for (const auto& channel : config.channels) {
+        auto k = std::lround(channel.offset * nbranches / input_rate);
+        auto bin = static_cast<size_t>((k % static_cast<long>(nbranches) + nbranches) % nbranches);
+        bins.push_back(bin);
+        residuals.push_back(channel.offset - k * input_rate / nbranches);
+        rotations.push_back(std::polar(1.0f, static_cast<float>(-2 * M_PI * bin / nbranches)));
+        if (verbose >= 1)
+            std::cerr << "channel " << bins.size() << " - offset: " << channel.offset << " Hz - bin: " << k << " - residual: " << residuals.back() << " Hz" << std::endl;
+    }
+    re.resize(nbranches);
+    im.resize(nbranches);
+    reset();
+
+    if (verbose >= 1)
+        std::cerr << "channelizer " << nbranches << " branches - " << taps << " taps per branch - " << getSamplerate() << " Hz per channel" << std::endl;
+}
+
+Channelizer::~Channelizer() {}
+
+
+// getters
+double Channelizer::getSamplerate() const
+{
+    return 2 * input_rate / nbranches;
+}
+
+double Channelizer::getResidual(size_t channel) const
+{
+    return residuals[channel];
+}
+
+
+// streaming
+void Channelizer::start(RingBuffer<short[2]> *input,
+                        const std::vector<RingBuffer<short[2]> *>& outputs)
+{
+    if (outputs.size() != bins.size())
+        throw Channelizer::Exception("one output per channel is required");
+    run = true;
+    total_input = 0;
+    total_output = 0;
+    thread = std::thread([this, input, outputs] { process_loop(input, outputs); });
+}
+
+void Channelizer::stop()
+{
+    if (run) {
+        run = false;
+        if (thread.joinable())
+            thread.join();
+    }
+    if (verbose >= 1)
+        std::cerr << "channelizer total input samples: " << total_input << " - output samples per channel: " << total_output << " - cpu time: " << cpu_time << "s" << std::endl;
+}
+
+// same as Stage::process_loop(), with several outputs
+void Channelizer::process_loop(RingBuffer<short[2]> *input,
+                               std::vector<RingBuffer<short[2]> *> outputs)
+{
+    auto reader = input->add_reader(OVERRUN_RESYNC);
+    input->set_watermark(reader, CHANNELIZER_MIN_READ_SIZE, CHANNELIZER_MAX_WAIT_MS);
+    auto read_ptr = input->next_read_ptr(reader);
+    std::vector<short (*)[2]> write_ptrs;
+    for (auto output : outputs)
+        write_ptrs.push_back(output->next_write_ptr());
+    uint64_t lost_samples = 0;
+    while (run) {
+        auto input_stopped = input->is_stopped();
+        auto max_read_size = input->next_read_max_size(reader, true);
+        // end of stream: the input is stopped and everything has been read
+        if (max_read_size == 0 && input_stopped)
+            break;
+        // an overrun moves the read pointer
+        read_ptr = input->next_read_ptr(reader);
+
+        auto lost = input->get_lost_samples(reader);
+        if (lost != lost_samples) {
+            reset();
+            lost_samples = lost;
+        }
+
+        size_t chunk = std::min(max_read_size, CHANNELIZER_MAX_CHUNK);
+        size_t max_write_size = SIZE_MAX;
+        for (auto output : outputs)
+            max_write_size = std::min(max_write_size, output->next_write_max_size());
+        while (chunk > 0 && chunk / (nbranches / 2) + 1 > max_write_size / 2)
+            chunk /= 2;
+        if (chunk == 0)
+            continue;
+
+        auto nout = process(read_ptr, chunk, write_ptrs);
+        read_ptr = input->next_read_ptr(reader, chunk);
+        if (nout > 0)
+            for (size_t c = 0; c < outputs.size(); c++)
+                write_ptrs[c] = outputs[c]->next_write_ptr(nout);
+        total_input += chunk;
+        total_output += nout;
+    }
+    input->remove_reader(reader);
+    for (auto output : outputs)
+        output->stop();
+
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        cpu_time = ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+size_t Channelizer::process(const short (*in)[2], size_t count, std::vector<short (*)[2]>& out)
+{
+    size_t history = taps * nbranches - 1;
+    xi.resize(history + count);
+    xq.resize(history + count);
+    for (size_t k = 0; k < count; k++) {
+        xi[history + k] = in[k][0];
+        xq[history + k] = in[k][1];
+    }
+
+    // one output every M/2 input samples; with that hop bin k comes out
+    // rotated by (-1)^(k * output index)
+    size_t end = history + count;
+    size_t nout = 0;
+    while (next_index < end) {
+        size_t base = next_index + 1 - nbranches;
+        polyphase_iq(&xi[base], &xq[base], coeffs.data(), nbranches, taps, re.data(), im.data());
+        fft.forward(re.data(), im.data());
+        for (size_t c = 0; c < bins.size(); c++) {
+            auto y = rotations[c] * std::complex<float>(re[bins[c]], im[bins[c]]);
+            if (odd_output && (bins[c] & 1))
+                y = -y;
+            out[c][nout][0] = static_cast<short>(std::min(std::max(lrintf(y.real()), -32768L), 32767L));
+            out[c][nout][1] = static_cast<short>(std::min(std::max(lrintf(y.imag()), -32768L), 32767L));
+        }
+        nout++;
+        odd_output = !odd_output;
+        next_index += nbranches / 2;
+    }
+
+    // keep the history for the next block
+    std::copy(xi.end() - history, xi.end(), xi.begin());
+    std::copy(xq.end() - history, xq.end(), xq.begin());
+    next_index -= count;
+    return nout;
+}
+
+void Channelizer::reset()
+{
+    size_t history = taps * nbranches - 1;
+    xi.assign(history, 0);
+    xq.assign(history, 0);
+    next_index = history;
+    odd_output = false;
+}
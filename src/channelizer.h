@@ -0,0 +1,92 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_CHANNELIZER_H
+#define INCLUDED_RSP_SND_CHANNELIZER_H
+
+#include "fft.h"
+#include "ringbuffer.h"
+#include <complex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ChannelConfig {
+public:
+    double offset;                   // Hz from the tuner frequency
+    double sample_rate;              // Hz
+    std::string output;              // sound device or file name (like -o)
+    bool is_file;
+};
+
+class ChannelizerConfig {
+public:
+    std::string input;               // pipeline ring buffer ("" = after the I/Q correction)
+    double attenuation;              // stopband attenuation (dB)
+    std::vector<ChannelConfig> channels;
+};
+
+// polyphase FFT channelizer
+// a 2x oversampled analysis filter bank splits the input into M channels,
+// input_rate / M apart and each at 2 * input_rate / M; M is the largest
+// power of 2 that fits every configured channel in the flat part of one
+// bin. One M point FFT per output serves all the channels, and only the
+// configured bins are written out, each to its own ring buffer
+// a channel is centered on its bin, which is up to half a bin away from
+// its offset (getResidual())
+class Channelizer {
+
+public:
+    Channelizer(const ChannelizerConfig& config, double input_rate, int verbose = 0);
+    ~Channelizer();
+
+    // getters
+    double getSamplerate() const;                   // of each channel output
+    double getResidual(size_t channel) const;       // Hz (channel offset - bin center)
+    double getCpuTime() const { return cpu_time; }  // s (after stop())
+
+    // streaming
+    void start(RingBuffer<short[2]> *input,
+               const std::vector<RingBuffer<short[2]> *>& outputs);
+    void stop();
+
+    class Exception: public std::runtime_error {
+    public:
+        Exception(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+private:
+    void process_loop(RingBuffer<short[2]> *input,
+                      std::vector<RingBuffer<short[2]> *> outputs);
+    size_t process(const short (*in)[2], size_t count, std::vector<short (*)[2]>& out);
+    void reset();
+
+    int verbose;
+    double input_rate;
+    size_t nbranches;                // M
+    size_t taps;                     // per branch
+    std::vector<float> coeffs;       // branch-reversed prototype filter
+    std::vector<size_t> bins;        // per channel
+    std::vector<double> residuals;
+    std::vector<std::complex<float>> rotations;
+    Fft fft;
+    std::vector<float> xi;           // history + current chunk
+    std::vector<float> xq;
+    std::vector<float> re;           // FFT buffers
+    std::vector<float> im;
+    size_t next_index;               // newest input sample of the next output
+    bool odd_output;
+
+    std::thread thread;
+    bool run = false;
+    uint64_t total_input = 0;
+    uint64_t total_output = 0;
+    double cpu_time = 0;
+};
+
+#endif /* INCLUDED_RSP_SND_CHANNELIZER_H */
@@ -0,0 +1,670 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "compress.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+// coding methods for a channel
+enum { METHOD_FIXED0 = 0, METHOD_FIXED3 = 3, METHOD_LPC = 4, METHOD_VERBATIM = 5 };
+
+static constexpr int RICE_ESCAPE = 31;      // quotients from here on are sent raw
+static constexpr int LPC_PRECISION = 14;    // bits of the quantized coefficients
+static constexpr int MAX_LPC_ORDER = 32;
+
+
+// little endian helpers
+static void put_u32(unsigned char *p, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = value >> (8 * i);
+}
+
+static void put_u64(unsigned char *p, uint64_t value)
+{
+    put_u32(p, value);
+    put_u32(p + 4, value >> 32);
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static uint64_t get_u64(const unsigned char *p)
+{
+    return get_u32(p) | (static_cast<uint64_t>(get_u32(p + 4)) << 32);
+}
+
+static uint32_t crc32(const unsigned char *data, size_t size)
+{
+    static uint32_t table[256];
+    static bool table_ready = [] {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        return true;
+    }();
+    (void) table_ready;
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffff;
+}
+
+
+// MSB first bit stream, into a buffer that is large enough
+// (see max_encoded_size())
+class BitWriter {
+
+public:
+    BitWriter(unsigned char *data): data(data), ptr(data), acc(0), nbits(0) {}
+
+    // bits <= 32
+    void put(uint32_t value, int bits)
+    {
+        acc = (acc << bits) | (value & (bits == 32 ? 0xffffffff : (1u << bits) - 1));
+        nbits += bits;
+        if (nbits >= 32) {
+            nbits -= 32;
+            uint32_t word = acc >> nbits;
+            ptr[0] = word >> 24;
+            ptr[1] = word >> 16;
+            ptr[2] = word >> 8;
+            ptr[3] = word;
+            ptr += 4;
+        }
+    }
+
+    void put_rice(uint32_t value, int k)
+    {
+        uint32_t q = value >> k;
+        if (q >= RICE_ESCAPE) {
+            put((1u << RICE_ESCAPE) - 1, RICE_ESCAPE);
+            put(value, 32);
+            return;
+        }
+        // q ones, a zero, and the k low bits
+        uint32_t low = value & ((1u << k) - 1);
+        if (q + 1 + k <= 32) {
+            put((((1u << q) - 1) << (k + 1)) | low, q + 1 + k);
+        } else {
+            put(((1u << q) - 1) << 1, q + 1);
+            put(low, k);
+        }
+    }
+
+    // returns the number of bytes written
+    size_t flush()
+    {
+        while (nbits >= 8) {
+            nbits -= 8;
+            *ptr++ = acc >> nbits;
+        }
+        if (nbits > 0)
+            *ptr++ = acc << (8 - nbits);
+        nbits = 0;
+        return ptr - data;
+    }
+
+private:
+    unsigned char *data;
+    unsigned char *ptr;
+    uint64_t acc;
+    int nbits;
+};
+
+// worst case: every residual escaped, plus the channel headers
+static size_t max_encoded_size(size_t count)
+{
+    return 2 * (8 * count + 128 + 2 * MAX_LPC_ORDER);
+}
+
+class BitReader {
+
+public:
+    BitReader(const unsigned char *data, size_t size):
+        overrun(false), ptr(data), end(data + size), acc(0), nbits(0) {}
+
+    // bits <= 32
+    uint32_t get(int bits)
+    {
+        while (nbits < bits) {
+            if (ptr < end) {
+                acc = (acc << 8) | *ptr++;
+            } else {
+                acc <<= 8;
+                overrun = true;
+            }
+            nbits += 8;
+        }
+        nbits -= bits;
+        return (acc >> nbits) & (bits == 32 ? 0xffffffff : (1u << bits) - 1);
+    }
+
+    uint32_t get_rice(int k)
+    {
+        uint32_t q = 0;
+        while (q < RICE_ESCAPE && get(1) == 1)
+            q++;
+        if (q == RICE_ESCAPE)
+            return get(32);
+        return k > 0 ? (q << k) | get(k) : q;
+    }
+
+    bool overrun;
+
+private:
+    const unsigned char *ptr;
+    const unsigned char *end;
+    uint64_t acc;
+    int nbits;
+};
+
+static inline uint32_t fold(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+static inline int32_t unfold(uint32_t value)
+{
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+// residual of the fixed polynomial predictor of 'order'
+static void fixed_residual(const int32_t *x, size_t count, int order, int32_t *e)
+{
+    switch (order) {
+        case 0:
+            for (size_t i = 0; i < count; i++)
+                e[i] = x[i];
+            break;
+        case 1:
+            for (size_t i = 1; i < count; i++)
+                e[i] = x[i] - x[i - 1];
+            break;
+        case 2:
+            for (size_t i = 2; i < count; i++)
+                e[i] = x[i] - 2 * x[i - 1] + x[i - 2];
+            break;
+        default:
+            for (size_t i = 3; i < count; i++)
+                e[i] = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+            break;
+    }
+}
+
+static void fixed_restore(int32_t *x, size_t count, int order)
+{
+    for (size_t i = order; i < count; i++) {
+        switch (order) {
+            case 0: break;
+            case 1: x[i] += x[i - 1]; break;
+            case 2: x[i] += 2 * x[i - 1] - x[i - 2]; break;
+            default: x[i] += 3 * x[i - 1] - 3 * x[i - 2] + x[i - 3]; break;
+        }
+    }
+}
+
+// quantized LPC coefficients (Levinson-Durbin on the autocorrelation);
+// returns false if the signal is not predictable (e.g. all zeros)
+static bool compute_lpc(const int32_t *x, size_t count, int order,
+                        int32_t *coefs, int& shift)
+{
+    // the samples are 16 bit, so the sums are exact in 64 bit integers
+    double r[MAX_LPC_ORDER + 1];
+    for (int k = 0; k <= order; k++) {
+        int64_t sum = 0;
+        for (size_t i = k; i < count; i++)
+            sum += static_cast<int64_t>(x[i]) * x[i - k];
+        r[k] = sum;
+    }
+    if (r[0] == 0)
+        return false;
+    // a tiny bit of white noise keeps the recursion stable
+    r[0] *= 1.0 + 1e-9;
+
+    double a[MAX_LPC_ORDER + 1] = { 0 };
+    double err = r[0];
+    for (int m = 1; m <= order; m++) {
+        double acc = r[m];
+        for (int j = 1; j < m; j++)
+            acc -= a[j] * r[m - j];
+        double k = acc / err;
+        double tmp[MAX_LPC_ORDER + 1];
+        for (int j = 1; j < m; j++)
+            tmp[j] = a[j] - k * a[m - j];
+        for (int j = 1; j < m; j++)
+            a[j] = tmp[j];
+        a[m] = k;
+        err *= 1 - k * k;
+        if (err <= 0)
+            return false;
+    }
+
+    double max_coef = 0;
+    for (int j = 1; j <= order; j++)
+        max_coef = std::max(max_coef, std::fabs(a[j]));
+    if (max_coef == 0)
+        return false;
+    int log2_max;
+    std::frexp(max_coef, &log2_max);
+    shift = std::min(std::max(LPC_PRECISION - 1 - log2_max, 0), 15);
+    for (int j = 1; j <= order; j++) {
+        long q = lround(a[j] * (1 << shift));
+        coefs[j - 1] = std::min(std::max(q, -32768L), 32767L);
+    }
+    return true;
+}
+
+// false if a residual doesn't fit in 31 bits
+static bool lpc_residual(const int32_t *x, size_t count, int order,
+                         const int32_t *coefs, int shift, int32_t *e)
+{
+    int64_t min = 0;
+    int64_t max = 0;
+    for (size_t i = order; i < count; i++) {
+        int64_t prediction = 0;
+        for (int j = 0; j < order; j++)
+            prediction += static_cast<int64_t>(coefs[j]) * x[i - 1 - j];
+        int64_t residual = x[i] - (prediction >> shift);
+        min = std::min(min, residual);
+        max = std::max(max, residual);
+        e[i] = static_cast<int32_t>(residual);
+    }
+    return min >= -(1 << 30) && max < (1 << 30);
+}
+
+static void lpc_restore(int32_t *x, size_t count, int order,
+                        const int32_t *coefs, int shift)
+{
+    for (size_t i = order; i < count; i++) {
+        int64_t prediction = 0;
+        for (int j = 0; j < order; j++)
+            prediction += static_cast<int64_t>(coefs[j]) * x[i - 1 - j];
+        x[i] += static_cast<int32_t>(prediction >> shift);
+    }
+}
+
+static uint64_t residual_cost(const int32_t *e, size_t start, size_t count)
+{
+    uint64_t sum = 0;
+    for (size_t i = start; i < count; i++)
+        sum += fold(e[i]);
+    return sum;
+}
+
+// Rice parameter for a partition: about log2 of the mean folded residual
+static int rice_parameter(const int32_t *e, size_t count)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++)
+        sum += fold(e[i]);
+    int k = 0;
+    while (k < 30 && (static_cast<uint64_t>(count) << (k + 1)) < sum)
+        k++;
+    return k;
+}
+
+
+// headers
+void rspz_write_header(unsigned char *out, const RspzHeader& header)
+{
+    memset(out, 0, RSPZ_HEADER_SIZE);
+    memcpy(out, "RSPZ", 4);
+    out[4] = RSPZ_VERSION;
+    out[6] = RSPZ_HEADER_SIZE;
+    put_u32(out + 8, header.block_size);
+    uint64_t bits;
+    memcpy(&bits, &header.sample_rate, 8);
+    put_u64(out + 16, bits);
+    memcpy(&bits, &header.frequency, 8);
+    put_u64(out + 24, bits);
+}
+
+bool rspz_read_header(const unsigned char *in, RspzHeader& header)
+{
+    if (memcmp(in, "RSPZ", 4) != 0 || in[4] != RSPZ_VERSION || in[6] != RSPZ_HEADER_SIZE)
+        return false;
+    header.block_size = get_u32(in + 8);
+    uint64_t bits = get_u64(in + 16);
+    memcpy(&header.sample_rate, &bits, 8);
+    bits = get_u64(in + 24);
+    memcpy(&header.frequency, &bits, 8);
+    return true;
+}
+
+void rspz_write_index(std::vector<unsigned char>& out,
+                      const std::vector<RspzIndexEntry>& entries,
+                      uint64_t index_offset)
+{
+    auto start = out.size();
+    out.resize(start + 8 + 16 * entries.size() + RSPZ_TRAILER_SIZE);
+    auto p = out.data() + start;
+    memcpy(p, "RZIX", 4);
+    put_u32(p + 4, entries.size());
+    p += 8;
+    for (const auto& entry : entries) {
+        put_u64(p, entry.offset);
+        put_u64(p + 8, entry.first_frame);
+        p += 16;
+    }
+    put_u64(p, index_offset);
+    memcpy(p + 8, "RZND", 4);
+}
+
+bool rspz_read_index(const unsigned char *file, size_t size,
+                     std::vector<RspzIndexEntry>& entries)
+{
+    if (size < RSPZ_HEADER_SIZE + 8 + RSPZ_TRAILER_SIZE ||
+        memcmp(file + size - 4, "RZND", 4) != 0)
+        return false;
+    auto index_offset = get_u64(file + size - RSPZ_TRAILER_SIZE);
+    if (index_offset < RSPZ_HEADER_SIZE || index_offset > size - 8 - RSPZ_TRAILER_SIZE)
+        return false;
+    auto p = file + index_offset;
+    uint64_t count = get_u32(p + 4);
+    if (memcmp(p, "RZIX", 4) != 0 || index_offset + 8 + 16 * count + RSPZ_TRAILER_SIZE != size)
+        return false;
+    p += 8;
+    entries.clear();
+    for (uint64_t i = 0; i < count; i++, p += 16)
+        entries.push_back({ get_u64(p), get_u64(p + 8) });
+    return true;
+}
+
+size_t rspz_scan_block(const unsigned char *in, size_t size, uint32_t& frames)
+{
+    if (size < RSPZ_BLOCK_HEADER_SIZE || memcmp(in, "RZBK", 4) != 0)
+        return 0;
+    size_t payload_size = get_u32(in + 8);
+    if (payload_size > size - RSPZ_BLOCK_HEADER_SIZE)
+        return 0;
+    frames = get_u32(in + 4);
+    return RSPZ_BLOCK_HEADER_SIZE + payload_size;
+}
+
+
+// encoder
+IqEncoder::IqEncoder(int max_lpc_order):
+    max_lpc_order(std::min(std::max(max_lpc_order, 0), MAX_LPC_ORDER))
+{
+}
+
+void IqEncoder::encode(const short (*in)[2], size_t count, std::vector<unsigned char>& out)
+{
+    auto start = out.size();
+    out.resize(start + RSPZ_BLOCK_HEADER_SIZE + max_encoded_size(count));
+    channel.resize(count);
+    residual.resize(count);
+    best_residual.resize(count);
+    BitWriter bits(out.data() + start + RSPZ_BLOCK_HEADER_SIZE);
+    for (int c = 0; c < 2; c++) {
+        for (size_t i = 0; i < count; i++)
+            channel[i] = in[i][c];
+        encode_channel(channel.data(), count, bits);
+    }
+    auto payload_size = bits.flush();
+    out.resize(start + RSPZ_BLOCK_HEADER_SIZE + payload_size);
+
+    auto header = out.data() + start;
+    memcpy(header, "RZBK", 4);
+    put_u32(header + 4, count);
+    put_u32(header + 8, payload_size);
+    put_u32(header + 12, crc32(header + RSPZ_BLOCK_HEADER_SIZE, payload_size));
+}
+
+void IqEncoder::encode_channel(const int32_t *x, size_t count, BitWriter& bits)
+{
+    // pick the predictor with the smallest residual
+    int method = METHOD_VERBATIM;
+    int order = 0;
+    uint64_t best_cost = UINT64_MAX;
+    for (int p = 0; p <= 3 && static_cast<size_t>(p) < count; p++) {
+        fixed_residual(x, count, p, residual.data());
+        auto cost = residual_cost(residual.data(), p, count);
+        if (cost < best_cost) {
+            best_cost = cost;
+            method = METHOD_FIXED0 + p;
+            order = p;
+            std::swap(residual, best_residual);
+        }
+    }
+    int32_t coefs[MAX_LPC_ORDER];
+    int shift = 0;
+    if (max_lpc_order > 0 && count > 4 * static_cast<size_t>(max_lpc_order) &&
+        compute_lpc(x, count, max_lpc_order, coefs, shift) &&
+        lpc_residual(x, count, max_lpc_order, coefs, shift, residual.data())) {
+        auto cost = residual_cost(residual.data(), max_lpc_order, count);
+        if (cost < best_cost) {
+            best_cost = cost;
+            method = METHOD_LPC;
+            order = max_lpc_order;
+            std::swap(residual, best_residual);
+        }
+    }
+    // Rice codes of about log2(mean) + 2 bits each; verbatim is 16 bits
+    if (count == 0 || best_cost / count > (1 << 14)) {
+        method = METHOD_VERBATIM;
+        order = count;
+    }
+
+    bits.put(method, 8);
+    if (method == METHOD_LPC) {
+        bits.put(order, 8);
+        bits.put(shift, 8);
+        for (int j = 0; j < order; j++)
+            bits.put(static_cast<uint32_t>(coefs[j]), 16);
+    }
+    for (int i = 0; i < order; i++)
+        bits.put(static_cast<uint32_t>(x[i]), 16);
+    if (method == METHOD_VERBATIM)
+        return;
+    for (size_t p = order; p < count; p += RSPZ_PARTITION_SIZE) {
+        auto n = std::min(RSPZ_PARTITION_SIZE, count - p);
+        auto e = best_residual.data() + p;
+        int k = rice_parameter(e, n);
+        bits.put(k, 5);
+        for (size_t i = 0; i < n; i++)
+            bits.put_rice(fold(e[i]), k);
+    }
+}
+
+
+// decoder
+size_t IqDecoder::decode(const unsigned char *in, size_t size, std::vector<short>& out)
+{
+    if (size < RSPZ_BLOCK_HEADER_SIZE || memcmp(in, "RZBK", 4) != 0)
+        return 0;
+    size_t count = get_u32(in + 4);
+    size_t payload_size = get_u32(in + 8);
+    if (payload_size > size - RSPZ_BLOCK_HEADER_SIZE)
+        return 0;
+    auto payload = in + RSPZ_BLOCK_HEADER_SIZE;
+    if (crc32(payload, payload_size) != get_u32(in + 12))
+        return 0;
+
+    BitReader bits(payload, payload_size);
+    for (int c = 0; c < 2; c++) {
+        channel[c].resize(count);
+        if (!decode_channel(bits, channel[c].data(), count))
+            return 0;
+    }
+    auto start = out.size();
+    out.resize(start + 2 * count);
+    for (size_t i = 0; i < count; i++) {
+        out[start + 2 * i] = static_cast<short>(channel[0][i]);
+        out[start + 2 * i + 1] = static_cast<short>(channel[1][i]);
+    }
+    return RSPZ_BLOCK_HEADER_SIZE + payload_size;
+}
+
+bool IqDecoder::decode_channel(BitReader& bits, int32_t *x, size_t count)
+{
+    int method = bits.get(8);
+    size_t order;
+    int32_t coefs[MAX_LPC_ORDER];
+    int shift = 0;
+    if (method == METHOD_VERBATIM) {
+        order = count;
+    } else if (method == METHOD_LPC) {
+        order = bits.get(8);
+        shift = bits.get(8);
+        if (order == 0 || order > MAX_LPC_ORDER || shift > 15)
+            return false;
+        for (size_t j = 0; j < order; j++)
+            coefs[j] = static_cast<int16_t>(bits.get(16));
+    } else if (method <= METHOD_FIXED3) {
+        order = method - METHOD_FIXED0;
+    } else {
+        return false;
+    }
+    if (order > count)
+        return false;
+    for (size_t i = 0; i < order; i++)
+        x[i] = static_cast<int16_t>(bits.get(16));
+    for (size_t p = order; p < count; p += RSPZ_PARTITION_SIZE) {
+        auto n = std::min(RSPZ_PARTITION_SIZE, count - p);
+        int k = bits.get(5);
+        for (size_t i = 0; i < n; i++)
+            x[p + i] = unfold(bits.get_rice(k));
+        if (bits.overrun)
+            return false;
+    }
+    if (method == METHOD_LPC)
+        lpc_restore(x, count, order, coefs, shift);
+    else if (method != METHOD_VERBATIM)
+        fixed_restore(x, count, order);
+    return !bits.overrun;
+}
+
+
+// worker pool
+Compressor::Compressor(size_t block_size, int max_lpc_order,
+                       unsigned int threads, Output output):
+    block_size(std::max(block_size, static_cast<size_t>(1))),
+    max_lpc_order(max_lpc_order),
+    output(output),
+    max_pending(2 * std::max(threads, 1u)),
+    current(nullptr),
+    next_frame(0),
+    run(true)
+{
+    for (unsigned int i = 0; i < std::max(threads, 1u); i++)
+        workers.emplace_back([this] { work_loop(); });
+}
+
+Compressor::~Compressor()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        run = false;
+    }
+    work_cond.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+    for (auto job : pending)
+        delete job;
+    for (auto job : free_jobs)
+        delete job;
+    delete current;
+}
+
+void Compressor::add(const short (*in)[2], size_t count)
+{
+    while (count > 0) {
+        if (current == nullptr) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!free_jobs.empty()) {
+                    current = free_jobs.back();
+                    free_jobs.pop_back();
+                }
+            }
+            if (current == nullptr) {
+                current = new Job;
+                current->samples.resize(2 * block_size);
+            }
+            current->frames = 0;
+            current->first_frame = next_frame;
+            current->done = false;
+        }
+        auto n = std::min(count, block_size - current->frames);
+        memcpy(&current->samples[2 * current->frames], in, n * sizeof(*in));
+        current->frames += n;
+        next_frame += n;
+        in += n;
+        count -= n;
+        if (current->frames == block_size)
+            submit();
+    }
+    drain(false);
+}
+
+void Compressor::finish()
+{
+    if (current != nullptr && current->frames > 0)
+        submit();
+    drain(true);
+}
+
+void Compressor::submit()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(current);
+        todo.push_back(current);
+    }
+    current = nullptr;
+    work_cond.notify_one();
+    drain(false);
+}
+
+// hand the blocks that are done to output(), in order; wait for the
+// oldest one if too many are pending (or for all of them)
+void Compressor::drain(bool all)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!pending.empty()) {
+        auto job = pending.front();
+        if (!job->done) {
+            if (!all && pending.size() < max_pending)
+                break;
+            done_cond.wait(lock, [job] { return job->done; });
+        }
+        pending.pop_front();
+        lock.unlock();
+        output(job->out, job->first_frame);
+        lock.lock();
+        free_jobs.push_back(job);
+    }
+}
+
+void Compressor::work_loop()
+{
+    IqEncoder encoder(max_lpc_order);
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        work_cond.wait(lock, [this] { return !todo.empty() || !run; });
+        if (todo.empty())
+            return;
+        auto job = todo.front();
+        todo.pop_front();
+        lock.unlock();
+        job->out.clear();
+        encoder.encode(reinterpret_cast<const short (*)[2]>(job->samples.data()),
+                       job->frames, job->out);
+        lock.lock();
+        job->done = true;
+        done_cond.notify_all();
+    }
+}
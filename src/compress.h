@@ -0,0 +1,148 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_COMPRESS_H
+#define INCLUDED_RSP_SND_COMPRESS_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// lossless compression of S16 I/Q recordings (.rspz files)
+// the samples are cut into blocks; in each block I and Q are coded
+// separately, FLAC style: a linear predictor (fixed polynomial of order
+// 0 to 3, or quantized LPC up to max_lpc_order, whichever leaves the
+// smallest residual) and the residual in Rice codes, with one Rice
+// parameter per partition of RSPZ_PARTITION_SIZE residuals
+// file layout (little endian):
+//   header   'RSPZ' u16 version u16 header_size u32 block_size u32 0
+//            f64 sample_rate f64 frequency
+//   blocks   'RZBK' u32 frames u32 payload_size u32 crc32(payload), payload
+//   index    'RZIX' u32 count, count x (u64 file offset, u64 first frame)
+//   trailer  u64 index offset 'RZND'
+// a file without the index (interrupted recording) can still be read by
+// going through the block headers
+static constexpr size_t RSPZ_HEADER_SIZE = 32;
+static constexpr size_t RSPZ_BLOCK_HEADER_SIZE = 16;
+static constexpr size_t RSPZ_TRAILER_SIZE = 12;
+static constexpr unsigned int RSPZ_VERSION = 1;
+static constexpr size_t RSPZ_PARTITION_SIZE = 256;
+
+class BitWriter;
+class BitReader;
+
+struct RspzHeader {
+    uint32_t block_size;            // frames per block (the last one can be shorter)
+    double sample_rate;
+    double frequency;               // center frequency (Hz)
+};
+
+struct RspzIndexEntry {
+    uint64_t offset;                // of the block header in the file
+    uint64_t first_frame;
+};
+
+void rspz_write_header(unsigned char *out, const RspzHeader& header);
+bool rspz_read_header(const unsigned char *in, RspzHeader& header);
+// index and trailer for the blocks at 'entries'; index_offset is where
+// they go in the file
+void rspz_write_index(std::vector<unsigned char>& out,
+                      const std::vector<RspzIndexEntry>& entries,
+                      uint64_t index_offset);
+// the index of a whole file in memory; false if there is none
+bool rspz_read_index(const unsigned char *file, size_t size,
+                     std::vector<RspzIndexEntry>& entries);
+// size of the block at in[] (0 if it is not a complete block), and its
+// number of frames (without decoding it)
+size_t rspz_scan_block(const unsigned char *in, size_t size, uint32_t& frames);
+
+class IqEncoder {
+
+public:
+    IqEncoder(int max_lpc_order);
+
+    // append the compressed block (with its block header) for count
+    // frames to out
+    void encode(const short (*in)[2], size_t count, std::vector<unsigned char>& out);
+
+private:
+    void encode_channel(const int32_t *x, size_t count, BitWriter& bits);
+
+    int max_lpc_order;
+    std::vector<int32_t> channel;
+    std::vector<int32_t> residual;
+    std::vector<int32_t> best_residual;
+};
+
+class IqDecoder {
+
+public:
+    // decode the block that starts at in[] (with its block header) and
+    // append its frames to out[] (interleaved I/Q); returns the number of
+    // bytes of the block, or 0 if it is truncated or corrupted
+    size_t decode(const unsigned char *in, size_t size, std::vector<short>& out);
+
+private:
+    bool decode_channel(BitReader& bits, int32_t *x, size_t count);
+
+    std::vector<int32_t> channel[2];
+};
+
+// compresses blocks on a pool of worker threads; the compressed blocks
+// are handed to 'output' in order, on the thread that calls add() and
+// finish()
+// add() only waits when all the workers are behind, i.e. when there are
+// 2 * threads blocks waiting to be compressed
+class Compressor {
+
+public:
+    typedef std::function<void(const std::vector<unsigned char>& block,
+                               uint64_t first_frame)> Output;
+
+    Compressor(size_t block_size, int max_lpc_order, unsigned int threads,
+               Output output);
+    ~Compressor();
+
+    void add(const short (*in)[2], size_t count);
+    // compress the last partial block and output all the blocks
+    void finish();
+
+private:
+    struct Job {
+        std::vector<short> samples;
+        size_t frames;
+        uint64_t first_frame;
+        std::vector<unsigned char> out;
+        bool done;
+    };
+
+    void submit();
+    void drain(bool all);
+    void work_loop();
+
+    size_t block_size;
+    int max_lpc_order;
+    Output output;
+    size_t max_pending;
+    Job *current;
+    uint64_t next_frame;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable work_cond;
+    std::condition_variable done_cond;
+    std::deque<Job *> todo;
+    std::deque<Job *> pending;      // submitted, in output order
+    std::vector<Job *> free_jobs;
+    bool run;
+};
+
+#endif /* INCLUDED_RSP_SND_COMPRESS_H */
@@ -7,10 +7,18 @@
 
 #include "agc_gtw.h"
 #include "agc_rsp.h"
+#include "capture.h"
+#include "channelizer.h"
 #include "config.h"
+#include "decimator.h"
 #include "file.h"
+#include "iq_correction.h"
+#include "replay.h"
+#include "resampler.h"
 #include "rsp.h"
 #include "snd.h"
+#include "spectrum.h"
+#include "synth.h"
 #include <algorithm>
 #include <fstream>
 #include <getopt.h>
@@ -20,22 +28,49 @@ static void usage(const char* progname);
 
 static void set_global_config_defaults(GlobalConfig& global_config);
 static void set_rsp_config_defaults(RspConfig& rsp_config);
+static void set_synth_config_defaults(SynthConfig& synth_config);
+static void set_replay_config_defaults(ReplayConfig& replay_config);
 static void set_snd_config_defaults(SndConfig& snd_config);
 static void set_file_config_defaults(FileConfig& file_config);
 static void set_agc_rsp_config_defaults(AgcRspConfig& agc_rsp_config);
 static void set_agc_gtw_config_defaults(AgcGtwConfig& agc_gtw_config);
+static void set_iq_correction_config_defaults(IqCorrectionConfig& iq_correction_config);
+static void set_decimator_config_defaults(DecimatorConfig& decimator_config);
+static void set_resampler_config_defaults(ResamplerConfig& resampler_config);
+static void set_channelizer_config_defaults(ChannelizerConfig& channelizer_config);
+static ChannelConfig get_channel_config_defaults();
+static void set_spectrum_config_defaults(SpectrumConfig& spectrum_config);
+static void set_capture_config_defaults(CaptureConfig& capture_config);
+static void set_pipeline_config_defaults(PipelineConfig& pipeline_config);
+static StageConfig get_stage_config_defaults();
+static SinkConfig get_sink_config_defaults();
 
 static void set_unqualified_parameter(const std::string& parameter_name,
                                       const std::string& value,
                                       GlobalConfig& global_config,
                                       RspConfig& rsp_config,
+                                      SynthConfig& synth_config,
+                                      ReplayConfig& replay_config,
                                       SndConfig& snd_config,
                                       FileConfig& file_config,
                                       AgcRspConfig& agc_rsp_config,
-                                      AgcGtwConfig& agc_gtw_config);
+                                      AgcGtwConfig& agc_gtw_config,
+                                      IqCorrectionConfig& iq_correction_config,
+                                      DecimatorConfig& decimator_config,
+                                      ResamplerConfig& resampler_config,
+                                      ChannelizerConfig& channelizer_config,
+                                      SpectrumConfig& spectrum_config,
+                                      CaptureConfig& capture_config,
+                                      PipelineConfig& pipeline_config);
 static void set_rsp_parameter(const std::string& parameter_name,
                               const std::string& value,
                               RspConfig& rsp_config);
+static void set_synth_parameter(const std::string& parameter_name,
+                                const std::string& value,
+                                SynthConfig& synth_config);
+static void set_replay_parameter(const std::string& parameter_name,
+                                 const std::string& value,
+                                 ReplayConfig& replay_config);
 static void set_snd_parameter(const std::string& parameter_name,
                               const std::string& value,
                               SndConfig& snd_config);
@@ -48,40 +83,112 @@ static void set_agc_rsp_parameter(const std::string& parameter_name,
 static void set_agc_gtw_parameter(const std::string& parameter_name,
                                   const std::string& value,
                                   AgcGtwConfig& agc_gtw_config);
+static void set_iq_correction_parameter(const std::string& parameter_name,
+                                        const std::string& value,
+                                        IqCorrectionConfig& iq_correction_config);
+static void set_decimator_parameter(const std::string& parameter_name,
+                                    const std::string& value,
+                                    DecimatorConfig& decimator_config);
+static void set_resampler_parameter(const std::string& parameter_name,
+                                    const std::string& value,
+                                    ResamplerConfig& resampler_config);
+static void set_channelizer_parameter(const std::string& parameter_name,
+                                      const std::string& value,
+                                      ChannelizerConfig& channelizer_config);
+static void set_channel_parameter(const std::string& parameter_name,
+                                  const std::string& value,
+                                  ChannelConfig& channel_config);
+static void set_spectrum_parameter(const std::string& parameter_name,
+                                   const std::string& value,
+                                   SpectrumConfig& spectrum_config);
+static void set_capture_parameter(const std::string& parameter_name,
+                                  const std::string& value,
+                                  CaptureConfig& capture_config);
+static void set_stage_parameter(const std::string& parameter_name,
+                                const std::string& value,
+                                StageConfig& stage_config);
+static void set_sink_parameter(const std::string& parameter_name,
+                               const std::string& value,
+                               SinkConfig& sink_config);
+static unsigned long get_section_index(const std::string& component,
+                                       const std::string& section);
 
+static OverrunPolicy get_overrun_policy(const std::string& value);
+static SampleFormat get_sample_format(const std::string& value);
+static FileContainer get_file_container(const std::string& value);
 
 static void read_config_file(const std::string& filename,
                              GlobalConfig& global_config, RspConfig& rsp_config,
+                             SynthConfig& synth_config,
+                             ReplayConfig& replay_config,
                              SndConfig& snd_config, FileConfig& file_config,
                              AgcRspConfig& agc_rsp_config,
-                             AgcGtwConfig& agc_gtw_config);
+                             AgcGtwConfig& agc_gtw_config,
+                             IqCorrectionConfig& iq_correction_config,
+                             DecimatorConfig& decimator_config,
+                             ResamplerConfig& resampler_config,
+                             ChannelizerConfig& channelizer_config,
+                             SpectrumConfig& spectrum_config,
+                             CaptureConfig& capture_config,
+                             PipelineConfig& pipeline_config);
 
 void get_config(int argc, char *const argv[],
                 GlobalConfig& global_config, RspConfig& rsp_config,
+                SynthConfig& synth_config, ReplayConfig& replay_config,
                 SndConfig& snd_config, FileConfig& file_config,
-                AgcRspConfig& agc_rsp_config, AgcGtwConfig& agc_gtw_config)
+                AgcRspConfig& agc_rsp_config, AgcGtwConfig& agc_gtw_config,
+                IqCorrectionConfig& iq_correction_config,
+                DecimatorConfig& decimator_config,
+                ResamplerConfig& resampler_config,
+                ChannelizerConfig& channelizer_config,
+                SpectrumConfig& spectrum_config,
+                CaptureConfig& capture_config,
+                PipelineConfig& pipeline_config)
 {
     set_global_config_defaults(global_config);
     set_rsp_config_defaults(rsp_config);
+    set_synth_config_defaults(synth_config);
+    set_replay_config_defaults(replay_config);
     set_snd_config_defaults(snd_config);
     set_file_config_defaults(file_config);
     set_agc_rsp_config_defaults(agc_rsp_config);
     set_agc_gtw_config_defaults(agc_gtw_config);
+    set_iq_correction_config_defaults(iq_correction_config);
+    set_decimator_config_defaults(decimator_config);
+    set_resampler_config_defaults(resampler_config);
+    set_channelizer_config_defaults(channelizer_config);
+    set_spectrum_config_defaults(spectrum_config);
+    set_capture_config_defaults(capture_config);
+    set_pipeline_config_defaults(pipeline_config);
 
+    std::string in_name;
     std::string out_name;
     double sample_rate;
     int bw_type;
 
     int c;
-    while ((c = getopt(argc, argv, "C:vi:f:r:B:l:We:o:n:a:b:c:g:G:sS:x:y:z:h")) != -1) {
+    while ((c = getopt(argc, argv, "C:vm:I:i:f:r:B:l:WDt:e:o:n:a:b:c:g:G:sS:x:y:z:h")) != -1) {
         switch (c) {
             case 'C':
-                read_config_file(optarg, global_config, rsp_config, snd_config,
-                                 file_config, agc_rsp_config, agc_gtw_config);
+                read_config_file(optarg, global_config, rsp_config,
+                                 synth_config, replay_config, snd_config,
+                                 file_config, agc_rsp_config, agc_gtw_config,
+                                 iq_correction_config, decimator_config,
+                                 resampler_config, channelizer_config,
+                                 spectrum_config, capture_config,
+                                 pipeline_config);
                 break;
             case 'v':
                 global_config.verbose++;
                 break;
+            case 'm':
+                global_config.statsFile = optarg;
+                break;
+
+            // Input config parameters
+            case 'I':
+                in_name = optarg;
+                break;
 
             // RSP config parameters
             case 'i':
@@ -99,6 +206,8 @@ void get_config(int argc, char *const argv[],
                     exit(1);
                 }
                 rsp_config.sample_rate = sample_rate;
+                synth_config.sample_rate = sample_rate;
+                replay_config.sample_rate = sample_rate;
                 snd_config.sample_rate = sample_rate;
                 break;
             case 'B':
@@ -119,13 +228,26 @@ void get_config(int argc, char *const argv[],
             case 'W':
                 rsp_config.wide_band_signal = true;
                 break;
+            case 'D':
+                rsp_config.software_decimation = true;
+                break;
+            case 't':
+                if (sscanf(optarg, "%lf", &rsp_config.tuning_offset) != 1) {
+                    std::cerr << "invalid tuning offset: " << optarg << std::endl;
+                    exit(1);
+                }
+                break;
             case 'e':
                 rsp_config.gain_file = optarg;
                 break;
 
             // Output config parameters
             case 'o':
-                out_name = optarg;
+                // each -o after the first adds another sink
+                if (out_name.empty())
+                    out_name = optarg;
+                else
+                    global_config.teeOutNames.push_back(optarg);
                 break;
 
             // AGC config parameters
@@ -202,6 +324,15 @@ void get_config(int argc, char *const argv[],
         }
     }
 
+    if (in_name == "RSP" || in_name == "rsp") {
+        global_config.inModel = IN_RSP;
+    } else if (in_name == "SYNTH" || in_name == "synth") {
+        global_config.inModel = IN_SYNTH;
+    } else if (!in_name.empty()) {
+        global_config.inModel = IN_REPLAY;
+        replay_config.name = in_name;
+    }
+
     global_config.isOutFile = out_name.empty() || out_name == "-" || out_name.find("/") != std::string::npos;
     if (global_config.isOutFile) {
         file_config.name = out_name;
@@ -219,20 +350,24 @@ static void usage(const char* progname)
     std::cerr << "    -B bwType baseband low-pass filter type (200, 300, 600, 1536, 5000)" << std::endl;
     std::cerr << "    -b dec   (AGC GTW model) AGC \"decrease\" threshold, default 8192" << std::endl;
     std::cerr << "    -c min   (AGC GTW model) AGC sample period (ms), default 500" << std::endl;
+    std::cerr << "    -D       decimate in software (SIMD half-band filters) instead of in the RSP" << std::endl;
     std::cerr << "    -e gainfile  write gain values value to shared memory file" << std::endl;
     std::cerr << "    -f freq  set tuner frequency (in Hz)" << std::endl;
     std::cerr << "    -g agc_mode    (AGC RSP model)" << std::endl;
     std::cerr << "    -g gain  (AGC GTW model) set min gain reduction during AGC operation or fixed gain w/AGC disabled, default 30" << std::endl;
     std::cerr << "    -G gain  (AGC GTW model) set max gain reduction during AGC operation, default 59" << std::endl;
     std::cerr << "    -h       show usage" << std::endl;
+    std::cerr << "    -I input select input: RSP (default), synth, or a raw I/Q file to replay" << std::endl;
     std::cerr << "    -i ser   specify input device (serial number)" << std::endl;
     std::cerr << "    -l val   set LNA state, default 3.  See SDRPlay API gain reduction tables for more info" << std::endl;
+    std::cerr << "    -m statsfile  write performance statistics to shared memory file" << std::endl;
     std::cerr << "    -n agcmodel  AGC enable; AGC models: RSP, GTW - GTW uses parameters a,b,c,g,s,S,x,y,z" << std::endl;
-    std::cerr << "    -o dev   specify output device" << std::endl;
+    std::cerr << "    -o dev   specify output device (repeat it to send the samples to several outputs)" << std::endl;
     std::cerr << "    -r rate  set sampling rate (in Hz) [48000, 96000, 192000, 384000, 768000 recommended]" << std::endl;
     std::cerr << "    -S step_inc  (AGC GTW model) set gain AGC attenuation increase (gain reduction) step size in dB, default = 1 (1-10)" << std::endl;
     std::cerr << "    -s setPoint_dBfs   (AGC RSP model)" << std::endl;
     std::cerr << "    -s step_dec  (AGC GTW model) set gain AGC attenuation decrease (gain gain increase) step size in dB, default = 1 (1-10)" << std::endl;
+    std::cerr << "    -t offset  tune the RSP offset Hz away from the frequency and shift it back in software" << std::endl;
     std::cerr << "    -v       enable verbose output" << std::endl;
     std::cerr << "    -W       enable wideband signal mode (e.g. half-band filtering). Warning: High CPU useage!" << std::endl;
     std::cerr << "    -x decay_ms   (AGC RSP model)" << std::endl;
@@ -246,8 +381,11 @@ static void usage(const char* progname)
 static void set_global_config_defaults(GlobalConfig& global_config)
 {
     global_config.verbose = 0;
+    global_config.inModel = IN_RSP;
     global_config.isOutFile = true;
+    global_config.teeOutNames.clear();
     global_config.agcModel = AGC_NONE;
+    global_config.statsFile = "";
 }
 
 static void set_rsp_config_defaults(RspConfig& rsp_config)
@@ -258,6 +396,31 @@ static void set_rsp_config_defaults(RspConfig& rsp_config)
     rsp_config.gRdB = 50;
     rsp_config.lna_state = 3;
     rsp_config.wide_band_signal = false;
+    rsp_config.software_decimation = false;
+    rsp_config.tuning_offset = 0;
+}
+
+static void set_synth_config_defaults(SynthConfig& synth_config)
+{
+    synth_config.sample_rate = 768e3;
+    synth_config.realtime = true;
+    synth_config.block_size = 1344;
+    synth_config.tones = { 10e3 };
+    synth_config.tone_level = -20;
+    synth_config.noise_level = -60;
+    synth_config.burst_level = -10;
+    synth_config.burst_period = 0;
+    synth_config.burst_length = 0.1;
+    synth_config.gRdB = 50;
+}
+
+static void set_replay_config_defaults(ReplayConfig& replay_config)
+{
+    replay_config.name = "";
+    replay_config.sample_rate = 768e3;
+    replay_config.realtime = true;
+    replay_config.loop = false;
+    replay_config.block_size = 1344;
 }
 
 static void set_snd_config_defaults(SndConfig& snd_config)
@@ -265,11 +428,39 @@ static void set_snd_config_defaults(SndConfig& snd_config)
     snd_config.name = "";
     snd_config.sample_rate = 768e3;
     snd_config.latency = 30000;
+    snd_config.overrun_policy = OVERRUN_SKIP_TO_NEWEST;
+    snd_config.format = SAMPLE_S16;
+    snd_config.scale = 1;
+    snd_config.mmap = true;
 }
 
 static void set_file_config_defaults(FileConfig& file_config)
 {
     file_config.name = "";
+    file_config.overrun_policy = OVERRUN_RESYNC;
+    file_config.discontinuity_file = "";
+    file_config.min_write_size = 16384;
+    file_config.max_wait_ms = 100;
+    file_config.format = SAMPLE_S16;
+    file_config.scale = 1;
+    file_config.direct_io = false;
+    file_config.io_buffer_size = 1048576;
+    file_config.io_queue_depth = 8;
+    file_config.preallocate = 268435456;
+    file_config.container = CONTAINER_RAW;
+    file_config.header_update_ms = 1000;
+    file_config.rotate_size = 0;
+    file_config.rotate_interval = 0;
+    file_config.sigmf = false;
+    file_config.splice = false;
+    file_config.pipe_size = 0;
+    file_config.compression_block_size = 16384;
+    file_config.compression_threads = 4;
+    file_config.lpc_order = 8;
+    file_config.sample_rate = 0;
+    file_config.frequency = 0;
+    file_config.gain_reduction = 0;
+    file_config.lna_state = 0;
 }
 
 static void set_agc_rsp_config_defaults(AgcRspConfig& agc_rsp_config)
@@ -296,6 +487,95 @@ static void set_agc_gtw_config_defaults(AgcGtwConfig& agc_gtw_config)
     agc_gtw_config.agc6_c = 5000;
 }
 
+static void set_iq_correction_config_defaults(IqCorrectionConfig& iq_correction_config)
+{
+    iq_correction_config.enable = false;
+    iq_correction_config.dc_offset = true;
+    iq_correction_config.iq_balance = true;
+    iq_correction_config.dc_time_constant = 0.1;
+    iq_correction_config.iq_time_constant = 1;
+}
+
+static void set_decimator_config_defaults(DecimatorConfig& decimator_config)
+{
+    decimator_config.factor = 1;
+    decimator_config.attenuation = 80;
+    decimator_config.passband = 0.9;
+}
+
+static void set_resampler_config_defaults(ResamplerConfig& resampler_config)
+{
+    resampler_config.output_rate = 0;
+    resampler_config.attenuation = 80;
+    resampler_config.passband = 0.9;
+}
+
+static void set_channelizer_config_defaults(ChannelizerConfig& channelizer_config)
+{
+    channelizer_config.input = "";
+    channelizer_config.attenuation = 80;
+    channelizer_config.channels.clear();
+}
+
+static ChannelConfig get_channel_config_defaults()
+{
+    ChannelConfig channel_config;
+    channel_config.offset = 0;
+    channel_config.sample_rate = 48e3;
+    channel_config.is_file = false;
+    return channel_config;
+}
+
+static void set_spectrum_config_defaults(SpectrumConfig& spectrum_config)
+{
+    spectrum_config.name = "";
+    spectrum_config.fft_size = 1024;
+    spectrum_config.averaging = 4;
+    spectrum_config.frame_rate = 10;
+}
+
+static void set_capture_config_defaults(CaptureConfig& capture_config)
+{
+    capture_config.name = "";
+    capture_config.input = "";
+    capture_config.pre_trigger = 10;
+    capture_config.post_trigger = 5;
+    capture_config.huge_pages = true;
+    capture_config.control_socket = "";
+    capture_config.trigger_level = 0;
+    capture_config.cpu = -1;
+}
+
+static void set_pipeline_config_defaults(PipelineConfig& pipeline_config)
+{
+    pipeline_config.stages.clear();
+    pipeline_config.sinks.clear();
+}
+
+static StageConfig get_stage_config_defaults()
+{
+    StageConfig stage_config;
+    stage_config.name = "";
+    stage_config.type = "";
+    stage_config.input = "";
+    stage_config.cpu = -1;
+    stage_config.fuse = false;
+    stage_config.frequency = 0;
+    stage_config.factor = 1;
+    stage_config.output_rate = 0;
+    return stage_config;
+}
+
+static SinkConfig get_sink_config_defaults()
+{
+    SinkConfig sink_config;
+    sink_config.input = "";
+    sink_config.output = "";
+    sink_config.is_file = true;
+    sink_config.cpu = -1;
+    return sink_config;
+}
+
 static inline void trim(std::string &s)
 {
     s.erase(s.begin(), std::find_if(s.begin(), s.end(),
@@ -306,9 +586,17 @@ static inline void trim(std::string &s)
 }
 
 void read_config_file(const std::string& filename, GlobalConfig& global_config,
-                      RspConfig& rsp_config, SndConfig& snd_config,
+                      RspConfig& rsp_config, SynthConfig& synth_config,
+                      ReplayConfig& replay_config, SndConfig& snd_config,
                       FileConfig& file_config, AgcRspConfig& agc_rsp_config,
-                      AgcGtwConfig& agc_gtw_config)
+                      AgcGtwConfig& agc_gtw_config,
+                      IqCorrectionConfig& iq_correction_config,
+                      DecimatorConfig& decimator_config,
+                      ResamplerConfig& resampler_config,
+                      ChannelizerConfig& channelizer_config,
+                      SpectrumConfig& spectrum_config,
+                      CaptureConfig& capture_config,
+                      PipelineConfig& pipeline_config)
 {
     std::fstream config_file;
     config_file.open(filename, std::ios::in);
@@ -342,13 +630,21 @@ void read_config_file(const std::string& filename, GlobalConfig& global_config,
         pos = fullkey.find('.');
         if (pos == std::string::npos) {
             set_unqualified_parameter(fullkey, value, global_config, rsp_config,
-                                      snd_config, file_config, agc_rsp_config,
-                                      agc_gtw_config);
+                                      synth_config, replay_config, snd_config,
+                                      file_config, agc_rsp_config,
+                                      agc_gtw_config, iq_correction_config,
+                                      decimator_config, resampler_config,
+                                      channelizer_config, spectrum_config,
+                                      capture_config, pipeline_config);
         } else {
             auto component = fullkey.substr(0, pos);
             auto parameter_name = fullkey.substr(pos + 1);
             if (component == "rsp") {
                 set_rsp_parameter(parameter_name, value, rsp_config);
+            } else if (component == "synth") {
+                set_synth_parameter(parameter_name, value, synth_config);
+            } else if (component == "replay") {
+                set_replay_parameter(parameter_name, value, replay_config);
             } else if (component == "snd") {
                 set_snd_parameter(parameter_name, value, snd_config);
             } else if (component == "file") {
@@ -357,6 +653,39 @@ void read_config_file(const std::string& filename, GlobalConfig& global_config,
                 set_agc_rsp_parameter(parameter_name, value, agc_rsp_config);
             } else if (component == "agc_gtw") {
                 set_agc_gtw_parameter(parameter_name, value, agc_gtw_config);
+            } else if (component == "iq_correction") {
+                set_iq_correction_parameter(parameter_name, value, iq_correction_config);
+            } else if (component == "decimator") {
+                set_decimator_parameter(parameter_name, value, decimator_config);
+            } else if (component == "resampler") {
+                set_resampler_parameter(parameter_name, value, resampler_config);
+            } else if (component == "spectrum") {
+                set_spectrum_parameter(parameter_name, value, spectrum_config);
+            } else if (component == "capture") {
+                set_capture_parameter(parameter_name, value, capture_config);
+            } else if (component == "channelizer") {
+                set_channelizer_parameter(parameter_name, value, channelizer_config);
+            } else if (get_section_index(component, "channel") > 0) {
+                // [channel1], [channel2], ...
+                auto index = get_section_index(component, "channel");
+                auto& channels = channelizer_config.channels;
+                while (channels.size() < index)
+                    channels.push_back(get_channel_config_defaults());
+                set_channel_parameter(parameter_name, value, channels[index - 1]);
+            } else if (get_section_index(component, "stage") > 0) {
+                // [stage1], [stage2], ...
+                auto index = get_section_index(component, "stage");
+                auto& stages = pipeline_config.stages;
+                while (stages.size() < index)
+                    stages.push_back(get_stage_config_defaults());
+                set_stage_parameter(parameter_name, value, stages[index - 1]);
+            } else if (get_section_index(component, "sink") > 0) {
+                // [sink1], [sink2], ...
+                auto index = get_section_index(component, "sink");
+                auto& sinks = pipeline_config.sinks;
+                while (sinks.size() < index)
+                    sinks.push_back(get_sink_config_defaults());
+                set_sink_parameter(parameter_name, value, sinks[index - 1]);
             } else {
                 std::cerr << "unknown config parameter: " << fullkey << std::endl;
             }
@@ -370,15 +699,38 @@ static void set_unqualified_parameter(const std::string& parameter_name,
                                       const std::string& value,
                                       GlobalConfig& global_config,
                                       RspConfig& rsp_config,
+                                      SynthConfig& synth_config,
+                                      ReplayConfig& replay_config,
                                       SndConfig& snd_config,
                                       FileConfig& file_config,
                                       AgcRspConfig& agc_rsp_config,
-                                      AgcGtwConfig& agc_gtw_config)
+                                      AgcGtwConfig& agc_gtw_config,
+                                      IqCorrectionConfig& iq_correction_config,
+                                      DecimatorConfig& decimator_config,
+                                      ResamplerConfig& resampler_config,
+                                      ChannelizerConfig& channelizer_config,
+                                      SpectrumConfig& spectrum_config,
+                                      CaptureConfig& capture_config,
+                                      PipelineConfig& pipeline_config)
 {
     if (parameter_name == "sample_rate") {
         auto sample_rate = strtod(value.c_str(), nullptr);
         rsp_config.sample_rate = sample_rate;
+        synth_config.sample_rate = sample_rate;
+        replay_config.sample_rate = sample_rate;
         snd_config.sample_rate = sample_rate;
+    } else if (parameter_name == "stats_file") {
+        global_config.statsFile = value;
+    } else if (parameter_name == "input") {
+        if (value == "RSP" || value == "rsp") {
+            global_config.inModel = IN_RSP;
+        } else if (value == "SYNTH" || value == "synth") {
+            global_config.inModel = IN_SYNTH;
+        } else if (value == "REPLAY" || value == "replay") {
+            global_config.inModel = IN_REPLAY;
+        } else {
+            std::cerr << "invalid input: " << value << std::endl;
+        }
     } else if (parameter_name == "agc_model") {
         if (value == "RSp" || value == "rsp") {
             global_config.agcModel = AGC_RSP;
@@ -410,6 +762,10 @@ static void set_rsp_parameter(const std::string& parameter_name,
         rsp_config.bw_type = strtol(value.c_str(), nullptr, 10);
     } else if (parameter_name == "wide_band_signal") {
         rsp_config.wide_band_signal = (value == "true" || value == "TRUE");
+    } else if (parameter_name == "software_decimation") {
+        rsp_config.software_decimation = (value == "true" || value == "TRUE");
+    } else if (parameter_name == "tuning_offset") {
+        rsp_config.tuning_offset = strtod(value.c_str(), nullptr);
     } else if (parameter_name == "antenna") {
         rsp_config.antenna = value;
     } else if (parameter_name == "gain_file") {
@@ -419,6 +775,62 @@ static void set_rsp_parameter(const std::string& parameter_name,
     }
 }
 
+static void set_synth_parameter(const std::string& parameter_name,
+                                const std::string& value,
+                                SynthConfig& synth_config)
+{
+    if (parameter_name == "sample_rate") {
+        synth_config.sample_rate = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "realtime") {
+        synth_config.realtime = (value == "true" || value == "TRUE");
+    } else if (parameter_name == "block_size") {
+        synth_config.block_size = static_cast<unsigned int>(strtoul(value.c_str(), nullptr, 10));
+    } else if (parameter_name == "tones") {
+        synth_config.tones.clear();
+        const char *s = value.c_str();
+        char *end;
+        for (auto tone = strtod(s, &end); end != s; tone = strtod(s, &end)) {
+            synth_config.tones.push_back(tone);
+            s = end;
+            while (*s == ',' || isspace(*s))
+                s++;
+        }
+    } else if (parameter_name == "tone_level") {
+        synth_config.tone_level = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "noise_level") {
+        synth_config.noise_level = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "burst_level") {
+        synth_config.burst_level = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "burst_period") {
+        synth_config.burst_period = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "burst_length") {
+        synth_config.burst_length = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "grdb") {
+        synth_config.gRdB = strtol(value.c_str(), nullptr, 10);
+    } else {
+        std::cerr << "invalid synth parameter " << parameter_name << std::endl;
+    }
+}
+
+static void set_replay_parameter(const std::string& parameter_name,
+                                 const std::string& value,
+                                 ReplayConfig& replay_config)
+{
+    if (parameter_name == "name") {
+        replay_config.name = value;
+    } else if (parameter_name == "sample_rate") {
+        replay_config.sample_rate = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "realtime") {
+        replay_config.realtime = (value == "true" || value == "TRUE");
+    } else if (parameter_name == "loop") {
+        replay_config.loop = (value == "true" || value == "TRUE");
+    } else if (parameter_name == "block_size") {
+        replay_config.block_size = static_cast<unsigned int>(strtoul(value.c_str(), nullptr, 10));
+    } else {
+        std::cerr << "invalid replay parameter " << parameter_name << std::endl;
+    }
+}
+
 static void set_snd_parameter(const std::string& parameter_name,
                               const std::string& value,
                               SndConfig& snd_config)
@@ -429,6 +841,14 @@ static void set_snd_parameter(const std::string& parameter_name,
         snd_config.sample_rate = strtod(value.c_str(), nullptr);
     } else if (parameter_name == "latency") {
         snd_config.latency = static_cast<unsigned int>(strtoul(value.c_str(), nullptr, 10));
+    } else if (parameter_name == "overrun_policy") {
+        snd_config.overrun_policy = get_overrun_policy(value);
+    } else if (parameter_name == "format") {
+        snd_config.format = get_sample_format(value);
+    } else if (parameter_name == "scale") {
+        snd_config.scale = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "mmap") {
+        snd_config.mmap = (value == "true" || value == "TRUE");
     } else {
         std::cerr << "invalid snd parameter " << parameter_name << std::endl;
     }
@@ -440,6 +860,46 @@ static void set_file_parameter(const std::string& parameter_name,
 {
     if (parameter_name == "name") {
         file_config.name = value;
+    } else if (parameter_name == "overrun_policy") {
+        file_config.overrun_policy = get_overrun_policy(value);
+    } else if (parameter_name == "discontinuity_file") {
+        file_config.discontinuity_file = value;
+    } else if (parameter_name == "min_write_size") {
+        file_config.min_write_size = strtoul(value.c_str(), nullptr, 10);
+    } else if (parameter_name == "max_wait_ms") {
+        file_config.max_wait_ms = static_cast<unsigned int>(strtoul(value.c_str(), nullptr, 10));
+    } else if (parameter_name == "format") {
+        file_config.format = get_sample_format(value);
+    } else if (parameter_name == "scale") {
+        file_config.scale = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "direct_io") {
+        file_config.direct_io = (value == "true" || value == "TRUE");
+    } else if (parameter_name == "io_buffer_size") {
+        file_config.io_buffer_size = strtoul(value.c_str(), nullptr, 10);
+    } else if (parameter_name == "io_queue_depth") {
+        file_config.io_queue_depth = static_cast<unsigned int>(strtoul(value.c_str(), nullptr, 10));
+    } else if (parameter_name == "preallocate") {
+        file_config.preallocate = strtoul(value.c_str(), nullptr, 10);
+    } else if (parameter_name == "container") {
+        file_config.container = get_file_container(value);
+    } else if (parameter_name == "header_update_ms") {
+        file_config.header_update_ms = static_cast<unsigned int>(strtoul(value.c_str(), nullptr, 10));
+    } else if (parameter_name == "rotate_size") {
+        file_config.rotate_size = strtoull(value.c_str(), nullptr, 10);
+    } else if (parameter_name == "rotate_interval") {
+        file_config.rotate_interval = static_cast<unsigned int>(strtoul(value.c_str(), nullptr, 10));
+    } else if (parameter_name == "sigmf") {
+        file_config.sigmf = (value == "true" || value == "TRUE");
+    } else if (parameter_name == "splice") {
+        file_config.splice = (value == "true" || value == "TRUE");
+    } else if (parameter_name == "pipe_size") {
+        file_config.pipe_size = strtoul(value.c_str(), nullptr, 10);
+    } else if (parameter_name == "compression_block_size") {
+        file_config.compression_block_size = strtoul(value.c_str(), nullptr, 10);
+    } else if (parameter_name == "compression_threads") {
+        file_config.compression_threads = static_cast<unsigned int>(strtoul(value.c_str(), nullptr, 10));
+    } else if (parameter_name == "lpc_order") {
+        file_config.lpc_order = strtol(value.c_str(), nullptr, 10);
     } else {
         std::cerr << "invalid file parameter " << parameter_name << std::endl;
     }
@@ -506,3 +966,208 @@ static void set_agc_gtw_parameter(const std::string& parameter_name,
         std::cerr << "invalid agc gtw parameter " << parameter_name << std::endl;
     }
 }
+
+static void set_iq_correction_parameter(const std::string& parameter_name,
+                                        const std::string& value,
+                                        IqCorrectionConfig& iq_correction_config)
+{
+    if (parameter_name == "enable") {
+        iq_correction_config.enable = (value == "true" || value == "TRUE");
+    } else if (parameter_name == "dc_offset") {
+        iq_correction_config.dc_offset = (value == "true" || value == "TRUE");
+    } else if (parameter_name == "iq_balance") {
+        iq_correction_config.iq_balance = (value == "true" || value == "TRUE");
+    } else if (parameter_name == "dc_time_constant") {
+        iq_correction_config.dc_time_constant = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "iq_time_constant") {
+        iq_correction_config.iq_time_constant = strtod(value.c_str(), nullptr);
+    } else {
+        std::cerr << "invalid iq correction parameter " << parameter_name << std::endl;
+    }
+}
+
+static void set_decimator_parameter(const std::string& parameter_name,
+                                    const std::string& value,
+                                    DecimatorConfig& decimator_config)
+{
+    if (parameter_name == "attenuation") {
+        decimator_config.attenuation = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "passband") {
+        decimator_config.passband = strtod(value.c_str(), nullptr);
+    } else {
+        std::cerr << "invalid decimator parameter " << parameter_name << std::endl;
+    }
+}
+
+static void set_resampler_parameter(const std::string& parameter_name,
+                                    const std::string& value,
+                                    ResamplerConfig& resampler_config)
+{
+    if (parameter_name == "output_rate") {
+        resampler_config.output_rate = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "attenuation") {
+        resampler_config.attenuation = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "passband") {
+        resampler_config.passband = strtod(value.c_str(), nullptr);
+    } else {
+        std::cerr << "invalid resampler parameter " << parameter_name << std::endl;
+    }
+}
+
+static void set_channelizer_parameter(const std::string& parameter_name,
+                                      const std::string& value,
+                                      ChannelizerConfig& channelizer_config)
+{
+    if (parameter_name == "input") {
+        channelizer_config.input = value;
+    } else if (parameter_name == "attenuation") {
+        channelizer_config.attenuation = strtod(value.c_str(), nullptr);
+    } else {
+        std::cerr << "invalid channelizer parameter " << parameter_name << std::endl;
+    }
+}
+
+static void set_channel_parameter(const std::string& parameter_name,
+                                  const std::string& value,
+                                  ChannelConfig& channel_config)
+{
+    if (parameter_name == "offset") {
+        channel_config.offset = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "sample_rate") {
+        channel_config.sample_rate = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "output") {
+        channel_config.output = value;
+        channel_config.is_file = value == "-" || value.find("/") != std::string::npos;
+    } else {
+        std::cerr << "invalid channel parameter " << parameter_name << std::endl;
+    }
+}
+
+static void set_spectrum_parameter(const std::string& parameter_name,
+                                   const std::string& value,
+                                   SpectrumConfig& spectrum_config)
+{
+    if (parameter_name == "name") {
+        spectrum_config.name = value;
+    } else if (parameter_name == "fft_size") {
+        spectrum_config.fft_size = static_cast<unsigned int>(strtoul(value.c_str(), nullptr, 10));
+    } else if (parameter_name == "averaging") {
+        spectrum_config.averaging = static_cast<unsigned int>(strtoul(value.c_str(), nullptr, 10));
+    } else if (parameter_name == "frame_rate") {
+        spectrum_config.frame_rate = strtod(value.c_str(), nullptr);
+    } else {
+        std::cerr << "invalid spectrum parameter " << parameter_name << std::endl;
+    }
+}
+
+static void set_capture_parameter(const std::string& parameter_name,
+                                  const std::string& value,
+                                  CaptureConfig& capture_config)
+{
+    if (parameter_name == "name") {
+        capture_config.name = value;
+    } else if (parameter_name == "input") {
+        capture_config.input = value;
+    } else if (parameter_name == "pre_trigger") {
+        capture_config.pre_trigger = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "post_trigger") {
+        capture_config.post_trigger = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "huge_pages") {
+        capture_config.huge_pages = (value == "true" || value == "TRUE");
+    } else if (parameter_name == "control_socket") {
+        capture_config.control_socket = value;
+    } else if (parameter_name == "trigger_level") {
+        capture_config.trigger_level = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "cpu") {
+        capture_config.cpu = strtol(value.c_str(), nullptr, 10);
+    } else {
+        std::cerr << "invalid capture parameter " << parameter_name << std::endl;
+    }
+}
+
+static void set_stage_parameter(const std::string& parameter_name,
+                                const std::string& value,
+                                StageConfig& stage_config)
+{
+    if (parameter_name == "name") {
+        stage_config.name = value;
+    } else if (parameter_name == "type") {
+        stage_config.type = value;
+    } else if (parameter_name == "input") {
+        stage_config.input = value;
+    } else if (parameter_name == "cpu") {
+        stage_config.cpu = strtol(value.c_str(), nullptr, 10);
+    } else if (parameter_name == "fuse") {
+        stage_config.fuse = (value == "true" || value == "TRUE");
+    } else if (parameter_name == "frequency") {
+        stage_config.frequency = strtod(value.c_str(), nullptr);
+    } else if (parameter_name == "factor") {
+        stage_config.factor = strtol(value.c_str(), nullptr, 10);
+    } else if (parameter_name == "output_rate") {
+        stage_config.output_rate = strtod(value.c_str(), nullptr);
+    } else {
+        std::cerr << "invalid stage parameter " << parameter_name << std::endl;
+    }
+}
+
+static void set_sink_parameter(const std::string& parameter_name,
+                               const std::string& value,
+                               SinkConfig& sink_config)
+{
+    if (parameter_name == "input") {
+        sink_config.input = value;
+    } else if (parameter_name == "output") {
+        sink_config.output = value;
+        sink_config.is_file = value == "-" || value.find("/") != std::string::npos;
+    } else if (parameter_name == "cpu") {
+        sink_config.cpu = strtol(value.c_str(), nullptr, 10);
+    } else {
+        std::cerr << "invalid sink parameter " << parameter_name << std::endl;
+    }
+}
+
+// N for a numbered section [<section>N] (N >= 1), otherwise 0
+static unsigned long get_section_index(const std::string& component,
+                                       const std::string& section)
+{
+    if (component.size() <= section.size() ||
+        component.compare(0, section.size(), section) != 0)
+        return 0;
+    return strtoul(component.c_str() + section.size(), nullptr, 10);
+}
+
+static OverrunPolicy get_overrun_policy(const std::string& value)
+{
+    if (value == "skip" || value == "SKIP")
+        return OVERRUN_SKIP_TO_NEWEST;
+    if (value == "resync" || value == "RESYNC")
+        return OVERRUN_RESYNC;
+    std::cerr << "invalid overrun policy " << value << std::endl;
+    return OVERRUN_SKIP_TO_NEWEST;
+}
+
+static SampleFormat get_sample_format(const std::string& value)
+{
+    if (value == "s16" || value == "S16")
+        return SAMPLE_S16;
+    if (value == "s24_3le" || value == "S24_3LE")
+        return SAMPLE_S24_3LE;
+    if (value == "s32" || value == "S32")
+        return SAMPLE_S32;
+    if (value == "cf32" || value == "CF32")
+        return SAMPLE_CF32;
+    std::cerr << "invalid sample format " << value << std::endl;
+    return SAMPLE_S16;
+}
+
+static FileContainer get_file_container(const std::string& value)
+{
+    if (value == "raw" || value == "RAW")
+        return CONTAINER_RAW;
+    if (value == "wav" || value == "WAV")
+        return CONTAINER_WAV;
+    if (value == "compressed" || value == "rspz")
+        return CONTAINER_COMPRESSED;
+    std::cerr << "invalid file container " << value << std::endl;
+    return CONTAINER_RAW;
+}
@@ -9,21 +9,42 @@
 #define INCLUDED_RSP_SND_CONFIG_H
 
 #include "agc_gtw.h"
+#include "capture.h"
+#include "channelizer.h"
+#include "decimator.h"
 #include "file.h"
+#include "iq_correction.h"
+#include "pipeline.h"
+#include "replay.h"
+#include "resampler.h"
 #include "rsp.h"
 #include "snd.h"
+#include "spectrum.h"
+#include "synth.h"
 
+enum InModel { IN_RSP, IN_SYNTH, IN_REPLAY };
 enum AgcModel { AGC_NONE, AGC_RSP, AGC_GTW };
 
 typedef struct {
     int verbose;
+    InModel inModel;
     bool isOutFile;
+    std::vector<std::string> teeOutNames;   // -o after the first
     AgcModel agcModel;
+    std::string statsFile;
 } GlobalConfig;
 
 void get_config(int argc, char *const argv[],
                 GlobalConfig& global_config, RspConfig& rsp_config,
+                SynthConfig& synth_config, ReplayConfig& replay_config,
                 SndConfig& snd_config, FileConfig& file_config,
-                AgcRspConfig& agc_rsp_config, AgcGtwConfig& agc_gtw_config);
+                AgcRspConfig& agc_rsp_config, AgcGtwConfig& agc_gtw_config,
+                IqCorrectionConfig& iq_correction_config,
+                DecimatorConfig& decimator_config,
+                ResamplerConfig& resampler_config,
+                ChannelizerConfig& channelizer_config,
+                SpectrumConfig& spectrum_config,
+                CaptureConfig& capture_config,
+                PipelineConfig& pipeline_config);
 
 #endif /* INCLUDED_RSP_SND_CONFIG_H */
@@ -0,0 +1,119 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "decimator.h"
+#include "filter.h"
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+
+Decimator::Decimator(const DecimatorConfig& config, double input_rate, int verbose):
+    Stage(verbose),
+    output_rate(input_rate / config.factor),
+    factor(config.factor)
+{
+    if (factor < 2 || factor > 32 || (factor & (factor - 1)) != 0)
+        throw Decimator::Exception("invalid decimation factor");
+    if (config.passband <= 0 || config.passband >= 1)
+        throw Decimator::Exception("invalid decimator passband");
+
+    // the half-band filter with input rate output_rate * 2^k must keep
+    // [0, passband * output_rate / 2] and reject what would alias there
+    for (int k = factor; k > 1; k /= 2) {
+        double passband_edge = 0.5 * config.passband / k;
+        auto h = kaiser_halfband(config.attenuation, 0.5 - 2 * passband_edge);
+        int center = h.size() / 2;
+        HalfBand halfband;
+        halfband.center = h[center];
+        for (int i = 0; i < center; i += 2)
+            halfband.h.push_back(h[i]);
+        halfbands.push_back(halfband);
+        if (verbose >= 1)
+            std::cerr << "decimator half-band " << (output_rate * k) << " -> " << (output_rate * k / 2) << " Hz - " << h.size() << " taps (" << halfband.h.size() + 1 << " multiplies per output)" << std::endl;
+    }
+    reset();
+}
+
+Decimator::~Decimator() {}
+
+
+// getters
+double Decimator::getSamplerate() const
+{
+    return output_rate;
+}
+
+
+size_t Decimator::process(const short (*in)[2], size_t count, short (*out)[2])
+{
+    auto& first = halfbands.front();
+    auto carry = first.xi.size();
+    first.xi.resize(carry + count);
+    first.xq.resize(carry + count);
+    for (size_t k = 0; k < count; k++) {
+        first.xi[carry + k] = in[k][0];
+        first.xq[carry + k] = in[k][1];
+    }
+
+    // each half-band appends its output to the input of the next one
+    for (size_t s = 0; s < halfbands.size(); s++) {
+        auto& halfband = halfbands[s];
+        bool last = s + 1 == halfbands.size();
+        decimate(halfband, halfband.xi, last ? yi : halfbands[s + 1].xi);
+        decimate(halfband, halfband.xq, last ? yq : halfbands[s + 1].xq);
+    }
+
+    size_t nout = yi.size();
+    for (size_t k = 0; k < nout; k++) {
+        out[k][0] = static_cast<short>(std::min(std::max(lrintf(yi[k]), -32768L), 32767L));
+        out[k][1] = static_cast<short>(std::min(std::max(lrintf(yq[k]), -32768L), 32767L));
+    }
+    yi.clear();
+    yq.clear();
+    return nout;
+}
+
+size_t Decimator::max_output(size_t count) const
+{
+    // the input carried over by each half-band may add one sample
+    return count / factor + halfbands.size() + 1;
+}
+
+void Decimator::reset()
+{
+    // as if the stream had started with a filter length of zeros
+    for (auto& halfband : halfbands) {
+        size_t ntaps = 4 * halfband.h.size() - 1;
+        halfband.xi.assign(ntaps - 1, 0);
+        halfband.xq.assign(ntaps - 1, 0);
+    }
+    yi.clear();
+    yq.clear();
+}
+
+// x[] holds the input not consumed yet; the window of output n starts at x[2n]
+void Decimator::decimate(const HalfBand& halfband, std::vector<float>& x, std::vector<float>& y)
+{
+    size_t nh = halfband.h.size();
+    size_t ntaps = 4 * nh - 1;
+    if (x.size() < ntaps)
+        return;
+    size_t nout = (x.size() - ntaps) / 2 + 1;
+    even.resize(nout + 2 * nh - 1);
+    odd.resize(nout + nh - 1);
+    for (size_t j = 0; j < even.size(); j++)
+        even[j] = x[2 * j];
+    for (size_t j = 0; j < odd.size(); j++)
+        odd[j] = x[2 * j + 1];
+    auto start = y.size();
+    y.resize(start + nout);
+    halfband_decimate(even.data(), odd.data(), halfband.h.data(), nh,
+                      halfband.center, y.data() + start, nout);
+    x.erase(x.begin(), x.begin() + 2 * nout);
+}
@@ -0,0 +1,64 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_DECIMATOR_H
+#define INCLUDED_RSP_SND_DECIMATOR_H
+
+#include "stage.h"
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class DecimatorConfig {
+public:
+    int factor;                      // power of 2 (2 to 32)
+    double attenuation;              // stopband attenuation (dB)
+    double passband;                 // passband edge (fraction of the output Nyquist frequency)
+};
+
+// cascade of half-band filters, each decimating by 2
+// the earlier filters only have to protect the final passband, so they
+// are much shorter than the last one
+class Decimator: public Stage {
+
+public:
+    Decimator(const DecimatorConfig& config, double input_rate, int verbose = 0);
+    ~Decimator();
+
+    // getters
+    double getSamplerate() const override;
+
+    class Exception: public std::runtime_error {
+    public:
+        Exception(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+protected:
+    size_t process(const short (*in)[2], size_t count, short (*out)[2]) override;
+    size_t max_output(size_t count) const override;
+    void reset() override;
+
+private:
+    struct HalfBand {
+        std::vector<float> h;        // non zero taps of the first half
+        float center;
+        std::vector<float> xi;       // input not used yet
+        std::vector<float> xq;
+    };
+
+    void decimate(const HalfBand& halfband, std::vector<float>& x, std::vector<float>& y);
+
+    double output_rate;
+    int factor;
+    std::vector<HalfBand> halfbands;
+    std::vector<float> even;
+    std::vector<float> odd;
+    std::vector<float> yi;
+    std::vector<float> yq;
+};
+
+#endif /* INCLUDED_RSP_SND_DECIMATOR_H */
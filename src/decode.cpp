@@ -0,0 +1,178 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// rsp_snd_decode - decode compressed (.rspz) recordings to S16 I/Q
+// the block index at the end of the file is used to seek to the first
+// sample; a file without it (interrupted recording) is scanned block by
+// block instead
+
+#include "compress.h"
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <getopt.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+
+static void usage(const char* progname)
+{
+    std::cerr << "usage: " << progname << " [options...] input.rspz [output]" << std::endl;
+    std::cerr << "options:" << std::endl;
+    std::cerr << "    -c       check every block (no output)" << std::endl;
+    std::cerr << "    -h       show usage" << std::endl;
+    std::cerr << "    -i       show the header and the block index" << std::endl;
+    std::cerr << "    -n count number of samples to decode (default: all)" << std::endl;
+    std::cerr << "    -s start first sample to decode (default 0)" << std::endl;
+    std::cerr << "the output (default stdout) is interleaved S16 I/Q" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    bool check = false;
+    bool info = false;
+    uint64_t start = 0;
+    uint64_t count = UINT64_MAX;
+
+    int c;
+    while ((c = getopt(argc, argv, "chin:s:")) != -1) {
+        switch (c) {
+            case 'c':
+                check = true;
+                break;
+            case 'i':
+                info = true;
+                break;
+            case 'n':
+                count = strtoull(optarg, nullptr, 10);
+                break;
+            case 's':
+                start = strtoull(optarg, nullptr, 10);
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+                exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        exit(1);
+    }
+    std::string input_name = argv[optind];
+    std::string output_name = optind + 1 < argc ? argv[optind + 1] : "-";
+
+    auto fd = open(input_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "open(" << input_name << ") failed: " << strerror(errno) << std::endl;
+        exit(1);
+    }
+    struct stat st;
+    fstat(fd, &st);
+    size_t size = st.st_size;
+    if (size < RSPZ_HEADER_SIZE) {
+        std::cerr << input_name << ": not a compressed recording" << std::endl;
+        exit(1);
+    }
+    auto file = static_cast<const unsigned char *>(mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0));
+    if (file == MAP_FAILED) {
+        std::cerr << "mmap() failed: " << strerror(errno) << std::endl;
+        exit(1);
+    }
+    close(fd);
+
+    RspzHeader header;
+    if (!rspz_read_header(file, header)) {
+        std::cerr << input_name << ": not a compressed recording" << std::endl;
+        exit(1);
+    }
+
+    // the blocks, and where the data ends
+    std::vector<RspzIndexEntry> index;
+    bool has_index = rspz_read_index(file, size, index);
+    size_t end = size;
+    if (has_index) {
+        end = index.empty() ? RSPZ_HEADER_SIZE : size - RSPZ_TRAILER_SIZE - 8 - 16 * index.size();
+    } else {
+        uint64_t frame = 0;
+        for (size_t offset = RSPZ_HEADER_SIZE; offset < size; ) {
+            uint32_t frames;
+            auto block_size = rspz_scan_block(file + offset, size - offset, frames);
+            if (block_size == 0)
+                break;
+            index.push_back({ offset, frame });
+            frame += frames;
+            offset += block_size;
+        }
+        end = index.empty() ? RSPZ_HEADER_SIZE : size;
+        std::cerr << input_name << ": no block index - found " << index.size() << " complete blocks" << std::endl;
+    }
+    uint64_t total_frames = 0;
+    if (!index.empty()) {
+        uint32_t frames = 0;
+        rspz_scan_block(file + index.back().offset, end - index.back().offset, frames);
+        total_frames = index.back().first_frame + frames;
+    }
+
+    if (info) {
+        printf("sample rate: %.0f\n", header.sample_rate);
+        printf("center frequency: %.0f\n", header.frequency);
+        printf("block size: %" PRIu32 "\n", header.block_size);
+        printf("blocks: %zu%s\n", index.size(), has_index ? "" : " (no index)");
+        printf("samples: %" PRIu64 "\n", total_frames);
+        printf("compression ratio: %.3f\n", size > 0 ? 4.0 * total_frames / size : 0);
+        return 0;
+    }
+
+    // first block to decode
+    size_t first_block = 0;
+    while (first_block + 1 < index.size() && index[first_block + 1].first_frame <= start)
+        first_block++;
+
+    FILE *out = nullptr;
+    if (!check) {
+        out = output_name == "-" ? stdout : fopen(output_name.c_str(), "wb");
+        if (out == nullptr) {
+            std::cerr << "fopen(" << output_name << ") failed: " << strerror(errno) << std::endl;
+            exit(1);
+        }
+    }
+
+    IqDecoder decoder;
+    std::vector<short> samples;
+    int errors = 0;
+    for (size_t b = first_block; b < index.size() && count > 0; b++) {
+        auto offset = index[b].offset;
+        samples.clear();
+        if (offset >= end || decoder.decode(file + offset, end - offset, samples) == 0) {
+            std::cerr << "block " << b << " at offset " << offset << " is corrupted" << std::endl;
+            errors++;
+            continue;
+        }
+        if (check)
+            continue;
+        uint64_t frames = samples.size() / 2;
+        uint64_t skip = start > index[b].first_frame ? start - index[b].first_frame : 0;
+        if (skip >= frames)
+            continue;
+        uint64_t n = std::min(frames - skip, count);
+        fwrite(&samples[2 * skip], sizeof(short[2]), n, out);
+        count -= n;
+    }
+    if (out != nullptr && out != stdout)
+        fclose(out);
+    if (check)
+        std::cerr << input_name << ": " << index.size() << " blocks - " << total_frames << " samples - " << errors << " corrupted blocks" << std::endl;
+    munmap(const_cast<unsigned char *>(file), size);
+    return errors > 0 ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "fft.h"
+#include "simd.h"
+#include <cmath>
+#include <utility>
+
+
+Fft::Fft(size_t size):
+    size(size),
+    bit_reverse(size)
+{
+    if (size < 2 || (size & (size - 1)) != 0)
+        throw Fft::Exception("invalid FFT size");
+    int bits = 0;
+    while ((static_cast<size_t>(1) << bits) < size)
+        bits++;
+    for (size_t n = 0; n < size; n++) {
+        unsigned int r = 0;
+        for (int b = 0; b < bits; b++)
+            r |= ((n >> b) & 1) << (bits - 1 - b);
+        bit_reverse[n] = r;
+    }
+    for (size_t half = 4; half < size; half *= 2) {
+        for (size_t k = 0; k < half; k++) {
+            twiddle_re.push_back(static_cast<float>(cos(M_PI * k / half)));
+            twiddle_im.push_back(static_cast<float>(-sin(M_PI * k / half)));
+        }
+    }
+}
+
+// decimation in time
+void Fft::forward(float *re, float *im) const
+{
+    for (size_t n = 0; n < size; n++) {
+        auto r = bit_reverse[n];
+        if (r > n) {
+            std::swap(re[n], re[r]);
+            std::swap(im[n], im[r]);
+        }
+    }
+
+    if (size == 2) {
+        auto tr = re[1];
+        auto ti = im[1];
+        re[1] = re[0] - tr;
+        im[1] = im[0] - ti;
+        re[0] += tr;
+        im[0] += ti;
+        return;
+    }
+
+    // radix-4: the twiddle factors are 1 and -j
+    for (size_t n = 0; n < size; n += 4) {
+        auto a0r = re[n] + re[n + 1];
+        auto a0i = im[n] + im[n + 1];
+        auto a1r = re[n] - re[n + 1];
+        auto a1i = im[n] - im[n + 1];
+        auto a2r = re[n + 2] + re[n + 3];
+        auto a2i = im[n + 2] + im[n + 3];
+        auto a3r = re[n + 2] - re[n + 3];
+        auto a3i = im[n + 2] - im[n + 3];
+        re[n] = a0r + a2r;
+        im[n] = a0i + a2i;
+        re[n + 2] = a0r - a2r;
+        im[n + 2] = a0i - a2i;
+        re[n + 1] = a1r + a3i;
+        im[n + 1] = a1i - a3r;
+        re[n + 3] = a1r - a3i;
+        im[n + 3] = a1i + a3r;
+    }
+
+    for (size_t half = 4; half < size; half *= 2)
+        fft_pass(re, im, &twiddle_re[half - 4], &twiddle_im[half - 4], size, half);
+}
@@ -0,0 +1,44 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_FFT_H
+#define INCLUDED_RSP_SND_FFT_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// in-place complex FFT (power of 2 sizes) on split real/imaginary arrays
+// X[k] = sum(x[n] * exp(-2 pi j k n / N)), not normalized
+// the first two passes are one radix-4 pass without multiplies; the others
+// are SIMD radix-2 passes (fft_pass()) with contiguous twiddle factors
+class Fft {
+
+public:
+    Fft(size_t size);
+
+    // getters
+    size_t getSize() const { return size; }
+
+    void forward(float *re, float *im) const;
+
+    class Exception: public std::runtime_error {
+    public:
+        Exception(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+private:
+    size_t size;
+    std::vector<unsigned int> bit_reverse;
+    // the pass with groups of 2 * half points (half >= 4) uses
+    // exp(-2 pi j k / (2 * half)), k < half, from index half - 4
+    std::vector<float> twiddle_re;
+    std::vector<float> twiddle_im;
+};
+
+#endif /* INCLUDED_RSP_SND_FFT_H */
@@ -5,35 +5,66 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#include "affinity.h"
 #include "file.h"
+#include "metadata.h"
 #include "ringbuffer.h"
-#include <fcntl.h>
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
 #include <iostream>
+#include <unistd.h>
 
 
 template <typename T>
 File<T>::File(const FileConfig& config, int verbose):
-    Out(verbose)
+    Out(verbose),
+    config(config),
+    overrun_policy(config.overrun_policy),
+    min_write_size(config.min_write_size),
+    max_wait_ms(config.max_wait_ms),
+    discontinuity_file(nullptr),
+    converter(config.format, config.scale),
+    header_update_ms(config.header_update_ms),
+    segment(nullptr),
+    rotate_samples(config.rotate_size / converter.getFrameSize()),
+    rotate_interval(config.rotate_interval),
+    rotating(config.rotate_size > 0 || config.rotate_interval > 0),
+    segment_index(0),
+    rotate_run(false),
+    next_segment(nullptr),
+    next_ready(false)
 {
-    if (config.name.empty() || config.name == "-") {
-        fd = fileno(stdout);
-    } else {
-        fd = open(config.name.c_str(), O_WRONLY | O_CREAT, 0644);
-        if (fd < 0) {
-            std::cerr << "open(" << config.name << ") failed: " << strerror(errno) << std::endl;
-            throw File::Exception("open() failed");
+    if (rotating && (config.name.empty() || config.name == "-"))
+        throw File::Exception("file rotation requires a file name");
+    if (config.container == CONTAINER_COMPRESSED && config.format != SAMPLE_S16)
+        throw File::Exception("compressed files are S16 only");
+    try {
+        segment = new FileSegment(config, rotating ? get_segment_name(config.name, 0) : config.name, verbose);
+    } catch (const std::runtime_error& e) {
+        throw File::Exception(e.what());
+    }
+    if (!config.discontinuity_file.empty()) {
+        discontinuity_file = fopen(config.discontinuity_file.c_str(), "w");
+        if (discontinuity_file == nullptr) {
+            std::cerr << "fopen(" << config.discontinuity_file << ") failed: " << strerror(errno) << std::endl;
+            throw File::Exception("fopen() failed");
         }
+        fprintf(discontinuity_file, "# sample_offset type gap first_sample_num timestamp_ns\n");
     }
 }
 
 template <typename T>
 File<T>::~File()
 {
-    if (fd != fileno(stdout)) {
-        auto err = close(fd);
-        if (err < 0)
-            std::cerr << "close() failed: " << strerror(errno) << std::endl;
+    delete segment;
+    if (next_segment != nullptr) {
+        next_segment->discard();
+        delete next_segment;
     }
+    if (discontinuity_file != nullptr)
+        fclose(discontinuity_file);
 }
 
 
@@ -43,7 +74,13 @@ void File<T>::start(RingBuffer<T> *buffer)
 {
     run = true;
     total_samples = 0;
+    if (rotating) {
+        rotate_run = true;
+        rotate_thread = std::thread([this] { rotate_loop(); });
+        open_next();
+    }
     thread = std::thread([this, buffer] { write_loop(buffer); });
+    pin_thread(thread, cpu, "file sink", verbose);
 }
 
 template <typename T>
@@ -54,6 +91,15 @@ void File<T>::stop()
         if (thread.joinable())
             thread.join();
     }
+    // the rotation thread finishes its jobs (closing the last files) first
+    if (rotate_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(rotate_mutex);
+            rotate_run = false;
+        }
+        rotate_cond.notify_all();
+        rotate_thread.join();
+    }
     if (verbose >= 1)
         std::cerr << "file sink total_samples: " << total_samples << std::endl;
 }
@@ -61,17 +107,227 @@ void File<T>::stop()
 template <typename T>
 void File<T>::write_loop(RingBuffer<T> *buffer)
 {
-    auto read_ptr = buffer->next_read_ptr(nullptr);
+    uint64_t total_lost_samples = 0;
+    auto reader = buffer->add_reader(overrun_policy);
+    buffer->set_watermark(reader, min_write_size, max_wait_ms);
+    auto read_ptr = buffer->next_read_ptr(reader);
+    reader_id.store(reader, std::memory_order_release);
+    auto frame_size = converter.getFrameSize();
+    MetadataReader blocks(metadata);
+    segment->begin(0, stats);
+    auto current = segment;
+    defer([current] { current->write_sidecar(); });
+    set_rotate_time();
+    auto header_time = std::chrono::steady_clock::now();
+    // zero copy into a pipe: the pipe references the samples in the ring
+    // buffer until the consumer reads them, so the read pointer is held
+    // back by the samples still in the pipe (in_pipe), and the next ones
+    // are spliced from after them
+    // the pipe must be much smaller than the ring buffer, or the producer
+    // overruns the held back read pointer all the time
+    bool zero_copy = segment->isSpliced() && !rotating;
+    if (zero_copy && segment->getPipeSize() > buffer->get_size() * sizeof(T) / 4) {
+        std::cerr << "pipe size " << segment->getPipeSize() << " is more than 1/4 of the ring buffer - using write()" << std::endl;
+        zero_copy = false;
+    }
+    size_t in_pipe = 0;
+    const uintptr_t page_mask = getpagesize() - 1;
+    const size_t min_splice_size = std::max(min_write_size, (page_mask + 1) / frame_size);
     while (run) {
-        auto max_read_size = buffer->next_read_max_size(read_ptr, true);
-        auto bytecount = max_read_size * sizeof(T);
-        auto nwritten = write(fd, read_ptr, bytecount);
-        if (nwritten < 0)
-            std::cerr << "write() failed: " << strerror(errno) << std::endl;
-        else if (nwritten != bytecount)
-            std::cerr << "write() incomplete - expected: " << bytecount << " - written: " << nwritten << std::endl;
-        read_ptr = buffer->next_read_ptr(read_ptr, nwritten / sizeof(T));
-        total_samples += nwritten / sizeof(T);
+        if (zero_copy) {
+            auto released = in_pipe - std::min(in_pipe, segment->getQueued() / frame_size);
+            read_ptr = buffer->next_read_ptr(reader, released);
+            in_pipe -= released;
+            buffer->set_watermark(reader, in_pipe + min_splice_size, max_wait_ms);
+        }
+        auto max_read_size = buffer->next_read_max_size(reader, true);
+        // an overrun moves the read pointer
+        read_ptr = buffer->next_read_ptr(reader);
+        if (rotate_due()) {
+            rotate();
+            header_time = std::chrono::steady_clock::now();
+        }
+        // a file ends at exactly rotate_size bytes of samples
+        size_t count = max_read_size;
+        if (rotate_samples > 0)
+            count = std::min(count, static_cast<size_t>(rotate_samples - segment->getSamples()));
+        ssize_t nwritten;
+        auto write_start = std::chrono::steady_clock::now();
+        if (zero_copy) {
+            // after an overrun what was in the pipe is no longer in the
+            // ring buffer
+            if (buffer->get_lost_samples(reader) != total_lost_samples)
+                in_pipe = 0;
+            // whole pages, so each pipe buffer references a full page
+            auto start = reinterpret_cast<uintptr_t>(read_ptr + in_pipe);
+            auto end = (start + (count - in_pipe) * frame_size) & ~page_mask;
+            nwritten = end > start ? segment->splice(read_ptr + in_pipe, end - start) : 0;
+            // a full pipe takes only part of the samples
+            if (nwritten < 0)
+                std::cerr << "vmsplice() failed: " << strerror(errno) << std::endl;
+            if (nwritten < 0 && stats != nullptr)
+                stats->file_write_errors.add(1);
+        } else {
+            auto data = converter.convert(read_ptr, count);
+            auto bytecount = count * frame_size;
+            nwritten = segment->write(data, bytecount);
+            if (nwritten < 0)
+                std::cerr << "write() failed: " << strerror(errno) << std::endl;
+            else if (static_cast<size_t>(nwritten) != bytecount)
+                std::cerr << "write() incomplete - expected: " << bytecount << " - written: " << nwritten << std::endl;
+            if (static_cast<size_t>(nwritten) != bytecount && stats != nullptr)
+                stats->file_write_errors.add(1);
+        }
+        if (stats != nullptr)
+            stats->file_write_latency.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - write_start).count());
+        size_t nsamples = nwritten > 0 ? nwritten / frame_size : 0;
+        if (zero_copy)
+            in_pipe += nsamples;
+        else
+            read_ptr = buffer->next_read_ptr(reader, nsamples);
+        total_samples += nsamples;
+
+        // keep the header current, so an interrupted recording is still
+        // a valid file
+        if (std::chrono::steady_clock::now() - header_time >= std::chrono::milliseconds(header_update_ms)) {
+            segment->update_header();
+            header_time = std::chrono::steady_clock::now();
+        }
+
+        // where is the recording discontinuous?
+        auto read_seq = buffer->get_read_seq(reader) + in_pipe;
+        auto lost_samples = buffer->get_lost_samples(reader);
+        if (lost_samples != total_lost_samples) {
+            uint64_t offset = total_samples - nsamples;
+            if (discontinuity_file != nullptr)
+                fprintf(discontinuity_file, "%" PRIu64 " overrun %" PRIu64 " 0 0\n",
+                        offset, lost_samples - total_lost_samples);
+            segment->annotate(offset, "overrun " + std::to_string(lost_samples - total_lost_samples));
+            total_lost_samples = lost_samples;
+        }
+        blocks.check(read_seq, [this, read_seq](const BlockInfo& block, const char *type, int64_t gap) {
+            // blocks skipped by an overrun are reported at the overrun
+            uint64_t offset = read_seq - block.seq < total_samples ? total_samples - (read_seq - block.seq) : 0;
+            if (verbose >= 1)
+                std::cerr << "file sink " << type << " at sample " << offset << " - gap: " << gap << std::endl;
+            if (discontinuity_file != nullptr)
+                fprintf(discontinuity_file, "%" PRIu64 " %s %" PRId64 " %" PRIu32 " %" PRId64 "\n",
+                        offset, type, gap, block.first_sample_num, block.timestamp);
+            segment->annotate(offset, gap != 0 ? std::string(type) + " " + std::to_string(gap) : std::string(type));
+        });
+    }
+    // give the consumer some time to read what still points into the
+    // ring buffer, before the producer overwrites it
+    for (int i = 0; i < 100 && in_pipe > 0 && segment->getQueued() > 0; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    current = segment;
+    segment = nullptr;
+    defer([current] { current->finish(); delete current; });
+    if (discontinuity_file != nullptr)
+        fflush(discontinuity_file);
+    reader_id.store(-1, std::memory_order_release);
+    buffer->remove_reader(reader);
+}
+
+
+// rotation
+template <typename T>
+bool File<T>::rotate_due() const
+{
+    return (rotate_samples > 0 && segment->getSamples() >= rotate_samples) ||
+           (rotate_interval > 0 && std::chrono::system_clock::now() >= rotate_time);
+}
+
+// switch to the file the rotation thread has opened; it is normally ready
+// long before it is needed, so this doesn't wait
+template <typename T>
+void File<T>::rotate()
+{
+    FileSegment *next;
+    {
+        std::unique_lock<std::mutex> lock(rotate_mutex);
+        rotate_cond.wait(lock, [this] { return next_ready; });
+        next = next_segment;
+        next_segment = nullptr;
+        next_ready = false;
+    }
+    if (next == nullptr) {
+        std::cerr << "file rotation stopped - writing to " << segment->getName() << std::endl;
+        rotate_samples = 0;
+        rotate_interval = 0;
+        return;
+    }
+    auto current = segment;
+    defer([current] { current->finish(); delete current; });
+    segment = next;
+    segment_index++;
+    segment->begin(total_samples, stats);
+    current = segment;
+    defer([current] { current->write_sidecar(); });
+    set_rotate_time();
+    open_next();
+    if (verbose >= 1)
+        std::cerr << "file sink rotated to " << segment->getName() << " at sample " << total_samples << std::endl;
+}
+
+template <typename T>
+void File<T>::open_next()
+{
+    auto name = get_segment_name(config.name, segment_index + 1);
+    defer([this, name] {
+        FileSegment *next = nullptr;
+        try {
+            next = new FileSegment(config, name, verbose);
+        } catch (const std::runtime_error& e) {
+            std::cerr << "opening " << name << " failed: " << e.what() << std::endl;
+        }
+        {
+            std::lock_guard<std::mutex> lock(rotate_mutex);
+            next_segment = next;
+            next_ready = true;
+        }
+        rotate_cond.notify_all();
+    });
+}
+
+// files start on multiples of rotate_interval since the epoch (on the
+// hour with 3600)
+template <typename T>
+void File<T>::set_rotate_time()
+{
+    if (rotate_interval == 0)
+        return;
+    auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    rotate_time = std::chrono::system_clock::time_point(std::chrono::seconds((now / rotate_interval + 1) * rotate_interval));
+}
+
+template <typename T>
+void File<T>::defer(std::function<void()> job)
+{
+    if (!rotating) {
+        job();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(rotate_mutex);
+        rotate_jobs.push_back(std::move(job));
+    }
+    rotate_cond.notify_all();
+}
+
+template <typename T>
+void File<T>::rotate_loop()
+{
+    std::unique_lock<std::mutex> lock(rotate_mutex);
+    while (true) {
+        rotate_cond.wait(lock, [this] { return !rotate_jobs.empty() || !rotate_run; });
+        if (rotate_jobs.empty())
+            break;
+        auto job = std::move(rotate_jobs.front());
+        rotate_jobs.pop_front();
+        lock.unlock();
+        job();
+        lock.lock();
     }
 }
 
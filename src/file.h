@@ -10,7 +10,15 @@
 
 #include "out.h"
 #include "ringbuffer.h"
+#include "sample_format.h"
+#include "segment.h"
+#include "wav.h"
 #include <alsa/asoundlib.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <thread>
@@ -18,6 +26,32 @@
 class FileConfig {
 public:
     std::string name;
+    OverrunPolicy overrun_policy;
+    std::string discontinuity_file;
+    size_t min_write_size;          // samples
+    unsigned int max_wait_ms;
+    SampleFormat format;
+    double scale;                   // applied to S24, S32 and CF32
+    bool direct_io;                 // O_DIRECT writes through io_uring
+    size_t io_buffer_size;          // bytes per write (direct_io)
+    unsigned int io_queue_depth;    // writes in flight (direct_io)
+    size_t preallocate;             // fallocate() extent size in bytes (direct_io; 0 = off)
+    FileContainer container;
+    unsigned int header_update_ms;  // how often the WAV header is rewritten
+    uint64_t rotate_size;           // bytes of samples per file (0 = no limit)
+    unsigned int rotate_interval;   // s, aligned to the wall clock (0 = no limit)
+    bool sigmf;                     // write a .sigmf-meta sidecar for each file
+    bool splice;                    // vmsplice() the samples into a pipe
+    size_t pipe_size;               // F_SETPIPE_SZ for a pipe output (0 = as is)
+    // compressed container
+    size_t compression_block_size;  // samples
+    unsigned int compression_threads;
+    int lpc_order;                  // 0 = fixed predictors only
+    // recorded in the WAV header
+    double sample_rate;
+    double frequency;               // center frequency (Hz)
+    int gain_reduction;             // IF gain reduction (dB)
+    int lna_state;
 };
 
 template <typename T>
@@ -38,11 +72,40 @@ public:
 
 private:
     void write_loop(RingBuffer<T> *buffer);
+    bool rotate_due() const;
+    void rotate();
+    void open_next();
+    void set_rotate_time();
+    // run job on the rotation thread (or right away when not rotating)
+    void defer(std::function<void()> job);
+    void rotate_loop();
 
-    int fd;
+    FileConfig config;
+    OverrunPolicy overrun_policy;
+    size_t min_write_size;
+    unsigned int max_wait_ms;
+    FILE *discontinuity_file;
+    SampleConverter converter;
+    unsigned int header_update_ms;
     std::thread thread;
     bool run = false;
     size_t total_samples = 0;
+
+    // rotation: the next file is opened by the rotation thread while the
+    // current one is written, and the old one is closed there too
+    FileSegment *segment;
+    uint64_t rotate_samples;
+    unsigned int rotate_interval;
+    std::chrono::system_clock::time_point rotate_time;
+    bool rotating;
+    unsigned int segment_index;
+    std::thread rotate_thread;
+    std::mutex rotate_mutex;
+    std::condition_variable rotate_cond;
+    std::deque<std::function<void()>> rotate_jobs;
+    bool rotate_run;
+    FileSegment *next_segment;
+    bool next_ready;
 };
 
 #endif /* INCLUDED_RSP_SND_FILE_H */
@@ -0,0 +1,70 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "filter.h"
+#include <algorithm>
+#include <cmath>
+
+
+// modified Bessel function of the first kind, order 0
+static double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < 1e-12 * sum)
+            break;
+    }
+    return sum;
+}
+
+double kaiser_beta(double attenuation)
+{
+    if (attenuation > 50)
+        return 0.1102 * (attenuation - 8.7);
+    if (attenuation > 21)
+        return 0.5842 * pow(attenuation - 21, 0.4) + 0.07886 * (attenuation - 21);
+    return 0;
+}
+
+int kaiser_ntaps(double attenuation, double transition_width)
+{
+    return static_cast<int>(ceil((attenuation - 7.95) / (14.36 * transition_width))) + 1;
+}
+
+std::vector<double> kaiser_lowpass(int ntaps, double cutoff, double beta)
+{
+    std::vector<double> h(ntaps);
+    double center = 0.5 * (ntaps - 1);
+    double i0_beta = bessel_i0(beta);
+    double sum = 0;
+    for (int k = 0; k < ntaps; k++) {
+        double t = k - center;
+        double sinc = t == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * t) / (M_PI * t);
+        double r = center > 0 ? t / center : 0;
+        double window = bessel_i0(beta * sqrt(std::max(0.0, 1 - r * r))) / i0_beta;
+        h[k] = sinc * window;
+        sum += h[k];
+    }
+    for (auto& c : h)
+        c /= sum;
+    return h;
+}
+
+std::vector<double> kaiser_halfband(double attenuation, double transition_width)
+{
+    int ntaps = kaiser_ntaps(attenuation, transition_width);
+    ntaps = 4 * ((ntaps + 3) / 4) + 3;
+    auto h = kaiser_lowpass(ntaps, 0.25, kaiser_beta(attenuation));
+    int center = ntaps / 2;
+    for (int k = 0; k < ntaps; k++)
+        if (k != center && (k - center) % 2 == 0)
+            h[k] = 0;
+    return h;
+}
@@ -0,0 +1,29 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_FILTER_H
+#define INCLUDED_RSP_SND_FILTER_H
+
+#include <vector>
+
+// Kaiser window FIR filter design
+// frequencies are in cycles/sample (0.5 = Nyquist)
+
+// window shape for a stopband attenuation (in dB)
+double kaiser_beta(double attenuation);
+
+// filter length for a stopband attenuation (in dB) and transition width
+int kaiser_ntaps(double attenuation, double transition_width);
+
+// windowed sinc lowpass with cutoff (-6dB) frequency 'cutoff' and unity gain at DC
+std::vector<double> kaiser_lowpass(int ntaps, double cutoff, double beta);
+
+// half-band lowpass (cutoff 0.25): 4m+3 taps, every other tap except the
+// center one is exactly zero
+std::vector<double> kaiser_halfband(double attenuation, double transition_width);
+
+#endif /* INCLUDED_RSP_SND_FILTER_H */
@@ -0,0 +1,42 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_IN_H
+#define INCLUDED_RSP_SND_IN_H
+
+#include "metadata.h"
+#include "ringbuffer.h"
+#include "stats.h"
+
+class In {
+
+public:
+    In(int verbose = 0): verbose(verbose) {}
+    virtual ~In() {}
+
+    // setters
+    void setStats(StatsPage *stats) { this->stats = stats; }
+    void setMetadata(RingBuffer<BlockInfo> *metadata) { this->metadata = metadata; }
+    virtual void setIFGainReduction(int gRdB, bool wait = false) = 0;
+
+    // getters
+    virtual double getSamplerate() const = 0;
+    virtual int getIFGainReduction() const = 0;
+    // the input has ended by itself (e.g. end of a replayed file)
+    virtual bool isFinished() const { return false; }
+
+    // streaming
+    virtual void start(RingBuffer<short[2]> *buffer) = 0;
+    virtual void stop() = 0;
+
+protected:
+    int verbose;
+    StatsPage *stats = nullptr;
+    RingBuffer<BlockInfo> *metadata = nullptr;
+};
+
+#endif /* INCLUDED_RSP_SND_IN_H */
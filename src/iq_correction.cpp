@@ -0,0 +1,126 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "iq_correction.h"
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+
+// the estimates only look at every ESTIMATE_STRIDE-th sample
+static constexpr size_t ESTIMATE_STRIDE = 8;
+// keep the fixed-point correction from overflowing
+static constexpr double MAX_DC = 8192;
+static constexpr double MAX_PHASE_ERROR = 0.5;    // tan(phase error)
+static constexpr double MIN_POWER = 1;
+
+IqCorrection::IqCorrection(const IqCorrectionConfig& config, double sample_rate, int verbose):
+    Stage(verbose),
+    sample_rate(sample_rate),
+    dc_offset(config.dc_offset),
+    iq_balance(config.iq_balance),
+    dc_time_constant(config.dc_time_constant),
+    iq_time_constant(config.iq_time_constant),
+    have_estimates(false),
+    dc_i(0),
+    dc_q(0),
+    power_i(0),
+    power_q(0),
+    cross_iq(0),
+    c1(16384),
+    c2(0)
+{
+}
+
+IqCorrection::~IqCorrection()
+{
+    if (verbose >= 1 && have_estimates)
+        std::cerr << "iq correction - dc: " << dc_i << " " << dc_q
+                  << " - gain imbalance: " << 10 * log10(power_q / power_i) << "dB"
+                  << " - phase error: " << asin(cross_iq / sqrt(power_i * power_q)) * 180 / M_PI << "deg"
+                  << std::endl;
+}
+
+
+// getters
+double IqCorrection::getSamplerate() const
+{
+    return sample_rate;
+}
+
+
+size_t IqCorrection::process(const short (*in)[2], size_t count, short (*out)[2])
+{
+    estimate(in, count);
+
+    // I' = I - dc_i
+    // Q' = (c2 * (I - dc_i) + c1 * (Q - dc_q)), with 0.5 for rounding
+    auto dc_i_used = dc_offset ? dc_i : 0;
+    auto dc_q_used = dc_offset ? dc_q : 0;
+    int offset_i = static_cast<int>(lrint(16384 * (0.5 - dc_i_used)));
+    int offset_q = static_cast<int>(lrint(8192 - c2 * dc_i_used - c1 * dc_q_used));
+    iq_correct(out, in, count, c1, c2, offset_i, offset_q);
+    return count;
+}
+
+size_t IqCorrection::max_output(size_t count) const
+{
+    return count;
+}
+
+void IqCorrection::estimate(const short (*in)[2], size_t count)
+{
+    double sum_i = 0;
+    double sum_q = 0;
+    double sum_ii = 0;
+    double sum_qq = 0;
+    double sum_iq = 0;
+    size_t n = 0;
+    for (size_t k = 0; k < count; k += ESTIMATE_STRIDE) {
+        double i = in[k][0];
+        double q = in[k][1];
+        sum_i += i;
+        sum_q += q;
+        sum_ii += i * i;
+        sum_qq += q * q;
+        sum_iq += i * q;
+        n++;
+    }
+    if (n == 0)
+        return;
+    double mean_i = sum_i / n;
+    double mean_q = sum_q / n;
+    double block_ii = sum_ii / n - mean_i * mean_i;
+    double block_qq = sum_qq / n - mean_q * mean_q;
+    double block_iq = sum_iq / n - mean_i * mean_q;
+
+    // one-pole IIR filters, one step per block
+    double block_time = count / sample_rate;
+    double dc_alpha = have_estimates ? 1 - exp(-block_time / dc_time_constant) : 1;
+    double iq_alpha = have_estimates ? 1 - exp(-block_time / iq_time_constant) : 1;
+    dc_i = std::min(std::max(dc_i + dc_alpha * (mean_i - dc_i), -MAX_DC), MAX_DC);
+    dc_q = std::min(std::max(dc_q + dc_alpha * (mean_q - dc_q), -MAX_DC), MAX_DC);
+    power_i += iq_alpha * (block_ii - power_i);
+    power_q += iq_alpha * (block_qq - power_q);
+    cross_iq += iq_alpha * (block_iq - cross_iq);
+    have_estimates = true;
+
+    if (!iq_balance || power_i < MIN_POWER || power_q < MIN_POWER)
+        return;
+
+    // with I = a cos(t) and Q = g a sin(t + phi):
+    //   g = sqrt(E[Q^2] / E[I^2]), sin(phi) = E[IQ] / sqrt(E[I^2] E[Q^2])
+    //   Q / g = a (sin(t) cos(phi) + cos(t) sin(phi))
+    // so a sin(t) = Q / (g cos(phi)) - I tan(phi)
+    double gain = sqrt(power_q / power_i);
+    double sin_phi = std::min(std::max(cross_iq / sqrt(power_i * power_q), -0.45), 0.45);
+    double cos_phi = sqrt(1 - sin_phi * sin_phi);
+    double tan_phi = std::min(std::max(sin_phi / cos_phi, -MAX_PHASE_ERROR), MAX_PHASE_ERROR);
+    c1 = static_cast<int>(lrint(std::min(std::max(16384 / (gain * cos_phi), 8192.0), 32767.0)));
+    c2 = static_cast<int>(lrint(-16384 * tan_phi));
+}
@@ -0,0 +1,57 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_IQ_CORRECTION_H
+#define INCLUDED_RSP_SND_IQ_CORRECTION_H
+
+#include "stage.h"
+
+class IqCorrectionConfig {
+public:
+    bool enable;
+    bool dc_offset;                  // remove the DC offset
+    bool iq_balance;                 // correct the I/Q gain and phase imbalance
+    double dc_time_constant;         // s
+    double iq_time_constant;         // s
+};
+
+// software DC offset and I/Q imbalance correction
+// the estimates are updated once per block from a subset of the samples
+// (a one-pole IIR on the block averages); the correction itself is a
+// fixed-point multiply-add pair per sample
+class IqCorrection: public Stage {
+
+public:
+    IqCorrection(const IqCorrectionConfig& config, double sample_rate, int verbose = 0);
+    ~IqCorrection();
+
+    // getters
+    double getSamplerate() const override;
+
+protected:
+    size_t process(const short (*in)[2], size_t count, short (*out)[2]) override;
+    size_t max_output(size_t count) const override;
+
+private:
+    void estimate(const short (*in)[2], size_t count);
+
+    double sample_rate;
+    bool dc_offset;
+    bool iq_balance;
+    double dc_time_constant;
+    double iq_time_constant;
+    bool have_estimates;
+    double dc_i;
+    double dc_q;
+    double power_i;                  // E[I^2], E[Q^2], E[IQ] (without DC)
+    double power_q;
+    double cross_iq;
+    int c1;                          // Q14 correction coefficients
+    int c2;
+};
+
+#endif /* INCLUDED_RSP_SND_IQ_CORRECTION_H */
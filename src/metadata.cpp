@@ -0,0 +1,28 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "metadata.h"
+
+
+MetadataReader::MetadataReader(RingBuffer<BlockInfo> *metadata):
+    metadata(metadata),
+    reader(-1),
+    read_ptr(nullptr),
+    have_next_sample_num(false),
+    next_sample_num(0)
+{
+    if (metadata != nullptr) {
+        reader = metadata->add_reader();
+        read_ptr = metadata->next_read_ptr(reader);
+    }
+}
+
+MetadataReader::~MetadataReader()
+{
+    if (metadata != nullptr)
+        metadata->remove_reader(reader);
+}
@@ -0,0 +1,76 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_METADATA_H
+#define INCLUDED_RSP_SND_METADATA_H
+
+#include "ringbuffer.h"
+#include <cstdint>
+
+// descriptor of a block of samples written to the I/Q ring buffer
+// (one per stream callback); they go through their own ring buffer, so
+// readers can tell exactly where the I/Q stream is discontinuous
+enum BlockFlags {
+    BLOCK_RESET = 1,                // the API reset the stream
+    BLOCK_GAIN_CHANGED = 2,         // first block with the new gain
+    BLOCK_DROPPED = 4,              // dropped_samples were not written
+};
+
+struct BlockInfo {
+    uint64_t seq;                   // I/Q ring buffer sequence number
+    int64_t timestamp;              // host time (ns since the epoch)
+    uint32_t first_sample_num;      // hardware sample counter
+    uint32_t num_samples;           // samples written to the ring buffer
+    uint32_t dropped_samples;
+    uint32_t flags;
+};
+
+class MetadataReader {
+
+public:
+    MetadataReader(RingBuffer<BlockInfo> *metadata);
+    ~MetadataReader();
+
+    // go through the blocks that start before the I/Q sequence number
+    // 'seq' and call handler(block, reason, gap) for each discontinuity
+    template <typename F>
+    void check(uint64_t seq, F handler);
+
+private:
+    RingBuffer<BlockInfo> *metadata;
+    int reader;
+    BlockInfo *read_ptr;
+    bool have_next_sample_num;
+    uint32_t next_sample_num;
+};
+
+template <typename F>
+void MetadataReader::check(uint64_t seq, F handler)
+{
+    if (metadata == nullptr)
+        return;
+    auto nblocks = metadata->next_read_max_size(reader);
+    // an overrun moves the read pointer
+    read_ptr = metadata->next_read_ptr(reader);
+    size_t k = 0;
+    for (; k < nblocks && read_ptr[k].seq < seq; k++) {
+        const auto& block = read_ptr[k];
+        if (block.flags & BLOCK_RESET)
+            handler(block, "reset", 0);
+        else if (have_next_sample_num && block.first_sample_num != next_sample_num)
+            handler(block, "gap", static_cast<int32_t>(block.first_sample_num - next_sample_num));
+        if (block.flags & BLOCK_DROPPED)
+            handler(block, "dropped", block.dropped_samples);
+        if (block.flags & BLOCK_GAIN_CHANGED)
+            handler(block, "gain", 0);
+        next_sample_num = block.first_sample_num + block.num_samples + block.dropped_samples;
+        have_next_sample_num = true;
+    }
+    read_ptr = metadata->next_read_ptr(reader, k);
+}
+
+#endif /* INCLUDED_RSP_SND_METADATA_H */
@@ -0,0 +1,43 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "nco.h"
+#include "simd.h"
+#include <cmath>
+#include <iostream>
+
+
+Nco::Nco(double frequency, double sample_rate, int verbose):
+    Stage(verbose),
+    sample_rate(sample_rate),
+    phase(0),
+    increment(2 * M_PI * frequency / sample_rate)
+{
+    if (std::abs(frequency) >= sample_rate / 2)
+        throw Nco::Exception("invalid NCO frequency");
+    if (verbose >= 1)
+        std::cerr << "NCO frequency shift: " << frequency << " Hz" << std::endl;
+}
+
+
+// getters
+double Nco::getSamplerate() const
+{
+    return sample_rate;
+}
+
+
+size_t Nco::process(const short (*in)[2], size_t count, short (*out)[2])
+{
+    nco_mix(out, in, count, phase, increment);
+    return count;
+}
+
+size_t Nco::max_output(size_t count) const
+{
+    return count;
+}
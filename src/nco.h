@@ -0,0 +1,42 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_NCO_H
+#define INCLUDED_RSP_SND_NCO_H
+
+#include "stage.h"
+#include <stdexcept>
+#include <string>
+
+// numerically controlled oscillator frequency shifter
+// the phase is accumulated in double precision once per chunk; within a
+// chunk the SIMD kernel runs a renormalized recursive oscillator
+class Nco: public Stage {
+
+public:
+    // shift the spectrum up by 'frequency' Hz (negative = down)
+    Nco(double frequency, double sample_rate, int verbose = 0);
+
+    // getters
+    double getSamplerate() const override;
+
+    class Exception: public std::runtime_error {
+    public:
+        Exception(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+protected:
+    size_t process(const short (*in)[2], size_t count, short (*out)[2]) override;
+    size_t max_output(size_t count) const override;
+
+private:
+    double sample_rate;
+    double phase;                    // rad
+    double increment;                // rad/sample
+};
+
+#endif /* INCLUDED_RSP_SND_NCO_H */
@@ -8,13 +8,26 @@
 #ifndef INCLUDED_RSP_SND_OUT_H
 #define INCLUDED_RSP_SND_OUT_H
 
+#include "metadata.h"
 #include "ringbuffer.h"
+#include "stats.h"
+#include <atomic>
 
 class Out {
 
 public:
     Out(int verbose = 0): verbose(verbose) {}
-    ~Out() {}
+    virtual ~Out() {}
+
+    // setters
+    void setStats(StatsPage *stats) { this->stats = stats; }
+    void setMetadata(RingBuffer<BlockInfo> *metadata) { this->metadata = metadata; }
+    void setCpu(int cpu) { this->cpu = cpu; }
+
+    // getters
+    // the reader this output has registered on its ring buffer (-1 = none),
+    // so its lag can be watched from another thread
+    int getReader() const { return reader_id.load(std::memory_order_acquire); }
 
     // streaming
     virtual void start(RingBuffer<short[2]> *buffer) = 0;
@@ -22,6 +35,10 @@ public:
 
 protected:
     int verbose;
+    StatsPage *stats = nullptr;
+    RingBuffer<BlockInfo> *metadata = nullptr;
+    int cpu = -1;
+    std::atomic<int> reader_id{-1};
 };
 
 #endif /* INCLUDED_RSP_SND_OUT_H */
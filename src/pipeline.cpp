@@ -0,0 +1,268 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "decimator.h"
+#include "file.h"
+#include "iq_correction.h"
+#include "nco.h"
+#include "pipeline.h"
+#include "resampler.h"
+#include "snd.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+
+Pipeline::Pipeline(const PipelineConfig& config, double input_rate,
+                   double input_frequency,
+                   const IqCorrectionConfig& iq_correction_config,
+                   const DecimatorConfig& decimator_config,
+                   const ResamplerConfig& resampler_config,
+                   const SndConfig& snd_config, const FileConfig& file_config,
+                   int verbose):
+    verbose(verbose)
+{
+    nodes.push_back({ PIPELINE_INPUT,
+                      new RingBuffer<short[2]>(PIPELINE_RING_BUFFER_SIZE, verbose),
+                      new RingBuffer<BlockInfo>(PIPELINE_METADATA_RING_BUFFER_SIZE),
+                      input_rate, input_frequency, nullptr, -1 });
+
+    for (size_t i = 0; i < config.stages.size(); i++) {
+        const auto& stage_config = config.stages[i];
+        auto name = stage_config.name.empty() ? stage_config.type : stage_config.name;
+        if (find(name) >= 0) {
+            std::cerr << "duplicate pipeline stage name: " << name << " (stage " << i + 1 << ")" << std::endl;
+            throw Pipeline::Exception("duplicate pipeline stage name");
+        }
+        int input = stage_config.input.empty() ? nodes.size() - 1 : find(stage_config.input);
+        if (input < 0) {
+            std::cerr << "stage " << name << ": unknown input " << stage_config.input << std::endl;
+            throw Pipeline::Exception("unknown pipeline stage input");
+        }
+        // the input callback must return quickly, so only a stage can
+        // take another stage onto its thread
+        if (stage_config.fuse && nodes[input].stage == nullptr) {
+            std::cerr << "stage " << name << ": only a stage can be fused onto another stage" << std::endl;
+            throw Pipeline::Exception("invalid pipeline stage fusion");
+        }
+
+        auto stage = create_stage(stage_config, nodes[input].sample_rate,
+                                  iq_correction_config, decimator_config,
+                                  resampler_config);
+        Node node = { name,
+                      new RingBuffer<short[2]>(PIPELINE_RING_BUFFER_SIZE, verbose),
+                      new RingBuffer<BlockInfo>(PIPELINE_METADATA_RING_BUFFER_SIZE),
+                      stage->getSamplerate(), nodes[input].frequency, stage, input };
+        // the NCO moves the spectrum up, so the center goes down
+        if (stage_config.type == "nco")
+            node.frequency -= stage_config.frequency;
+        stage->setMetadata(nodes[input].metadata, node.metadata);
+        stage->setCpu(stage_config.cpu);
+        if (stage_config.fuse)
+            nodes[input].stage->addFused(stage);
+        nodes.push_back(node);
+        if (verbose >= 1)
+            std::cerr << "pipeline stage " << name << ": " << stage_config.type << " - input: " << nodes[input].name << " - sample rate: " << node.sample_rate << (stage_config.fuse ? " - fused" : "") << std::endl;
+    }
+
+    for (const auto& sink_config : config.sinks) {
+        int input = sink_config.input.empty() ? nodes.size() - 1 : find(sink_config.input);
+        if (input < 0) {
+            std::cerr << "sink " << sink_config.output << ": unknown input " << sink_config.input << std::endl;
+            throw Pipeline::Exception("unknown pipeline sink input");
+        }
+        Out *out;
+        if (sink_config.is_file) {
+            FileConfig sink_file_config = file_config;
+            sink_file_config.name = sink_config.output;
+            sink_file_config.sample_rate = nodes[input].sample_rate;
+            sink_file_config.frequency = nodes[input].frequency;
+            out = new File<short[2]>(sink_file_config, verbose);
+        } else {
+            SndConfig sink_snd_config = snd_config;
+            sink_snd_config.name = sink_config.output;
+            sink_snd_config.sample_rate = nodes[input].sample_rate;
+            out = new Snd(sink_snd_config, verbose);
+        }
+        out->setMetadata(nodes[input].metadata);
+        out->setCpu(sink_config.cpu);
+        auto name = sink_config.output.empty() ? "-" : sink_config.output;
+        sinks.push_back({ name, out, input, 0, 0, 0, false, 0, 0, {} });
+        if (verbose >= 1)
+            std::cerr << "pipeline sink " << name << ": " << (sink_config.is_file ? "file" : "snd") << " - input: " << nodes[input].name << std::endl;
+    }
+}
+
+Pipeline::~Pipeline()
+{
+    for (auto& sink : sinks)
+        delete sink.out;
+    for (auto& node : nodes) {
+        delete node.stage;
+        delete node.ringbuffer;
+        delete node.metadata;
+    }
+}
+
+
+// getters
+RingBuffer<short[2]> *Pipeline::getRingBuffer(const std::string& name) const
+{
+    auto node = find(name);
+    return node >= 0 ? nodes[node].ringbuffer : nullptr;
+}
+
+RingBuffer<BlockInfo> *Pipeline::getMetadata(const std::string& name) const
+{
+    auto node = find(name);
+    return node >= 0 ? nodes[node].metadata : nullptr;
+}
+
+double Pipeline::getSamplerate(const std::string& name) const
+{
+    auto node = find(name);
+    return node >= 0 ? nodes[node].sample_rate : 0;
+}
+
+double Pipeline::getFrequency(const std::string& name) const
+{
+    auto node = find(name);
+    return node >= 0 ? nodes[node].frequency : 0;
+}
+
+bool Pipeline::hasRingBuffer(const std::string& name) const
+{
+    return find(name) >= 0;
+}
+
+
+// setters
+// the stats page has room for the readers of one ring buffer: the one
+// read by the first sink; the lag of every sink is published by monitor()
+void Pipeline::setStats(StatsPage *stats)
+{
+    this->stats = stats;
+    for (auto& node : nodes)
+        if (node.stage != nullptr)
+            node.stage->setStats(stats);
+    for (auto& sink : sinks)
+        sink.out->setStats(stats);
+    if (!sinks.empty())
+        nodes[sinks[0].input].ringbuffer->setStats(stats);
+}
+
+
+// streaming
+// downstream first, so that a fused stage is ready before its upstream
+// stage starts pushing samples into it
+void Pipeline::start()
+{
+    for (auto& sink : sinks)
+        sink.out->start(nodes[sink.input].ringbuffer);
+    for (auto node = nodes.rbegin(); node != nodes.rend(); ++node)
+        if (node->stage != nullptr)
+            node->stage->start(nodes[node->input].ringbuffer, node->ringbuffer);
+}
+
+// the input must have been stopped already; each stage stops its output
+// ring buffer when it exits, so the stop propagates downstream
+void Pipeline::stop()
+{
+    // the last counts, while the sinks still hold their readers
+    monitor();
+    for (auto& node : nodes)
+        if (node.stage != nullptr)
+            node.stage->stop();
+    for (auto& sink : sinks) {
+        sink.out->stop();
+        if (verbose >= 1 || sink.overruns > 0) {
+            auto size = nodes[sink.input].ringbuffer->get_size();
+            // formatted apart, so std::cerr keeps its own format
+            std::ostringstream percent;
+            percent << std::fixed << std::setprecision(2) << (100.0 * sink.max_lag / size);
+            std::cerr << "sink " << sink.name << " max lag: " << sink.max_lag << " samples (" << percent.str() << "%) - overruns: " << sink.overruns << " - lost samples: " << sink.lost_samples << std::endl;
+        }
+    }
+}
+
+// main thread
+// a sink is lagging when it is more than half a ring buffer behind, which
+// leaves it half a ring buffer before it loses samples; it is reported
+// once, and again only after it has caught up to within a quarter
+// overruns are reported at most once a second per sink
+static constexpr auto SINK_REPORT_INTERVAL = std::chrono::seconds(1);
+
+void Pipeline::monitor()
+{
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < sinks.size(); i++) {
+        auto& sink = sinks[i];
+        auto reader = sink.out->getReader();
+        if (reader < 0)
+            continue;
+        auto ringbuffer = nodes[sink.input].ringbuffer;
+        auto lag = ringbuffer->get_lag(reader);
+        auto overruns = ringbuffer->get_overruns(reader);
+        auto lost_samples = ringbuffer->get_lost_samples(reader);
+        sink.max_lag = std::max(sink.max_lag, lag);
+        if (stats != nullptr && i < STATS_MAX_SINKS) {
+            stats->sink_lag[i].add(lag);
+            stats->sink_overruns[i].add(overruns - sink.overruns);
+            stats->sink_lost_samples[i].add(lost_samples - sink.lost_samples);
+        }
+        sink.overruns = overruns;
+        sink.lost_samples = lost_samples;
+
+        auto size = ringbuffer->get_size();
+        if (!sink.lagging && lag > size / 2) {
+            sink.lagging = true;
+            std::cerr << "sink " << sink.name << " is falling behind - lag: " << lag << " samples (" << (100 * lag / size) << "% of the ring buffer)" << std::endl;
+        } else if (sink.lagging && lag < size / 4) {
+            sink.lagging = false;
+            if (verbose >= 1)
+                std::cerr << "sink " << sink.name << " caught up - lag: " << lag << " samples" << std::endl;
+        }
+        if (sink.overruns != sink.reported_overruns && now - sink.reported_time >= SINK_REPORT_INTERVAL) {
+            std::cerr << "sink " << sink.name << " overruns: " << (sink.overruns - sink.reported_overruns) << " - lost samples: " << (sink.lost_samples - sink.reported_lost_samples) << std::endl;
+            sink.reported_overruns = sink.overruns;
+            sink.reported_lost_samples = sink.lost_samples;
+            sink.reported_time = now;
+        }
+    }
+}
+
+
+int Pipeline::find(const std::string& name) const
+{
+    for (size_t i = 0; i < nodes.size(); i++)
+        if (nodes[i].name == name)
+            return i;
+    return -1;
+}
+
+Stage *Pipeline::create_stage(const StageConfig& config, double input_rate,
+                              const IqCorrectionConfig& iq_correction_config,
+                              const DecimatorConfig& decimator_config,
+                              const ResamplerConfig& resampler_config)
+{
+    if (config.type == "iq_correction") {
+        return new IqCorrection(iq_correction_config, input_rate, verbose);
+    } else if (config.type == "nco") {
+        return new Nco(config.frequency, input_rate, verbose);
+    } else if (config.type == "decimator") {
+        DecimatorConfig stage_decimator_config = decimator_config;
+        stage_decimator_config.factor = config.factor;
+        return new Decimator(stage_decimator_config, input_rate, verbose);
+    } else if (config.type == "resampler") {
+        ResamplerConfig stage_resampler_config = resampler_config;
+        stage_resampler_config.output_rate = config.output_rate;
+        return new Resampler(stage_resampler_config, input_rate, verbose);
+    }
+    std::cerr << "invalid pipeline stage type: " << config.type << std::endl;
+    throw Pipeline::Exception("invalid pipeline stage type");
+}
@@ -0,0 +1,135 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_PIPELINE_H
+#define INCLUDED_RSP_SND_PIPELINE_H
+
+#include "decimator.h"
+#include "file.h"
+#include "iq_correction.h"
+#include "metadata.h"
+#include "out.h"
+#include "resampler.h"
+#include "ringbuffer.h"
+#include "snd.h"
+#include "stage.h"
+#include "stats.h"
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// name of the ring buffer the input writes to
+static constexpr const char *PIPELINE_INPUT = "in";
+static constexpr size_t PIPELINE_RING_BUFFER_SIZE = 65536;
+static constexpr size_t PIPELINE_METADATA_RING_BUFFER_SIZE = 4096;
+
+class StageConfig {
+public:
+    std::string name;                // of its output ring buffer ("" = type)
+    std::string type;                // iq_correction, nco, decimator, resampler
+    std::string input;               // "in" or the name of a stage ("" = previous stage)
+    int cpu;                         // CPU to pin the thread to (-1 = any)
+    bool fuse;                       // run on the thread of the input stage
+    double frequency;                // nco: shift up by frequency Hz
+    int factor;                      // decimator
+    double output_rate;              // resampler
+};
+
+class SinkConfig {
+public:
+    std::string input;               // "" = last stage
+    std::string output;              // file name or sound card
+    bool is_file;
+    int cpu;
+};
+
+class PipelineConfig {
+public:
+    std::vector<StageConfig> stages;
+    std::vector<SinkConfig> sinks;
+};
+
+// processing graph after the input: stages and sinks connected by named
+// ring buffers; a ring buffer can feed any number of stages and sinks
+// the stages are created in config order, so a stage can only read from
+// the input or from a stage declared before it
+// the sinks of one ring buffer each read it with their own reader, so a
+// tee costs no copy; monitor() watches the lag of every sink, so a sink
+// that falls behind is reported by name before it starts losing samples
+class Pipeline {
+
+public:
+    Pipeline(const PipelineConfig& config, double input_rate,
+             double input_frequency,
+             const IqCorrectionConfig& iq_correction_config,
+             const DecimatorConfig& decimator_config,
+             const ResamplerConfig& resampler_config,
+             const SndConfig& snd_config, const FileConfig& file_config,
+             int verbose = 0);
+    ~Pipeline();
+
+    // getters
+    RingBuffer<short[2]> *getRingBuffer(const std::string& name) const;
+    RingBuffer<BlockInfo> *getMetadata(const std::string& name) const;
+    double getSamplerate(const std::string& name) const;
+    double getFrequency(const std::string& name) const;     // center frequency
+    bool hasRingBuffer(const std::string& name) const;
+
+    // setters
+    void setStats(StatsPage *stats);
+
+    // streaming (the input is started and stopped by the caller)
+    void start();
+    void stop();
+    // sample the lag and the overruns of the sinks (call periodically)
+    void monitor();
+
+    class Exception: public std::runtime_error {
+    public:
+        Exception(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+private:
+    struct Node {
+        std::string name;
+        RingBuffer<short[2]> *ringbuffer;
+        RingBuffer<BlockInfo> *metadata;
+        double sample_rate;
+        double frequency;            // center frequency (Hz)
+        Stage *stage;                // nullptr for the input
+        int input;                   // index of the input node
+    };
+
+    struct Sink {
+        std::string name;            // output
+        Out *out;
+        int input;                   // index of the input node
+        uint64_t max_lag;
+        uint64_t overruns;
+        uint64_t lost_samples;
+        bool lagging;
+        // the overruns last reported, and when
+        uint64_t reported_overruns;
+        uint64_t reported_lost_samples;
+        std::chrono::steady_clock::time_point reported_time;
+    };
+
+    int find(const std::string& name) const;
+    Stage *create_stage(const StageConfig& config, double input_rate,
+                        const IqCorrectionConfig& iq_correction_config,
+                        const DecimatorConfig& decimator_config,
+                        const ResamplerConfig& resampler_config);
+
+    int verbose;
+    std::vector<Node> nodes;
+    std::vector<Sink> sinks;
+    StatsPage *stats = nullptr;
+};
+
+#endif /* INCLUDED_RSP_SND_PIPELINE_H */
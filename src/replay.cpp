@@ -0,0 +1,153 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "replay.h"
+#include "ringbuffer.h"
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+
+Replay::Replay(const ReplayConfig& config, int verbose):
+    In(verbose),
+    buffer(nullptr),
+    sample_rate(config.sample_rate),
+    realtime(config.realtime),
+    loop(config.loop),
+    block_size(config.block_size),
+    gRdB(0)
+{
+    if (block_size == 0)
+        throw Replay::Exception("invalid block size");
+    if (config.name.empty() || config.name == "-") {
+        fd = fileno(stdin);
+    } else {
+        fd = open(config.name.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "open(" << config.name << ") failed: " << strerror(errno) << std::endl;
+            throw Replay::Exception("open() failed");
+        }
+    }
+    if (verbose >= 1)
+        std::cerr << "replay source - file: " << config.name << " - sample rate: " << sample_rate << " - realtime: " << realtime << std::endl;
+}
+
+Replay::~Replay()
+{
+    if (fd != fileno(stdin)) {
+        auto err = close(fd);
+        if (err < 0)
+            std::cerr << "close() failed: " << strerror(errno) << std::endl;
+    }
+}
+
+
+// setters
+void Replay::setIFGainReduction(int gRdB, bool /* wait */)
+{
+    // the gain is baked into the recording; just remember the value
+    this->gRdB = gRdB;
+}
+
+
+// getters
+double Replay::getSamplerate() const
+{
+    return sample_rate;
+}
+
+int Replay::getIFGainReduction() const
+{
+    return gRdB;
+}
+
+
+// streaming
+void Replay::start(RingBuffer<short[2]> *buffer)
+{
+    this->buffer = buffer;
+    total_samples = 0;
+    finished = false;
+    run = true;
+    thread = std::thread([this, buffer] { replay_loop(buffer); });
+}
+
+void Replay::stop()
+{
+    if (run) {
+        run = false;
+        if (thread.joinable())
+            thread.join();
+    }
+
+    if (buffer != nullptr)
+        buffer->stop();
+
+    if (verbose >= 1)
+        std::cerr << "replay source total_samples: " << total_samples << std::endl;
+}
+
+void Replay::replay_loop(RingBuffer<short[2]> *buffer)
+{
+    auto start_time = std::chrono::steady_clock::now();
+    auto write_ptr = buffer->next_write_ptr();
+    size_t partial = 0;    // bytes of an incomplete sample from the last read
+    bool restarted = false;
+    while (run) {
+        auto bytecount = block_size * sizeof(short[2]) - partial;
+        auto nread = read(fd, reinterpret_cast<char *>(write_ptr) + partial, bytecount);
+        if (nread < 0) {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "read() failed: " << strerror(errno) << std::endl;
+            break;
+        }
+        if (nread == 0) {
+            if (loop && lseek(fd, 0, SEEK_SET) == 0) {
+                partial = 0;
+                // the stream jumps back to the start of the file
+                restarted = true;
+                continue;
+            }
+            if (verbose >= 1)
+                std::cerr << "replay source - end of file" << std::endl;
+            break;
+        }
+        partial += nread;
+        auto samples = partial / sizeof(short[2]);
+        partial %= sizeof(short[2]);
+        if (samples == 0)
+            continue;
+        // an incomplete sample is already at the start of the next block
+        auto first_seq = buffer->get_write_seq();
+        write_ptr = buffer->next_write_ptr(samples);
+        if (metadata != nullptr) {
+            auto block = metadata->next_write_ptr();
+            block->seq = first_seq;
+            block->timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            block->first_sample_num = static_cast<uint32_t>(total_samples);
+            block->num_samples = samples;
+            block->dropped_samples = 0;
+            block->flags = restarted ? BLOCK_RESET : 0;
+            metadata->next_write_ptr(1);
+        }
+        restarted = false;
+        total_samples += samples;
+        if (realtime) {
+            auto elapsed = std::chrono::nanoseconds(static_cast<int64_t>(1e9 * total_samples / sample_rate));
+            std::this_thread::sleep_until(start_time + elapsed);
+        }
+    }
+    // end of file (or a read error): the readers get what is left in the
+    // ring buffer, and are not parked waiting for more
+    if (run) {
+        buffer->stop();
+        finished = true;
+    }
+}
@@ -0,0 +1,69 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_REPLAY_H
+#define INCLUDED_RSP_SND_REPLAY_H
+
+#include "in.h"
+#include "ringbuffer.h"
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+class ReplayConfig {
+public:
+    std::string name;
+    double sample_rate;
+    bool realtime;                   // pace the output to sample_rate
+    bool loop;                       // restart at end of file
+    unsigned int block_size;         // samples per block (like a USB callback)
+};
+
+// raw I/Q file (interleaved S16) replay
+class Replay: public In {
+
+public:
+    Replay(const ReplayConfig& config, int verbose = 0);
+    ~Replay();
+
+    // setters
+    void setIFGainReduction(int gRdB, bool wait = false) override;
+
+    // getters
+    double getSamplerate() const override;
+    int getIFGainReduction() const override;
+    bool isFinished() const override { return finished; }
+
+    // streaming
+    void start(RingBuffer<short[2]> *buffer) override;
+    void stop() override;
+
+    class Exception: public std::runtime_error {
+    public:
+        Exception(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+private:
+    void replay_loop(RingBuffer<short[2]> *buffer);
+
+    RingBuffer<short[2]> *buffer;
+    int fd;
+    double sample_rate;
+    bool realtime;
+    bool loop;
+    unsigned int block_size;
+    int gRdB;
+
+    std::thread thread;
+    bool run = false;
+    std::atomic<bool> finished{false};
+    uint64_t total_samples = 0;
+};
+
+#endif /* INCLUDED_RSP_SND_REPLAY_H */
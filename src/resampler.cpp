@@ -0,0 +1,116 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "filter.h"
+#include "resampler.h"
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+
+
+// keep the polyphase filter bank in the CPU caches
+static constexpr int MAX_PHASES = 4096;
+static constexpr size_t MAX_COEFFS = 1 << 20;
+
+Resampler::Resampler(const ResamplerConfig& config, double input_rate, int verbose):
+    Stage(verbose),
+    output_rate(config.output_rate)
+{
+    auto in_rate = llround(input_rate);
+    auto out_rate = llround(config.output_rate);
+    if (in_rate <= 0 || out_rate <= 0)
+        throw Resampler::Exception("invalid resampler rates");
+    if (config.passband <= 0 || config.passband >= 1)
+        throw Resampler::Exception("invalid resampler passband");
+    auto g = std::gcd(in_rate, out_rate);
+    if (out_rate / g > MAX_PHASES)
+        throw Resampler::Exception("resampler output/input rate ratio is too complex");
+    interpolation = out_rate / g;
+    decimation = in_rate / g;
+
+    // prototype filter at L times the input rate; the stopband starts at
+    // the lower of the two Nyquist frequencies
+    double nyquist = 0.5 * std::min(in_rate, out_rate);
+    double proto_rate = static_cast<double>(interpolation) * in_rate;
+    double cutoff = 0.5 * (1 + config.passband) * nyquist / proto_rate;
+    double transition = (1 - config.passband) * nyquist / proto_rate;
+    int ntaps = kaiser_ntaps(config.attenuation, transition);
+    taps = (ntaps + interpolation - 1) / interpolation;
+    if (static_cast<size_t>(taps) * interpolation > MAX_COEFFS)
+        throw Resampler::Exception("resampler filter is too long - lower the attenuation or the passband");
+    ntaps = taps * interpolation;
+    auto h = kaiser_lowpass(ntaps, cutoff, kaiser_beta(config.attenuation));
+
+    // phase p computes sum(h[p + j * L] * x[n - j]); the coefficients are
+    // stored reversed, so the dot product walks the input forward
+    coeffs.resize(ntaps);
+    for (int p = 0; p < interpolation; p++)
+        for (int t = 0; t < taps; t++)
+            coeffs[p * taps + t] = static_cast<float>(interpolation * h[p + (taps - 1 - t) * interpolation]);
+
+    reset();
+
+    if (verbose >= 1)
+        std::cerr << "resampler " << in_rate << " -> " << out_rate << " Hz - L=" << interpolation << " M=" << decimation << " - " << taps << " taps per phase" << std::endl;
+}
+
+Resampler::~Resampler() {}
+
+
+// getters
+double Resampler::getSamplerate() const
+{
+    return output_rate;
+}
+
+
+size_t Resampler::process(const short (*in)[2], size_t count, short (*out)[2])
+{
+    size_t history = taps - 1;
+    xi.resize(history + count);
+    xq.resize(history + count);
+    for (size_t k = 0; k < count; k++) {
+        xi[history + k] = in[k][0];
+        xq[history + k] = in[k][1];
+    }
+
+    size_t end = history + count;
+    size_t nout = 0;
+    while (next_index < end) {
+        float yi;
+        float yq;
+        fir_iq(&xi[next_index - history], &xq[next_index - history],
+               &coeffs[next_phase * taps], taps, yi, yq);
+        out[nout][0] = static_cast<short>(std::min(std::max(lrintf(yi), -32768L), 32767L));
+        out[nout][1] = static_cast<short>(std::min(std::max(lrintf(yq), -32768L), 32767L));
+        nout++;
+        next_phase += decimation;
+        next_index += next_phase / interpolation;
+        next_phase %= interpolation;
+    }
+
+    // keep the history for the next block
+    std::copy(xi.end() - history, xi.end(), xi.begin());
+    std::copy(xq.end() - history, xq.end(), xq.begin());
+    next_index -= count;
+    return nout;
+}
+
+size_t Resampler::max_output(size_t count) const
+{
+    return (count * interpolation + decimation - 1) / decimation + 1;
+}
+
+void Resampler::reset()
+{
+    xi.assign(taps - 1, 0);
+    xq.assign(taps - 1, 0);
+    next_index = taps - 1;
+    next_phase = 0;
+}
@@ -0,0 +1,57 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_RESAMPLER_H
+#define INCLUDED_RSP_SND_RESAMPLER_H
+
+#include "stage.h"
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class ResamplerConfig {
+public:
+    double output_rate;              // Hz (0 = no resampling)
+    double attenuation;              // stopband attenuation (dB)
+    double passband;                 // passband edge (fraction of the output Nyquist frequency)
+};
+
+// polyphase rational resampler (interpolate by L, lowpass, decimate by M)
+// only the output samples are computed, each with one of the L
+// phases of a Kaiser window lowpass prototype filter
+class Resampler: public Stage {
+
+public:
+    Resampler(const ResamplerConfig& config, double input_rate, int verbose = 0);
+    ~Resampler();
+
+    // getters
+    double getSamplerate() const override;
+
+    class Exception: public std::runtime_error {
+    public:
+        Exception(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+protected:
+    size_t process(const short (*in)[2], size_t count, short (*out)[2]) override;
+    size_t max_output(size_t count) const override;
+    void reset() override;
+
+private:
+    double output_rate;
+    int interpolation;               // L
+    int decimation;                  // M
+    int taps;                        // per phase
+    std::vector<float> coeffs;       // L phases of 'taps' coefficients (reversed)
+    std::vector<float> xi;           // taps - 1 samples of history + input
+    std::vector<float> xq;
+    size_t next_index;               // newest input sample of the next output
+    int next_phase;
+};
+
+#endif /* INCLUDED_RSP_SND_RESAMPLER_H */
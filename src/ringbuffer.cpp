@@ -5,21 +5,42 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#include "metadata.h"
 #include "ringbuffer.h"
+#include "stats.h"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
 #include <iomanip>
 #include <iostream>
+#include <linux/futex.h>
+#include <sstream>
+#include <stdexcept>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be a plain 32 bit integer");
+
+static inline long futex(std::atomic<uint32_t> *addr, int op, uint32_t val,
+                         const struct timespec *timeout = nullptr)
+{
+    return syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), op, val,
+                   timeout, nullptr, 0);
+}
+
+
 template <typename T>
 RingBuffer<T>::RingBuffer(size_t size, int verbose):
     data(nullptr),
     size(size),
-    write_idx(0),
     verbose(verbose),
+    write_seq(0),
+    nblocks(0),
+    parked(0),
     stopped(false),
-    max_read_size(0)
+    stats(nullptr)
 {
     const int pagesize = getpagesize();
 
@@ -41,6 +62,21 @@ RingBuffer<T>::RingBuffer(size_t size, int verbose):
     if (addr_ret !=  addr_req)
         throw std::runtime_error("mremap() second copy returned different address than requested");
     data = static_cast<T*>(addr);
+
+    for (auto& block_start : block_starts)
+        block_start = 0;
+    for (auto& reader : readers) {
+        reader.read_seq = 0;
+        reader.active = false;
+        reader.max_read_size = 0;
+        reader.overruns = 0;
+        reader.lost_samples = 0;
+        reader.min_read_size = 1;
+        reader.max_wait_ms = 0;
+        reader.wake_seq = NOT_WAITING;
+        reader.futex = 0;
+        reader.wakeups = 0;
+    }
 }
 
 template <typename T>
@@ -54,16 +90,32 @@ RingBuffer<T>::~RingBuffer()
         munmap(addr, bytesize);
         data = nullptr;
         size = 0;
-        write_idx = 0;
+        write_seq = 0;
     }
 }
 
 template <typename T>
 T* RingBuffer<T>::next_write_ptr(size_t advance)
 {
-    write_idx = (write_idx + advance) % size;
-    cv.notify_all();
-    return data + write_idx;
+    auto seq = write_seq.load(std::memory_order_relaxed);
+    if (advance == 0)
+        return data + seq % size;
+    seq += advance;
+    block_starts[nblocks++ % BLOCK_HISTORY].store(seq, std::memory_order_relaxed);
+    write_seq.store(seq, std::memory_order_release);
+    // pairs with the fence in wait(): either the reader sees the new
+    // write_seq or we see its wake_seq
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (parked.load(std::memory_order_relaxed) > 0) {
+        for (auto& r : readers) {
+            auto wake_seq = r.wake_seq.load(std::memory_order_relaxed);
+            if (seq >= wake_seq && r.wake_seq.compare_exchange_strong(wake_seq, NOT_WAITING, std::memory_order_relaxed)) {
+                r.wakeups.fetch_add(1, std::memory_order_relaxed);
+                wake(r);
+            }
+        }
+    }
+    return data + seq % size;
 }
 
 template <typename T>
@@ -73,37 +125,248 @@ size_t RingBuffer<T>::next_write_max_size()
 }
 
 template <typename T>
-T* RingBuffer<T>::next_read_ptr(T* current_read_ptr, size_t advance)
+uint64_t RingBuffer<T>::get_write_seq() const
+{
+    return write_seq.load(std::memory_order_relaxed);
+}
+
+template <typename T>
+int RingBuffer<T>::add_reader(OverrunPolicy policy)
+{
+    for (int i = 0; i < MAX_READERS; i++) {
+        bool expected = false;
+        if (readers[i].active.compare_exchange_strong(expected, true)) {
+            readers[i].read_seq.store(write_seq.load(std::memory_order_acquire),
+                                      std::memory_order_relaxed);
+            readers[i].policy = policy;
+            readers[i].max_read_size = 0;
+            readers[i].overruns = 0;
+            readers[i].lost_samples = 0;
+            readers[i].overrun_pending = false;
+            readers[i].min_read_size = 1;
+            readers[i].max_wait_ms = 0;
+            readers[i].wakeups = 0;
+            return i;
+        }
+    }
+    throw std::runtime_error("too many ring buffer readers");
+}
+
+template <typename T>
+void RingBuffer<T>::remove_reader(int reader)
+{
+    auto& r = readers[reader];
+    if (verbose >= 1) {
+        // formatted apart, so std::cerr keeps its own format
+        std::ostringstream percent;
+        percent << std::fixed << std::setprecision(2) << (100.0 * r.max_read_size / size);
+        std::cerr << "ring buffer reader " << reader << " max_read_size: " << r.max_read_size << " (" << percent.str() << "%) - wakeups: " << r.wakeups << std::endl;
+    }
+    if (verbose >= 1 || r.overruns > 0)
+        std::cerr << "ring buffer reader " << reader << " overruns: " << r.overruns << " - lost samples: " << r.lost_samples << std::endl;
+    r.active.store(false, std::memory_order_release);
+}
+
+template <typename T>
+T* RingBuffer<T>::next_read_ptr(int reader, size_t advance)
+{
+    auto& r = readers[reader];
+    auto read_seq = r.read_seq.load(std::memory_order_relaxed);
+    if (advance > 0) {
+        // the writer may have lapped us while we were using the data
+        auto seq = write_seq.load(std::memory_order_acquire);
+        if (seq - read_seq > size && !r.overrun_pending) {
+            r.overruns++;
+            r.overrun_pending = true;
+            if (stats != nullptr)
+                stats->ring_overruns[reader].add(1);
+            if (verbose >= 1)
+                std::cerr << "ring buffer reader " << reader << " overrun - data overwritten while reading" << std::endl;
+        }
+    }
+    read_seq += advance;
+    r.read_seq.store(read_seq, std::memory_order_relaxed);
+    return data + read_seq % size;
+}
+
+template <typename T>
+T* RingBuffer<T>::reset_read_ptr(int reader)
 {
-    if (current_read_ptr == nullptr)
-        return data + write_idx;
-    size_t read_idx = current_read_ptr - data;
-    return data + (read_idx + advance) % size;
+    auto read_seq = write_seq.load(std::memory_order_acquire);
+    readers[reader].read_seq.store(read_seq, std::memory_order_relaxed);
+    return data + read_seq % size;
 }
 
 template <typename T>
-size_t RingBuffer<T>::next_read_max_size(T* current_read_ptr, bool blocking)
+uint64_t RingBuffer<T>::get_read_seq(int reader) const
 {
-    size_t read_idx = current_read_ptr - data;
-    if (blocking) {
-        std::unique_lock<std::mutex> lock(mutex);
-        cv.wait(lock, [this, read_idx]() {
-            return write_idx != read_idx || stopped;
-        });
+    return readers[reader].read_seq.load(std::memory_order_relaxed);
+}
+
+template <typename T>
+size_t RingBuffer<T>::next_read_max_size(int reader, bool blocking)
+{
+    auto& r = readers[reader];
+    auto read_seq = r.read_seq.load(std::memory_order_relaxed);
+    auto seq = write_seq.load(std::memory_order_acquire);
+    if (blocking && seq - read_seq < r.min_read_size && !stopped.load(std::memory_order_acquire))
+        seq = wait(reader, read_seq, seq);
+    if (seq - read_seq > size - 1) {
+        read_seq = recover(reader, read_seq, seq);
+        r.read_seq.store(read_seq, std::memory_order_relaxed);
     }
-    size_t read_size = (size + write_idx - read_idx) % size;
-    max_read_size = std::max(max_read_size, read_size);
+    r.overrun_pending = false;
+    size_t read_size = seq - read_seq;
+    if (stats != nullptr)
+        stats->ring_fill[reader].add(read_size);
+    if (read_size > r.max_read_size.load(std::memory_order_relaxed))
+        r.max_read_size.store(read_size, std::memory_order_relaxed);
     return read_size;
 }
 
 template <typename T>
-void RingBuffer<T>::stop()
+void RingBuffer<T>::set_watermark(int reader, size_t min_read_size, unsigned int max_wait_ms)
+{
+    // a watermark too close to the ring size would always end in an overrun
+    readers[reader].min_read_size = std::min(std::max(min_read_size, size_t(1)), size / 2);
+    readers[reader].max_wait_ms = max_wait_ms;
+}
+
+// park a reader on its futex until its watermark is reached, the deadline
+// passes with some data available, or the ring buffer is stopped
+template <typename T>
+uint64_t RingBuffer<T>::wait(int reader, uint64_t read_seq, uint64_t seq)
+{
+    auto& r = readers[reader];
+    size_t wanted = r.min_read_size;
+    bool has_deadline = r.max_wait_ms > 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(r.max_wait_ms);
+    parked.fetch_add(1, std::memory_order_relaxed);
+    while (seq - read_seq < wanted && !stopped.load(std::memory_order_acquire)) {
+        struct timespec timeout;
+        struct timespec *timeoutp = nullptr;
+        if (has_deadline) {
+            auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (left <= 0) {
+                // deadline passed: any data will do
+                has_deadline = false;
+                wanted = 1;
+                continue;
+            }
+            timeout.tv_sec = left / 1000000000;
+            timeout.tv_nsec = left % 1000000000;
+            timeoutp = &timeout;
+        }
+        // read the futex word before publishing wake_seq, so a wakeup
+        // between the check below and FUTEX_WAIT is not lost
+        auto futex_val = r.futex.load(std::memory_order_acquire);
+        r.wake_seq.store(read_seq + wanted, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        seq = write_seq.load(std::memory_order_acquire);
+        if (seq - read_seq < wanted && !stopped.load(std::memory_order_acquire))
+            futex(&r.futex, FUTEX_WAIT_PRIVATE, futex_val, timeoutp);
+        r.wake_seq.store(NOT_WAITING, std::memory_order_relaxed);
+        seq = write_seq.load(std::memory_order_acquire);
+    }
+    parked.fetch_sub(1, std::memory_order_relaxed);
+    return seq;
+}
+
+template <typename T>
+void RingBuffer<T>::wake(Reader& r)
+{
+    r.futex.fetch_add(1, std::memory_order_release);
+    futex(&r.futex, FUTEX_WAKE_PRIVATE, 1);
+}
+
+// move a lapped reader back into the valid part of the ring
+template <typename T>
+uint64_t RingBuffer<T>::recover(int reader, uint64_t read_seq, uint64_t seq)
 {
-    stopped = true;
-    cv.notify_all();
+    auto& r = readers[reader];
+    uint64_t new_read_seq = seq;
+    if (r.policy == OVERRUN_RESYNC) {
+        // oldest block boundary in the older half of the ring, so the
+        // writer can't catch up with us again right away
+        uint64_t oldest_safe = seq - size / 2;
+        for (auto& block_start : block_starts) {
+            auto start = block_start.load(std::memory_order_relaxed);
+            if (start >= oldest_safe && start < new_read_seq)
+                new_read_seq = start;
+        }
+    }
+    if (!r.overrun_pending) {
+        r.overruns++;
+        if (stats != nullptr)
+            stats->ring_overruns[reader].add(1);
+    }
+    r.lost_samples += new_read_seq - read_seq;
+    if (stats != nullptr)
+        stats->ring_lost_samples[reader].add(new_read_seq - read_seq);
     if (verbose >= 1)
-        std::cerr << "ring buffer max_read_size: " << max_read_size << " (" << std::fixed << std::setprecision(2) << (100.0 * max_read_size / size) << "%)" << std::endl;
+        std::cerr << "ring buffer reader " << reader << " overrun - lost " << (new_read_seq - read_seq) << " samples" << std::endl;
+    return new_read_seq;
+}
+
+template <typename T>
+void RingBuffer<T>::setStats(StatsPage *stats)
+{
+    static_assert(MAX_READERS <= STATS_MAX_READERS, "too many readers for the stats page");
+    this->stats = stats;
+}
+
+template <typename T>
+void RingBuffer<T>::stop()
+{
+    stopped.store(true, std::memory_order_seq_cst);
+    for (auto& r : readers)
+        wake(r);
+}
+
+template <typename T>
+bool RingBuffer<T>::is_stopped() const
+{
+    return stopped.load(std::memory_order_acquire);
+}
+
+
+// reader statistics
+template <typename T>
+bool RingBuffer<T>::is_active(int reader) const
+{
+    return readers[reader].active.load(std::memory_order_acquire);
+}
+
+template <typename T>
+uint64_t RingBuffer<T>::get_lag(int reader) const
+{
+    auto read_seq = readers[reader].read_seq.load(std::memory_order_relaxed);
+    return write_seq.load(std::memory_order_acquire) - read_seq;
 }
 
+template <typename T>
+size_t RingBuffer<T>::get_max_read_size(int reader) const
+{
+    return readers[reader].max_read_size.load(std::memory_order_relaxed);
+}
+
+template <typename T>
+uint64_t RingBuffer<T>::get_overruns(int reader) const
+{
+    return readers[reader].overruns.load(std::memory_order_relaxed);
+}
+
+template <typename T>
+uint64_t RingBuffer<T>::get_lost_samples(int reader) const
+{
+    return readers[reader].lost_samples.load(std::memory_order_relaxed);
+}
+
+template <typename T>
+uint64_t RingBuffer<T>::get_wakeups(int reader) const
+{
+    return readers[reader].wakeups.load(std::memory_order_relaxed);
+}
 
 template class RingBuffer<short[2]>;
+template class RingBuffer<BlockInfo>;
@@ -8,10 +8,21 @@
 #ifndef INCLUDED_RSP_SND_RINGBUFFER_H
 #define INCLUDED_RSP_SND_RINGBUFFER_H
 
-#include <condition_variable>
+#include <atomic>
 #include <cstddef>
-#include <mutex>
+#include <cstdint>
 
+struct StatsPage;
+
+// what a reader does when the writer has lapped it
+enum OverrunPolicy { OVERRUN_SKIP_TO_NEWEST, OVERRUN_RESYNC };
+
+// single producer/multiple consumers ring buffer
+// the producer never blocks and only makes a system call when a parked
+// reader's watermark has been reached; each reader has its own registered
+// cursor and its own futex to sleep on
+// positions are monotonic 64 bit sequence numbers, so a reader that falls
+// more than a ring size behind is detected (overrun) instead of wrapping
 template <typename T>
 class RingBuffer {
 
@@ -19,21 +30,80 @@ public:
     RingBuffer(size_t size, int verbose = 0);
     ~RingBuffer();
 
+    size_t get_size() const { return size; }
+
+    // producer
     T* next_write_ptr(size_t advance = 0);
     size_t next_write_max_size();
-    T* next_read_ptr(T* current_read_ptr, size_t advance = 0);
-    size_t next_read_max_size(T* current_read_ptr, bool blocking = false);
+    uint64_t get_write_seq() const;
+
+    // consumers
+    int add_reader(OverrunPolicy policy = OVERRUN_SKIP_TO_NEWEST);
+    void remove_reader(int reader);
+    T* next_read_ptr(int reader, size_t advance = 0);
+    T* reset_read_ptr(int reader);
+    uint64_t get_read_seq(int reader) const;
+    // after an overrun the reader has been moved, so a read pointer taken
+    // before this call is stale: take it again with next_read_ptr(reader)
+    size_t next_read_max_size(int reader, bool blocking = false);
+    // a blocking reader is woken up only when at least min_read_size samples
+    // are available, or max_wait_ms (0 = no limit) has passed and there is
+    // some data
+    void set_watermark(int reader, size_t min_read_size, unsigned int max_wait_ms = 0);
     void stop();
+    // no more writes after stop(): a reader that saw is_stopped() before
+    // an empty next_read_max_size() has read everything
+    bool is_stopped() const;
+
+    // publish reader fill levels and overruns to the stats page
+    void setStats(StatsPage *stats);
+
+    // reader statistics (can be called from any thread)
+    bool is_active(int reader) const;
+    uint64_t get_lag(int reader) const;
+    size_t get_max_read_size(int reader) const;
+    uint64_t get_overruns(int reader) const;
+    uint64_t get_lost_samples(int reader) const;
+    uint64_t get_wakeups(int reader) const;
+
+    static constexpr int MAX_READERS = 16;
 
 private:
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+    static constexpr int BLOCK_HISTORY = 64;
+
+    struct alignas(CACHE_LINE_SIZE) Reader {
+        std::atomic<uint64_t> read_seq;
+        std::atomic<bool> active;
+        OverrunPolicy policy;
+        std::atomic<size_t> max_read_size;
+        std::atomic<uint64_t> overruns;
+        std::atomic<uint64_t> lost_samples;
+        bool overrun_pending;
+        size_t min_read_size;
+        unsigned int max_wait_ms;
+        // write_seq that ends the wait (NOT_WAITING when not parked)
+        std::atomic<uint64_t> wake_seq;
+        std::atomic<uint32_t> futex;
+        std::atomic<uint64_t> wakeups;
+    };
+
+    static constexpr uint64_t NOT_WAITING = UINT64_MAX;
+
+    uint64_t recover(int reader, uint64_t read_seq, uint64_t seq);
+    uint64_t wait(int reader, uint64_t read_seq, uint64_t seq);
+    void wake(Reader& r);
+
     T* data;
     size_t size;
-    size_t write_idx;
     int verbose;
-    bool stopped = false;
-    size_t max_read_size;
-    std::mutex mutex;
-    std::condition_variable cv;
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> write_seq;
+    uint64_t nblocks;
+    std::atomic<uint64_t> block_starts[BLOCK_HISTORY];
+    alignas(CACHE_LINE_SIZE) std::atomic<int> parked;
+    std::atomic<bool> stopped;
+    Reader readers[MAX_READERS];
+    StatsPage *stats;
 };
 
 #endif /* INCLUDED_RSP_SND_RINGBUFFER_H */
@@ -7,6 +7,7 @@
 
 #include "ringbuffer.h"
 #include "rsp.h"
+#include "simd.h"
 #include <fcntl.h>
 #include <iostream>
 #include <sys/mman.h>
@@ -27,16 +28,18 @@ static void static_event_callback(sdrplay_api_EventT eventId,
 
 
 Rsp::Rsp(const RspConfig& config, int verbose):
-    verbose(verbose)
+    In(verbose)
 {
     open_sdrplay_api();
-    if (verbose >= 1)
+    if (verbose >= 1) {
         sdrplay_api_DebugEnable(NULL, sdrplay_api_DbgLvl_Verbose);
+        std::cerr << "using " << simd_isa() << " kernels" << std::endl;
+    }
     select_device(config.serial, config.antenna);
-    setSamplerate(config.sample_rate);
+    setSamplerate(config.sample_rate, config.software_decimation);
     //setBandwidth(config.sample_rate);
     setBandwidth(config.bw_type * 1000.0 + 1);
-    setFrequency(config.frequency);
+    setFrequency(config.frequency + config.tuning_offset);
     setIFAgc(sdrplay_api_AGC_DISABLE);
     setIFGainReduction(config.gRdB);
     setRFLnaState(config.lna_state);
@@ -169,7 +172,9 @@ bool Rsp::select_device_rspduo(sdrplay_api_DeviceT& device_rspduo,
 
 
 // setters
-void Rsp::setSamplerate(double sample_rate)
+// with software decimation the RSP streams at the undecimated rate, and
+// decimation is left to a Decimator stage
+void Rsp::setSamplerate(double sample_rate, bool software_decimation)
 {
     double fsHz = sample_rate;
     unsigned char decimationFactor = 1;
@@ -180,6 +185,10 @@ void Rsp::setSamplerate(double sample_rate)
     if (fsHz < 2e6 || fsHz > 10.66e6 || (device.hwVer == SDRPLAY_RSPduo_ID &&
         device.rspDuoMode != sdrplay_api_RspDuoMode_Single_Tuner && fsHz != 2e6))
         throw Rsp::Exception("invalid sample rate");
+    if (software_decimation) {
+        sample_rate = fsHz;
+        decimationFactor = 1;
+    }
     sdrplay_api_ReasonForUpdateT reason = sdrplay_api_Update_None;
     if (device_params->devParams && fsHz != device_params->devParams->fsFreq.fsHz) {
         device_params->devParams->fsFreq.fsHz = fsHz;
@@ -514,28 +523,62 @@ void Rsp::stream_callback(short *xi, short *xq,
     if (!run)
         return;
 
+    auto callback_time = std::chrono::steady_clock::now();
+    if (stats != nullptr) {
+        if (total_samples > 0)
+            stats->callback_gap.add(std::chrono::duration_cast<std::chrono::nanoseconds>(callback_time - last_callback_time).count());
+        stats->callback_samples.add(numSamples);
+    }
+    last_callback_time = callback_time;
+
     gain_reduction_changed |= params->grChanged;
 
     int xidx = 0;
+    auto first_seq = buffer->get_write_seq();
     auto write_ptr = buffer->next_write_ptr();
     for (int i = 0; i < MAX_WRITE_TRIES; i++) {
         auto max_write_size = buffer->next_write_max_size();
         int samples = std::min((int) max_write_size, (int) numSamples - xidx);
-        for (int k = 0; k < samples; k++, xidx++) {
-            write_ptr[k][0] = xi[xidx];
-            write_ptr[k][1] = xq[xidx];
-        }
+        interleave(write_ptr, xi + xidx, xq + xidx, samples);
+        xidx += samples;
         write_ptr = buffer->next_write_ptr(samples);
         total_samples += samples;
-        if (xidx == numSamples)
+        if (stats != nullptr)
+            stats->total_samples.add(samples);
+        if (xidx == numSamples) {
+            publish_block(first_seq, params, numSamples, 0, reset);
+            if (stats != nullptr)
+                stats->callback_duration.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - callback_time).count());
             return;
+        }
     }
 
     std::cerr << "stream_callback() - dropped " << (numSamples - xidx) << " samples" << std::endl;
+    if (stats != nullptr)
+        stats->dropped_samples.add(numSamples - xidx);
+    publish_block(first_seq, params, xidx, numSamples - xidx, reset);
 
     return;
 }
 
+void Rsp::publish_block(uint64_t seq, const sdrplay_api_StreamCbParamsT *params,
+                        unsigned int num_samples, unsigned int dropped_samples,
+                        unsigned int reset)
+{
+    if (metadata == nullptr)
+        return;
+    auto block = metadata->next_write_ptr();
+    block->seq = seq;
+    block->timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    block->first_sample_num = params->firstSampleNum;
+    block->num_samples = num_samples;
+    block->dropped_samples = dropped_samples;
+    block->flags = (reset ? BLOCK_RESET : 0) |
+                   (params->grChanged ? BLOCK_GAIN_CHANGED : 0) |
+                   (dropped_samples > 0 ? BLOCK_DROPPED : 0);
+    metadata->next_write_ptr(1);
+}
+
 void Rsp::event_callback(sdrplay_api_EventT eventId,
                          sdrplay_api_TunerSelectT tuner,
                          sdrplay_api_EventParamsT *params)
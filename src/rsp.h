@@ -8,7 +8,10 @@
 #ifndef INCLUDED_RSP_SND_RSP_H
 #define INCLUDED_RSP_SND_RSP_H
 
+#include "in.h"
+#include "metadata.h"
 #include "ringbuffer.h"
+#include <chrono>
 #include <sdrplay_api.h>
 #include <stdexcept>
 #include <string>
@@ -22,22 +25,24 @@ public:
     int gRdB;
     int lna_state;
     bool wide_band_signal;
+    bool software_decimation;       // the RSP streams the undecimated rate
+    double tuning_offset;           // Hz (the NCO stage shifts it back)
     std::string antenna;
     std::string gain_file;
 };
 
-class Rsp {
+class Rsp: public In {
 
 public:
     Rsp(const RspConfig& config, int verbose = 0);
     ~Rsp();
 
     // setters
-    void setSamplerate(double sample_rate);
+    void setSamplerate(double sample_rate, bool software_decimation = false);
     void setBandwidth(double sample_rate);
     void setFrequency(double frequency);
     void setAntenna(const std::string& antenna);
-    void setIFGainReduction(int gRdB, bool wait = false);
+    void setIFGainReduction(int gRdB, bool wait = false) override;
     void setIFAgc(int enable = sdrplay_api_AGC_50HZ,
                   int setPoint_dBfs = -60,
                   unsigned short attack_ms = 0,
@@ -54,12 +59,12 @@ public:
     void setBulkTransferMode(bool enable);
 
     // getters
-    double getSamplerate() const;
-    int getIFGainReduction() const;
+    double getSamplerate() const override;
+    int getIFGainReduction() const override;
 
     // streaming
-    void start(RingBuffer<short[2]> *buffer);
-    void stop();
+    void start(RingBuffer<short[2]> *buffer) override;
+    void stop() override;
     void stream_callback(short *xi, short *xq,
                          sdrplay_api_StreamCbParamsT *params,
                          unsigned int numSamples,
@@ -80,6 +85,10 @@ private:
                               const std::string& serial,
                               const std::string& antenna);
 
+    void publish_block(uint64_t seq, const sdrplay_api_StreamCbParamsT *params,
+                       unsigned int num_samples, unsigned int dropped_samples,
+                       unsigned int reset);
+
     void open_gain_file();
     void close_gain_file();
 
@@ -88,10 +97,10 @@ private:
     sdrplay_api_RxChannelParamsT *rx_channel_params;
     RingBuffer<short[2]> *buffer;
     double sample_rate;
-    int verbose;
     bool run = false;
     bool device_selected = false;
     size_t total_samples = 0;
+    std::chrono::steady_clock::time_point last_callback_time;
 
     int gain_reduction_changed = 0;
 
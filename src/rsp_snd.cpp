@@ -7,16 +7,51 @@
 
 #include "agc_gtw.h"
 #include "agc_rsp.h"
+#include "capture.h"
+#include "channelizer.h"
 #include "config.h"
+#include "decimator.h"
 #include "file.h"
+#include "in.h"
+#include "iq_correction.h"
+#include "nco.h"
 #include "out.h"
+#include "pipeline.h"
+#include "replay.h"
+#include "resampler.h"
 #include "ringbuffer.h"
 #include "rsp.h"
 #include "snd.h"
+#include "spectrum.h"
+#include "stage.h"
+#include "stats.h"
+#include "synth.h"
+#include <cmath>
 #include <csignal>
 #include <iostream>
+#include <sys/resource.h>
+#include <vector>
 
 
+// what follows the channelizer for one channel
+struct ChannelChain {
+    RingBuffer<short[2]> *input;     // channelizer output
+    std::vector<Stage *> stages;
+    std::vector<RingBuffer<short[2]> *> ringbuffers;
+    Out *out;
+};
+
+// the stages and the output asked for by the command line options, for
+// the parts of the pipeline that the configuration file doesn't declare
+static void add_default_pipeline(PipelineConfig& pipeline_config,
+                                 double input_rate,
+                                 const GlobalConfig& global_config,
+                                 const RspConfig& rsp_config,
+                                 const IqCorrectionConfig& iq_correction_config,
+                                 const ResamplerConfig& resampler_config,
+                                 const SndConfig& snd_config,
+                                 const FileConfig& file_config);
+
 bool terminate = false;
 
 void terminate_signal_handler(int sig)
@@ -24,25 +59,114 @@ void terminate_signal_handler(int sig)
     terminate = true;
 }
 
-int main(int argc, char *argv[])
+volatile sig_atomic_t capture_requested = 0;
+
+void capture_signal_handler(int sig)
 {
-    constexpr size_t RING_BUFFER_SIZE = 65536;
+    capture_requested = 1;
+}
 
+int main(int argc, char *argv[])
+{
     GlobalConfig global_config;
     RspConfig rsp_config;
+    SynthConfig synth_config;
+    ReplayConfig replay_config;
     SndConfig snd_config;
     FileConfig file_config;
     AgcRspConfig agc_rsp_config;
     AgcGtwConfig agc_gtw_config;
+    IqCorrectionConfig iq_correction_config;
+    DecimatorConfig decimator_config;
+    ResamplerConfig resampler_config;
+    ChannelizerConfig channelizer_config;
+    SpectrumConfig spectrum_config;
+    CaptureConfig capture_config;
+    PipelineConfig pipeline_config;
 
-    get_config(argc, argv, global_config, rsp_config, snd_config, file_config,
-               agc_rsp_config, agc_gtw_config);
+    get_config(argc, argv, global_config, rsp_config, synth_config,
+               replay_config, snd_config, file_config, agc_rsp_config,
+               agc_gtw_config, iq_correction_config, decimator_config,
+               resampler_config, channelizer_config, spectrum_config,
+               capture_config, pipeline_config);
 
-    Rsp rsp(rsp_config, global_config.verbose);
+    In *in = nullptr;
+    if (global_config.inModel == IN_RSP)
+        in = new Rsp(rsp_config, global_config.verbose);
+    if (global_config.inModel == IN_SYNTH)
+        in = new Synth(synth_config, global_config.verbose);
+    if (global_config.inModel == IN_REPLAY)
+        in = new Replay(replay_config, global_config.verbose);
 
-    Out *out = global_config.isOutFile ?
-                   dynamic_cast<Out *>(new File<short[2]>(file_config, global_config.verbose)) :
-                   dynamic_cast<Out *>(new Snd(snd_config, global_config.verbose));
+    // processing stages and sinks after the input
+    add_default_pipeline(pipeline_config, in->getSamplerate(), global_config,
+                         rsp_config, iq_correction_config, resampler_config,
+                         snd_config, file_config);
+    // the RSP is tuned tuning_offset Hz above the requested frequency
+    double in_frequency = 0;
+    if (global_config.inModel == IN_RSP) {
+        in_frequency = rsp_config.frequency + rsp_config.tuning_offset;
+        file_config.gain_reduction = rsp_config.gRdB;
+        file_config.lna_state = rsp_config.lna_state;
+    }
+    Pipeline *pipeline = new Pipeline(pipeline_config, in->getSamplerate(),
+                                      in_frequency,
+                                      iq_correction_config, decimator_config,
+                                      resampler_config, snd_config,
+                                      file_config, global_config.verbose);
+    auto ringbuffer = pipeline->getRingBuffer(PIPELINE_INPUT);
+    auto metadata = pipeline->getMetadata(PIPELINE_INPUT);
+
+    // the channelizer reads the full rate stream (after the I/Q correction);
+    // each channel continues with an NCO for the residual offset, a
+    // resampler to its rate, and its own output
+    Channelizer *channelizer = nullptr;
+    std::vector<ChannelChain> channels;
+    if (!channelizer_config.channels.empty()) {
+        if (channelizer_config.input.empty())
+            channelizer_config.input = pipeline->hasRingBuffer("iq_correction") ? "iq_correction" : PIPELINE_INPUT;
+        if (!pipeline->hasRingBuffer(channelizer_config.input)) {
+            std::cerr << "unknown channelizer input: " << channelizer_config.input << std::endl;
+            exit(1);
+        }
+        // the channel offsets are from the requested frequency
+        if (global_config.inModel == IN_RSP)
+            for (auto& channel : channelizer_config.channels)
+                channel.offset -= rsp_config.tuning_offset;
+        channelizer = new Channelizer(channelizer_config, pipeline->getSamplerate(channelizer_config.input), global_config.verbose);
+        for (size_t c = 0; c < channelizer_config.channels.size(); c++) {
+            const auto& channel = channelizer_config.channels[c];
+            if (channel.output.empty()) {
+                std::cerr << "channel " << c + 1 << " has no output" << std::endl;
+                exit(1);
+            }
+            ChannelChain chain;
+            chain.input = new RingBuffer<short[2]>(PIPELINE_RING_BUFFER_SIZE, global_config.verbose);
+            double channel_rate = channelizer->getSamplerate();
+            if (channelizer->getResidual(c) != 0)
+                chain.stages.push_back(new Nco(-channelizer->getResidual(c), channel_rate, global_config.verbose));
+            if (lround(channel.sample_rate) != lround(channel_rate)) {
+                ResamplerConfig channel_resampler_config = resampler_config;
+                channel_resampler_config.output_rate = channel.sample_rate;
+                chain.stages.push_back(new Resampler(channel_resampler_config, channel_rate, global_config.verbose));
+            }
+            for (size_t i = 0; i < chain.stages.size(); i++)
+                chain.ringbuffers.push_back(new RingBuffer<short[2]>(PIPELINE_RING_BUFFER_SIZE, global_config.verbose));
+            if (channel.is_file) {
+                FileConfig channel_file_config = file_config;
+                channel_file_config.name = channel.output;
+                channel_file_config.sample_rate = channel.sample_rate;
+                channel_file_config.frequency = pipeline->getFrequency(channelizer_config.input) + channel.offset;
+                chain.out = new File<short[2]>(channel_file_config, global_config.verbose);
+            } else {
+                SndConfig channel_snd_config = snd_config;
+                channel_snd_config.name = channel.output;
+                channel_snd_config.sample_rate = channel.sample_rate;
+                chain.out = new Snd(channel_snd_config, global_config.verbose);
+            }
+            channels.push_back(chain);
+        }
+    }
 
     Agc *agc = nullptr;
     if (global_config.agcModel == AGC_RSP)
@@ -50,39 +174,191 @@ int main(int argc, char *argv[])
     if (global_config.agcModel == AGC_GTW)
         agc = new AgcGtw(agc_gtw_config, global_config.verbose);
     if (agc != nullptr) {
-        agc->setRsp(&rsp);
+        agc->setIn(in);
         agc->setup();
     }
-    
-    RingBuffer<short[2]> ringbuffer(RING_BUFFER_SIZE, global_config.verbose);
 
-    rsp.start(&ringbuffer);
-    out->start(&ringbuffer);
+    in->setMetadata(metadata);
+    if (agc != nullptr)
+        agc->setMetadata(metadata);
+
+    // spectrum of the RSP stream for monitors
+    Spectrum *spectrum = nullptr;
+    if (!spectrum_config.name.empty())
+        spectrum = new Spectrum(spectrum_config, in->getSamplerate(), in_frequency, global_config.verbose);
+
+    // pre-trigger capture of any ring buffer of the pipeline
+    Capture *capture = nullptr;
+    if (!capture_config.name.empty()) {
+        if (capture_config.input.empty())
+            capture_config.input = PIPELINE_INPUT;
+        if (!pipeline->hasRingBuffer(capture_config.input)) {
+            std::cerr << "unknown capture input: " << capture_config.input << std::endl;
+            exit(1);
+        }
+        capture = new Capture(capture_config, file_config,
+                              pipeline->getSamplerate(capture_config.input),
+                              pipeline->getFrequency(capture_config.input),
+                              global_config.verbose);
+    }
+
+    Stats *stats = nullptr;
+    if (!global_config.statsFile.empty()) {
+        stats = new Stats(global_config.statsFile, global_config.verbose);
+        stats->page->sample_rate = in->getSamplerate();
+        in->setStats(stats->page);
+        pipeline->setStats(stats->page);
+    }
+
+    pipeline->start();
+    in->start(ringbuffer);
+    if (channelizer != nullptr) {
+        std::vector<RingBuffer<short[2]> *> channel_inputs;
+        for (auto& chain : channels)
+            channel_inputs.push_back(chain.input);
+        channelizer->start(pipeline->getRingBuffer(channelizer_config.input),
+                           channel_inputs);
+        for (auto& chain : channels) {
+            for (size_t i = 0; i < chain.stages.size(); i++)
+                chain.stages[i]->start(i == 0 ? chain.input : chain.ringbuffers[i - 1],
+                                       chain.ringbuffers[i]);
+            chain.out->start(chain.ringbuffers.empty() ? chain.input : chain.ringbuffers.back());
+        }
+    }
     if (agc != nullptr)
-        agc->start(&ringbuffer);
+        agc->start(ringbuffer);
+    if (spectrum != nullptr)
+        spectrum->start(ringbuffer);
+    if (capture != nullptr)
+        capture->start(pipeline->getRingBuffer(capture_config.input));
 
 #if 1
     // handle Ctrl-C and SIGTERM
     signal(SIGINT, terminate_signal_handler);
     signal(SIGTERM, terminate_signal_handler);
+    // SIGUSR1 triggers a capture dump
+    if (capture != nullptr)
+        signal(SIGUSR1, capture_signal_handler);
     if (isatty(fileno(stderr)))
         std::cerr << "Type ^C to stop" << std::endl;
     struct timespec delay = { 0, 100000000 };   // 100ms delay
-    while (!terminate)
+    while (!terminate && !in->isFinished()) {
         nanosleep(&delay, nullptr);
+        pipeline->monitor();
+        if (capture_requested) {
+            capture_requested = 0;
+            if (capture->trigger("signal").empty())
+                std::cerr << "capture dump already in progress - SIGUSR1 ignored" << std::endl;
+        }
+    }
 #else
     struct timespec delay = { 60, 0 };   // 60s delay
     nanosleep(&delay, nullptr);
 #endif
 
-    rsp.stop();
+    in->stop();
+    pipeline->stop();
+    if (channelizer != nullptr)
+        channelizer->stop();
+    if (spectrum != nullptr) {
+        spectrum->stop();
+        delete spectrum;
+        spectrum = nullptr;
+    }
+    if (capture != nullptr) {
+        capture->stop();
+        delete capture;
+        capture = nullptr;
+    }
+    for (auto& chain : channels)
+        for (auto stage : chain.stages)
+            stage->stop();
     if (agc != nullptr) {
         agc->stop();
         delete agc;
         agc = nullptr;
     }
-    out->stop();
-    delete out;
-    out = nullptr;
+    for (auto& chain : channels) {
+        chain.out->stop();
+        delete chain.out;
+        for (auto stage : chain.stages)
+            delete stage;
+        for (auto channel_ringbuffer : chain.ringbuffers)
+            delete channel_ringbuffer;
+        delete chain.input;
+    }
+    delete channelizer;
+    channelizer = nullptr;
+    delete pipeline;
+    pipeline = nullptr;
+    delete in;
+    in = nullptr;
+    if (stats != nullptr) {
+        delete stats;
+        stats = nullptr;
+    }
+
+    // to compare the CPU cost of different configurations
+    struct rusage usage;
+    if (global_config.verbose >= 1 && getrusage(RUSAGE_SELF, &usage) == 0)
+        std::cerr << "cpu time - user: " << usage.ru_utime.tv_sec + 1e-6 * usage.ru_utime.tv_usec << "s - system: " << usage.ru_stime.tv_sec + 1e-6 * usage.ru_stime.tv_usec << "s" << std::endl;
     return 0;
 }
+
+static void add_default_pipeline(PipelineConfig& pipeline_config,
+                                 double input_rate,
+                                 const GlobalConfig& global_config,
+                                 const RspConfig& rsp_config,
+                                 const IqCorrectionConfig& iq_correction_config,
+                                 const ResamplerConfig& resampler_config,
+                                 const SndConfig& snd_config,
+                                 const FileConfig& file_config)
+{
+    if (pipeline_config.stages.empty()) {
+        StageConfig stage_config;
+        stage_config.input = "";
+        stage_config.cpu = -1;
+        stage_config.fuse = false;
+        stage_config.frequency = 0;
+        stage_config.factor = 1;
+        stage_config.output_rate = 0;
+        if (iq_correction_config.enable) {
+            stage_config.name = stage_config.type = "iq_correction";
+            pipeline_config.stages.push_back(stage_config);
+        }
+        // the RSP is tuned tuning_offset Hz above the requested frequency
+        if (global_config.inModel == IN_RSP && rsp_config.tuning_offset != 0) {
+            stage_config.name = stage_config.type = "nco";
+            stage_config.frequency = rsp_config.tuning_offset;
+            pipeline_config.stages.push_back(stage_config);
+        }
+        if (global_config.inModel == IN_RSP && rsp_config.software_decimation) {
+            stage_config.factor = static_cast<int>(lround(input_rate / rsp_config.sample_rate));
+            if (stage_config.factor > 1) {
+                stage_config.name = stage_config.type = "decimator";
+                pipeline_config.stages.push_back(stage_config);
+            }
+        }
+        if (resampler_config.output_rate > 0) {
+            stage_config.name = stage_config.type = "resampler";
+            stage_config.output_rate = resampler_config.output_rate;
+            pipeline_config.stages.push_back(stage_config);
+        }
+    }
+
+    // -o (or [file]/[snd] name) reads from the last stage, and so does
+    // every other -o
+    if (pipeline_config.sinks.empty()) {
+        SinkConfig sink_config;
+        sink_config.input = "";
+        sink_config.output = global_config.isOutFile ? file_config.name : snd_config.name;
+        sink_config.is_file = global_config.isOutFile;
+        sink_config.cpu = -1;
+        pipeline_config.sinks.push_back(sink_config);
+        for (const auto& out_name : global_config.teeOutNames) {
+            sink_config.output = out_name;
+            sink_config.is_file = out_name == "-" || out_name.find("/") != std::string::npos;
+            pipeline_config.sinks.push_back(sink_config);
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "sample_format.h"
+#include "simd.h"
+#include <algorithm>
+#include <cstring>
+
+
+// saturation limits (S32_MAX is the largest float below 2^31)
+static constexpr float S32_MIN = -2147483648.0f;
+static constexpr float S32_MAX = 2147483520.0f;
+static constexpr float S24_MIN = -8388608.0f;
+static constexpr float S24_MAX = 8388607.0f;
+
+// the S24 values go through an int32 block that stays in the L1 cache
+static constexpr size_t S24_BLOCK = 2048;
+
+SampleConverter::SampleConverter(SampleFormat format, double scale):
+    format(format),
+    scale(scale)
+{
+}
+
+size_t SampleConverter::getFrameSize() const
+{
+    switch (format) {
+        case SAMPLE_S24_3LE: return 2 * 3;
+        case SAMPLE_S32:     return 2 * sizeof(int32_t);
+        case SAMPLE_CF32:    return 2 * sizeof(float);
+        default:             return 2 * sizeof(short);
+    }
+}
+
+const void *SampleConverter::convert(const short (*in)[2], size_t count)
+{
+    if (format == SAMPLE_S16)
+        return in;
+    auto size = count * getFrameSize();
+    if (buffer.size() < size)
+        buffer.resize(size);
+    convert(buffer.data(), in, count);
+    return buffer.data();
+}
+
+void SampleConverter::convert(void *out, const short (*in)[2], size_t count)
+{
+    auto values = &in[0][0];
+    auto nvalues = 2 * count;
+    switch (format) {
+        case SAMPLE_S24_3LE:
+            s32.resize(S24_BLOCK);
+            for (size_t k = 0; k < nvalues; k += S24_BLOCK) {
+                auto n = std::min(S24_BLOCK, nvalues - k);
+                convert_s32(s32.data(), values + k, n, 256 * scale, S24_MIN, S24_MAX);
+                pack_s24(static_cast<unsigned char *>(out) + 3 * k, s32.data(), n);
+            }
+            break;
+        case SAMPLE_S32:
+            convert_s32(static_cast<int32_t *>(out), values, nvalues, 65536 * scale, S32_MIN, S32_MAX);
+            break;
+        case SAMPLE_CF32:
+            convert_f32(static_cast<float *>(out), values, nvalues, scale / 32768);
+            break;
+        default:
+            memcpy(out, in, nvalues * sizeof(short));
+            break;
+    }
+}
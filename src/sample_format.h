@@ -0,0 +1,45 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_SAMPLE_FORMAT_H
+#define INCLUDED_RSP_SND_SAMPLE_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// output sample formats (interleaved I/Q, little endian)
+// the stream is S16 up to the outputs; the wider formats let a gain
+// (scale > 1) go past the S16 full scale without clipping, and save the
+// consumers a conversion
+enum SampleFormat { SAMPLE_S16, SAMPLE_S24_3LE, SAMPLE_S32, SAMPLE_CF32 };
+
+// S16 -> output format conversion with a scale factor
+// full scale S16 maps to full scale S24/S32 and to +/-1.0 in CF32;
+// out of range values are saturated; S16 is passed through as is (no scale)
+class SampleConverter {
+
+public:
+    SampleConverter(SampleFormat format, double scale = 1.0);
+
+    // getters
+    size_t getFrameSize() const;     // bytes per I/Q frame
+
+    // returns the converted frames; they are valid until the next call
+    const void *convert(const short (*in)[2], size_t count);
+    // converts straight into out[] (count * getFrameSize() bytes, any
+    // alignment), e.g. a DMA buffer
+    void convert(void *out, const short (*in)[2], size_t count);
+
+private:
+    SampleFormat format;
+    float scale;
+    std::vector<unsigned char> buffer;
+    std::vector<int32_t> s32;       // S24 block
+};
+
+#endif /* INCLUDED_RSP_SND_SAMPLE_FORMAT_H */
@@ -0,0 +1,382 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "file.h"
+#include "segment.h"
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+
+// SigMF has no 24 bit sample type
+static const char *get_sigmf_datatype(SampleFormat format)
+{
+    switch (format) {
+        case SAMPLE_S16:
+            return "ci16_le";
+        case SAMPLE_S32:
+            return "ci32_le";
+        case SAMPLE_CF32:
+            return "cf32_le";
+        default:
+            return nullptr;
+    }
+}
+
+// rec.iq -> rec-000001.iq
+std::string get_segment_name(const std::string& name, unsigned int index)
+{
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "-%06u", index);
+    auto slash = name.rfind('/');
+    auto dot = name.rfind('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return name + suffix;
+    return name.substr(0, dot) + suffix + name.substr(dot);
+}
+
+// rec.iq -> rec.sigmf-meta, rec.sigmf-data -> rec.sigmf-meta
+static std::string get_sidecar_name(const std::string& name)
+{
+    auto slash = name.rfind('/');
+    auto dot = name.rfind('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return name + ".sigmf-meta";
+    return name.substr(0, dot) + ".sigmf-meta";
+}
+
+static std::string get_basename(const std::string& name)
+{
+    auto slash = name.rfind('/');
+    return slash == std::string::npos ? name : name.substr(slash + 1);
+}
+
+static bool ends_with(const std::string& s, const std::string& suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+
+FileSegment::FileSegment(const FileConfig& config, const std::string& name, int verbose):
+    name(name),
+    verbose(verbose),
+    frame_size(SampleConverter(config.format).getFrameSize()),
+    writer(nullptr),
+    header(nullptr),
+    rewrite_header(false),
+    spliced(false),
+    stats(nullptr),
+    data_bytes(0),
+    file_bytes(0),
+    compressor(nullptr),
+    datatype(get_sigmf_datatype(config.format)),
+    sample_rate(config.sample_rate),
+    frequency(config.frequency),
+    offset(0)
+{
+    bool is_stdout = name.empty() || name == "-";
+    if (is_stdout) {
+        if (config.direct_io)
+            throw FileSegment::Exception("direct_io requires a file name");
+        fd = fileno(stdout);
+    } else {
+        // the io_uring writer sets the final size, so old contents past the
+        // end are truncated there; a compressed file must end with its
+        // index, so it always starts empty
+        auto flags = O_WRONLY | O_CREAT | (config.direct_io ? O_DIRECT : 0) |
+                     (config.container == CONTAINER_COMPRESSED ? O_TRUNC : 0);
+        fd = open(name.c_str(), flags, 0644);
+        if (fd < 0) {
+            std::cerr << "open(" << name << ") failed: " << strerror(errno) << std::endl;
+            throw FileSegment::Exception("open() failed");
+        }
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        if (config.pipe_size > 0) {
+            auto pipe_size = fcntl(fd, F_SETPIPE_SZ, static_cast<int>(config.pipe_size));
+            if (pipe_size < 0)
+                std::cerr << "fcntl(F_SETPIPE_SZ) failed: " << strerror(errno) << std::endl;
+            else if (verbose >= 1)
+                std::cerr << "pipe size: " << pipe_size << std::endl;
+        }
+        // only raw S16 samples are written straight from the ring buffer
+        spliced = config.splice && config.format == SAMPLE_S16 &&
+                  config.container != CONTAINER_COMPRESSED;
+    } else if (config.splice && verbose >= 1) {
+        std::cerr << name << " is not a pipe - using write()" << std::endl;
+    }
+    if (config.direct_io)
+        writer = new UringWriter(fd, config.io_buffer_size, config.io_queue_depth,
+                                 config.preallocate, verbose);
+    if (config.container == CONTAINER_WAV) {
+        header = new WavHeader(config.format, config.sample_rate, config.frequency,
+                               config.gain_reduction, config.lna_state);
+        // a pipe can't be rewritten: its sizes stay 'unknown'
+        rewrite_header = lseek(fd, 0, SEEK_CUR) == 0;
+    }
+    if (config.container == CONTAINER_COMPRESSED) {
+        rspz_header = { static_cast<uint32_t>(config.compression_block_size),
+                        config.sample_rate, config.frequency };
+        compressor = new Compressor(config.compression_block_size, config.lpc_order,
+                                    config.compression_threads,
+                                    [this](const std::vector<unsigned char>& block, uint64_t first_frame) {
+                                        write_block(block, first_frame);
+                                    });
+    }
+    if (config.sigmf) {
+        if (is_stdout)
+            std::cerr << "no SigMF sidecar for stdout" << std::endl;
+        else if (compressor != nullptr)
+            std::cerr << "no SigMF sidecar for compressed files" << std::endl;
+        else if (datatype == nullptr)
+            std::cerr << "no SigMF datatype for this sample format - no sidecar" << std::endl;
+        else
+            sidecar_name = get_sidecar_name(name);
+    }
+}
+
+FileSegment::~FileSegment()
+{
+    delete compressor;
+    delete writer;
+    delete header;
+    if (fd >= 0 && fd != fileno(stdout)) {
+        auto err = close(fd);
+        if (err < 0)
+            std::cerr << "close() failed: " << strerror(errno) << std::endl;
+    }
+}
+
+
+// file sink thread
+void FileSegment::begin(uint64_t offset, StatsPage *stats,
+                        std::chrono::system_clock::time_point start_time)
+{
+    this->offset = offset;
+    this->stats = stats;
+    this->start_time = start_time;
+    if (writer != nullptr)
+        writer->setStats(stats);
+
+    // the headers go through the same path as the samples, so they are in
+    // order with them also with direct I/O
+    const void *data = nullptr;
+    size_t size = 0;
+    unsigned char rspz[RSPZ_HEADER_SIZE];
+    if (header != nullptr) {
+        header->setStartTime(start_time);
+        data = header->data();
+        size = WavHeader::SIZE;
+    } else if (compressor != nullptr) {
+        rspz_write_header(rspz, rspz_header);
+        data = rspz;
+        size = RSPZ_HEADER_SIZE;
+    }
+    if (size == 0)
+        return;
+    auto nwritten = write_file(data, size);
+    if (nwritten != static_cast<ssize_t>(size)) {
+        std::cerr << "write() file header failed: " << (nwritten < 0 ? strerror(errno) : "incomplete") << std::endl;
+        if (stats != nullptr)
+            stats->file_write_errors.add(1);
+    }
+}
+
+// compressed samples are written by write_block() as the blocks are
+// done, so here they are always all taken
+ssize_t FileSegment::write(const void *data, size_t count)
+{
+    if (compressor != nullptr) {
+        compressor->add(static_cast<const short (*)[2]>(data), count / sizeof(short[2]));
+        data_bytes += count;
+        return count;
+    }
+    auto nwritten = write_file(data, count);
+    if (nwritten > 0)
+        data_bytes += nwritten;
+    return nwritten;
+}
+
+ssize_t FileSegment::splice(const void *data, size_t count)
+{
+    struct iovec iov = { const_cast<void *>(data), count };
+    auto nwritten = vmsplice(fd, &iov, 1, 0);
+    if (nwritten > 0) {
+        data_bytes += nwritten;
+        file_bytes += nwritten;
+    }
+    return nwritten;
+}
+
+size_t FileSegment::getQueued() const
+{
+    int queued = 0;
+    if (ioctl(fd, FIONREAD, &queued) < 0)
+        return 0;
+    return queued;
+}
+
+size_t FileSegment::getPipeSize() const
+{
+    auto pipe_size = fcntl(fd, F_GETPIPE_SZ);
+    return pipe_size > 0 ? pipe_size : 0;
+}
+
+// the io_uring writer only blocks when all its writes are in flight, and
+// reports its own errors
+ssize_t FileSegment::write_file(const void *data, size_t count)
+{
+    ssize_t nwritten = count;
+    if (writer != nullptr)
+        writer->write(data, count);
+    else
+        nwritten = ::write(fd, data, count);
+    if (nwritten > 0)
+        file_bytes += nwritten;
+    return nwritten;
+}
+
+void FileSegment::write_block(const std::vector<unsigned char>& block, uint64_t first_frame)
+{
+    index.push_back({ file_bytes, first_frame });
+    auto nwritten = write_file(block.data(), block.size());
+    if (nwritten != static_cast<ssize_t>(block.size())) {
+        std::cerr << "write() compressed block failed: " << (nwritten < 0 ? strerror(errno) : "incomplete") << std::endl;
+        if (stats != nullptr)
+            stats->file_write_errors.add(1);
+    }
+}
+
+// the sample data is untouched: only the header block is rewritten
+void FileSegment::update_header()
+{
+    if (!rewrite_header)
+        return;
+    header->update(data_bytes);
+    auto nwritten = pwrite(fd, header->data(), WavHeader::SIZE, 0);
+    if (nwritten != WavHeader::SIZE) {
+        std::cerr << "pwrite() WAV header failed: " << (nwritten < 0 ? strerror(errno) : "incomplete") << std::endl;
+        if (stats != nullptr)
+            stats->file_write_errors.add(1);
+    }
+}
+
+void FileSegment::annotate(uint64_t sample, const std::string& comment)
+{
+    if (sidecar_name.empty())
+        return;
+    std::lock_guard<std::mutex> lock(annotations_mutex);
+    annotations.emplace_back(sample > offset ? sample - offset : 0, comment);
+}
+
+
+// any thread
+// the sidecar is written to a temporary file and renamed, so a reader
+// never sees a partial one
+void FileSegment::write_sidecar()
+{
+    if (sidecar_name.empty())
+        return;
+    std::vector<std::pair<uint64_t, std::string>> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(annotations_mutex);
+        snapshot = annotations;
+    }
+
+    auto t = std::chrono::system_clock::to_time_t(start_time);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(start_time.time_since_epoch()).count() % 1000;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char datetime[64];
+    snprintf(datetime, sizeof(datetime), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
+             tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour,
+             tm.tm_min, tm.tm_sec, static_cast<int>(ms));
+
+    auto tmp_name = sidecar_name + ".tmp";
+    auto f = fopen(tmp_name.c_str(), "w");
+    if (f == nullptr) {
+        std::cerr << "fopen(" << tmp_name << ") failed: " << strerror(errno) << std::endl;
+        return;
+    }
+    fprintf(f, "{\n");
+    fprintf(f, "    \"global\": {\n");
+    fprintf(f, "        \"core:datatype\": \"%s\",\n", datatype);
+    fprintf(f, "        \"core:sample_rate\": %.10g,\n", sample_rate);
+    fprintf(f, "        \"core:version\": \"1.0.0\",\n");
+    fprintf(f, "        \"core:num_channels\": 1,\n");
+    fprintf(f, "        \"core:offset\": %" PRIu64 ",\n", offset);
+    if (!ends_with(name, ".sigmf-data"))
+        fprintf(f, "        \"core:dataset\": \"%s\",\n", get_basename(name).c_str());
+    fprintf(f, "        \"core:recorder\": \"rsp_snd\"\n");
+    fprintf(f, "    },\n");
+    fprintf(f, "    \"captures\": [\n");
+    fprintf(f, "        {\n");
+    fprintf(f, "            \"core:sample_start\": 0,\n");
+    if (header != nullptr)
+        fprintf(f, "            \"core:header_bytes\": %zu,\n", WavHeader::SIZE);
+    fprintf(f, "            \"core:frequency\": %.10g,\n", frequency);
+    fprintf(f, "            \"core:datetime\": \"%s\"\n", datetime);
+    fprintf(f, "        }\n");
+    fprintf(f, "    ],\n");
+    fprintf(f, "    \"annotations\": [");
+    for (size_t i = 0; i < snapshot.size(); i++)
+        fprintf(f, "%s\n        { \"core:sample_start\": %" PRIu64 ", \"core:sample_count\": 1, \"core:comment\": \"%s\" }",
+                i == 0 ? "" : ",", snapshot[i].first, snapshot[i].second.c_str());
+    fprintf(f, "%s]\n", snapshot.empty() ? "" : "\n    ");
+    fprintf(f, "}\n");
+    if (fclose(f) != 0 || rename(tmp_name.c_str(), sidecar_name.c_str()) < 0)
+        std::cerr << "writing " << sidecar_name << " failed: " << strerror(errno) << std::endl;
+}
+
+void FileSegment::finish()
+{
+    if (compressor != nullptr) {
+        compressor->finish();
+        std::vector<unsigned char> trailer;
+        rspz_write_index(trailer, index, file_bytes);
+        if (write_file(trailer.data(), trailer.size()) != static_cast<ssize_t>(trailer.size()))
+            std::cerr << "write() block index failed: " << strerror(errno) << std::endl;
+    }
+    if (writer != nullptr)
+        writer->flush();
+    update_header();
+    write_sidecar();
+    if (fd != fileno(stdout)) {
+        auto err = close(fd);
+        if (err < 0)
+            std::cerr << "close() failed: " << strerror(errno) << std::endl;
+    }
+    fd = -1;
+    if (verbose >= 1) {
+        std::cerr << "file " << name << " closed - samples: " << getSamples();
+        if (compressor != nullptr && file_bytes > 0)
+            std::cerr << " - compression ratio: " << static_cast<double>(data_bytes) / file_bytes;
+        std::cerr << std::endl;
+    }
+}
+
+void FileSegment::discard()
+{
+    delete compressor;
+    compressor = nullptr;
+    delete writer;
+    writer = nullptr;
+    if (fd != fileno(stdout)) {
+        close(fd);
+        unlink(name.c_str());
+    }
+    fd = -1;
+}
@@ -0,0 +1,109 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_SEGMENT_H
+#define INCLUDED_RSP_SND_SEGMENT_H
+
+#include "compress.h"
+#include "stats.h"
+#include "uring_writer.h"
+#include "wav.h"
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+class FileConfig;
+
+// name of the file number 'index' of a series (rotated segments, capture
+// dumps): rec.iq -> rec-000001.iq
+std::string get_segment_name(const std::string& name, unsigned int index);
+
+// one output file of a recording (the whole recording, or one segment
+// when the output is rotated): the file descriptor with its io_uring
+// writer and WAV header, and the SigMF sidecar
+// with the compressed container the samples go through a Compressor, and
+// the block index is written by finish()
+// the constructor does all the slow work (open(), io_uring setup, the
+// first preallocated extent), so a segment can be opened ahead of time
+// on another thread; begin() and the writes then run on the file sink
+// thread, and finish() can run on any thread after the last write
+class FileSegment {
+
+public:
+    FileSegment(const FileConfig& config, const std::string& name, int verbose = 0);
+    ~FileSegment();
+
+    // getters
+    const std::string& getName() const { return name; }
+    uint64_t getSamples() const { return data_bytes / frame_size; }
+    bool isSpliced() const { return spliced; }
+
+    // file sink thread
+    // 'offset' is the number of samples in the recording before this file,
+    // and 'start_time' the time of its first sample
+    void begin(uint64_t offset, StatsPage *stats,
+               std::chrono::system_clock::time_point start_time = std::chrono::system_clock::now());
+    ssize_t write(const void *data, size_t count);
+    // zero copy (isSpliced()): the pipe keeps referencing the memory at
+    // data[] until the consumer has read it, so it must not be reused
+    // before getQueued() says so
+    ssize_t splice(const void *data, size_t count);
+    size_t getQueued() const;       // bytes in the pipe not read yet
+    size_t getPipeSize() const;     // bytes
+    void update_header();
+    // 'sample' is counted from the start of the recording
+    void annotate(uint64_t sample, const std::string& comment);
+
+    // any thread
+    void write_sidecar();
+    // write out everything, update the header and the sidecar, and close
+    void finish();
+    // remove a segment that was opened and never used
+    void discard();
+
+    class Exception: public std::runtime_error {
+    public:
+        Exception(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+private:
+    ssize_t write_file(const void *data, size_t count);
+    void write_block(const std::vector<unsigned char>& block, uint64_t first_frame);
+
+    std::string name;
+    int verbose;
+    int fd;
+    size_t frame_size;
+    UringWriter *writer;
+    WavHeader *header;
+    bool rewrite_header;
+    bool spliced;
+    StatsPage *stats;
+    uint64_t data_bytes;             // of samples (uncompressed)
+    uint64_t file_bytes;
+
+    // compressed container
+    Compressor *compressor;
+    RspzHeader rspz_header;
+    std::vector<RspzIndexEntry> index;
+
+    // SigMF
+    std::string sidecar_name;        // "" = no sidecar
+    const char *datatype;
+    double sample_rate;
+    double frequency;
+    uint64_t offset;
+    std::chrono::system_clock::time_point start_time;
+    std::mutex annotations_mutex;
+    std::vector<std::pair<uint64_t, std::string>> annotations;
+};
+
+#endif /* INCLUDED_RSP_SND_SEGMENT_H */
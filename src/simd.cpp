@@ -0,0 +1,1264 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+
+// scalar versions
+static void interleave_scalar(short (*out)[2], const short *xi,
+                              const short *xq, size_t count)
+{
+    for (size_t k = 0; k < count; k++) {
+        out[k][0] = xi[k];
+        out[k][1] = xq[k];
+    }
+}
+
+static void max_abs_iq_scalar(const short (*in)[2], size_t count, int threshold,
+                              int& max_iq, int& above_threshold)
+{
+    int vmax = 0;
+    int above = 0;
+    for (size_t k = 0; k < count; k++) {
+        auto iq = std::max(abs(in[k][0]), abs(in[k][1]));
+        vmax = std::max(iq, vmax);
+        above += iq > threshold;
+    }
+    max_iq = vmax;
+    above_threshold = above;
+}
+
+static void fir_iq_scalar(const float *xi, const float *xq, const float *h,
+                          size_t ntaps, float& yi, float& yq)
+{
+    float si = 0;
+    float sq = 0;
+    for (size_t k = 0; k < ntaps; k++) {
+        si += h[k] * xi[k];
+        sq += h[k] * xq[k];
+    }
+    yi = si;
+    yq = sq;
+}
+
+static void halfband_decimate_scalar(const float *even, const float *odd,
+                                     const float *h, size_t nh, float center,
+                                     float *out, size_t count)
+{
+    for (size_t n = 0; n < count; n++) {
+        float y = center * odd[n + nh - 1];
+        for (size_t i = 0; i < nh; i++)
+            y += h[i] * (even[n + i] + even[n + 2 * nh - 1 - i]);
+        out[n] = y;
+    }
+}
+
+static void iq_correct_scalar(short (*out)[2], const short (*in)[2], size_t count,
+                              int c1, int c2, int offset_i, int offset_q)
+{
+    for (size_t k = 0; k < count; k++) {
+        int i = (16384 * in[k][0] + offset_i) >> 14;
+        int q = (c2 * in[k][0] + c1 * in[k][1] + offset_q) >> 14;
+        out[k][0] = static_cast<short>(std::min(std::max(i, -32768), 32767));
+        out[k][1] = static_cast<short>(std::min(std::max(q, -32768), 32767));
+    }
+}
+
+
+// the oscillators below are recursive: each vector of phasors is rotated by
+// the phase increment of a whole vector, and pulled back to unit magnitude
+// with one Newton step (|p| ~ 1, so 1/|p| ~ (3 - |p|^2) / 2); they also
+// restart from the exact phase at every call
+static inline short saturate(float x)
+{
+    return static_cast<short>(std::min(std::max(lrintf(x), -32768L), 32767L));
+}
+
+static void nco_mix_scalar(short (*out)[2], const short (*in)[2], size_t count,
+                           double phase, double increment)
+{
+    std::complex<float> phasor(cos(phase), sin(phase));
+    const std::complex<float> rotation(cos(increment), sin(increment));
+    for (size_t k = 0; k < count; k++) {
+        auto y = std::complex<float>(in[k][0], in[k][1]) * phasor;
+        out[k][0] = saturate(y.real());
+        out[k][1] = saturate(y.imag());
+        phasor *= rotation;
+        phasor *= 1.5f - 0.5f * std::norm(phasor);
+    }
+}
+
+static void polyphase_iq_scalar(const float *xi, const float *xq, const float *h,
+                                size_t m, size_t ntaps, float *yi, float *yq)
+{
+    for (size_t i = 0; i < m; i++) {
+        float si = 0;
+        float sq = 0;
+        for (size_t r = 0; r < ntaps; r++) {
+            si += h[r * m + i] * xi[i - r * m];
+            sq += h[r * m + i] * xq[i - r * m];
+        }
+        yi[i] = si;
+        yq[i] = sq;
+    }
+}
+
+static void fft_pass_scalar(float *re, float *im, const float *wr, const float *wi,
+                            size_t n, size_t half)
+{
+    for (size_t start = 0; start < n; start += 2 * half) {
+        float *ar = re + start;
+        float *ai = im + start;
+        float *br = ar + half;
+        float *bi = ai + half;
+        for (size_t k = 0; k < half; k++) {
+            auto tr = br[k] * wr[k] - bi[k] * wi[k];
+            auto ti = br[k] * wi[k] + bi[k] * wr[k];
+            br[k] = ar[k] - tr;
+            bi[k] = ai[k] - ti;
+            ar[k] += tr;
+            ai[k] += ti;
+        }
+    }
+}
+
+static void convert_f32_scalar(float *out, const short *in, size_t count, float scale)
+{
+    for (size_t k = 0; k < count; k++)
+        out[k] = in[k] * scale;
+}
+
+static void convert_s32_scalar(int32_t *out, const short *in, size_t count,
+                               float scale, float min, float max)
+{
+    for (size_t k = 0; k < count; k++)
+        out[k] = static_cast<int32_t>(std::lrint(std::min(std::max(in[k] * scale, min), max)));
+}
+
+static void pack_s24_scalar(unsigned char *out, const int32_t *in, size_t count)
+{
+    for (size_t k = 0; k < count; k++) {
+        out[3 * k] = in[k];
+        out[3 * k + 1] = in[k] >> 8;
+        out[3 * k + 2] = in[k] >> 16;
+    }
+}
+
+
+#ifdef SIMD_X86
+__attribute__((target("sse2")))
+static void interleave_sse2(short (*out)[2], const short *xi,
+                            const short *xq, size_t count)
+{
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        auto i = _mm_loadu_si128(reinterpret_cast<const __m128i *>(xi + k));
+        auto q = _mm_loadu_si128(reinterpret_cast<const __m128i *>(xq + k));
+        auto dst = reinterpret_cast<__m128i *>(out + k);
+        _mm_storeu_si128(dst, _mm_unpacklo_epi16(i, q));
+        _mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(i, q));
+    }
+    interleave_scalar(out + k, xi + k, xq + k, count - k);
+}
+
+__attribute__((target("avx2")))
+static void interleave_avx2(short (*out)[2], const short *xi,
+                            const short *xq, size_t count)
+{
+    size_t k = 0;
+    for (; k + 16 <= count; k += 16) {
+        auto i = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(xi + k));
+        auto q = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(xq + k));
+        // unpack works within each 128 bit lane; put the lanes back in order
+        auto lo = _mm256_unpacklo_epi16(i, q);
+        auto hi = _mm256_unpackhi_epi16(i, q);
+        auto dst = reinterpret_cast<__m256i *>(out + k);
+        _mm256_storeu_si256(dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(dst + 1, _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    interleave_sse2(out + k, xi + k, xq + k, count - k);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void interleave_avx512(short (*out)[2], const short *xi,
+                              const short *xq, size_t count)
+{
+    // even output words come from xi (index 0-31), odd ones from xq (32-63)
+    const auto idx_lo = _mm512_set_epi16(47, 15, 46, 14, 45, 13, 44, 12,
+                                         43, 11, 42, 10, 41,  9, 40,  8,
+                                         39,  7, 38,  6, 37,  5, 36,  4,
+                                         35,  3, 34,  2, 33,  1, 32,  0);
+    const auto idx_hi = _mm512_set_epi16(63, 31, 62, 30, 61, 29, 60, 28,
+                                         59, 27, 58, 26, 57, 25, 56, 24,
+                                         55, 23, 54, 22, 53, 21, 52, 20,
+                                         51, 19, 50, 18, 49, 17, 48, 16);
+    size_t k = 0;
+    for (; k + 32 <= count; k += 32) {
+        auto i = _mm512_loadu_si512(xi + k);
+        auto q = _mm512_loadu_si512(xq + k);
+        auto dst = reinterpret_cast<__m512i *>(out + k);
+        _mm512_storeu_si512(dst, _mm512_permutex2var_epi16(i, idx_lo, q));
+        _mm512_storeu_si512(dst + 1, _mm512_permutex2var_epi16(i, idx_hi, q));
+    }
+    interleave_avx2(out + k, xi + k, xq + k, count - k);
+}
+
+// each frame is a 32 bit lane (I in the low half, Q in the high half);
+// |x| is treated as unsigned 16 bit so that |-32768| = 32768
+__attribute__((target("sse2")))
+static void max_abs_iq_sse2(const short (*in)[2], size_t count, int threshold,
+                            int& max_iq, int& above_threshold)
+{
+    // SSE2 has no unsigned 16 bit max; flip the sign bit and use the signed one
+    const auto bias = _mm_set1_epi16(static_cast<short>(0x8000));
+    const auto low_half = _mm_set1_epi32(0xffff);
+    const auto thr = _mm_set1_epi32(threshold);
+    auto vmax = bias;
+    auto above = _mm_setzero_si128();
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + k));
+        auto sign = _mm_srai_epi16(x, 15);
+        auto a = _mm_xor_si128(_mm_sub_epi16(_mm_xor_si128(x, sign), sign), bias);
+        auto m = _mm_xor_si128(_mm_max_epi16(a, _mm_xor_si128(_mm_srli_epi32(_mm_xor_si128(a, bias), 16), bias)), bias);
+        vmax = _mm_max_epi16(vmax, _mm_xor_si128(m, bias));
+        above = _mm_sub_epi32(above, _mm_cmpgt_epi32(_mm_and_si128(m, low_half), thr));
+    }
+    alignas(16) unsigned short vmax_lanes[8];
+    alignas(16) int above_lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(vmax_lanes), _mm_xor_si128(vmax, bias));
+    _mm_store_si128(reinterpret_cast<__m128i *>(above_lanes), above);
+    max_abs_iq_scalar(in + k, count - k, threshold, max_iq, above_threshold);
+    for (auto lane : vmax_lanes)
+        max_iq = std::max(max_iq, static_cast<int>(lane));
+    for (auto lane : above_lanes)
+        above_threshold += lane;
+}
+
+__attribute__((target("avx2")))
+static void max_abs_iq_avx2(const short (*in)[2], size_t count, int threshold,
+                            int& max_iq, int& above_threshold)
+{
+    const auto low_half = _mm256_set1_epi32(0xffff);
+    const auto thr = _mm256_set1_epi32(threshold);
+    auto vmax = _mm256_setzero_si256();
+    auto above = _mm256_setzero_si256();
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + k));
+        auto a = _mm256_abs_epi16(x);
+        auto m = _mm256_max_epu16(a, _mm256_srli_epi32(a, 16));
+        vmax = _mm256_max_epu16(vmax, m);
+        above = _mm256_sub_epi32(above, _mm256_cmpgt_epi32(_mm256_and_si256(m, low_half), thr));
+    }
+    alignas(32) unsigned short vmax_lanes[16];
+    alignas(32) int above_lanes[8];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(vmax_lanes), vmax);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(above_lanes), above);
+    max_abs_iq_scalar(in + k, count - k, threshold, max_iq, above_threshold);
+    for (auto lane : vmax_lanes)
+        max_iq = std::max(max_iq, static_cast<int>(lane));
+    for (auto lane : above_lanes)
+        above_threshold += lane;
+}
+
+__attribute__((target("sse2")))
+static void fir_iq_sse2(const float *xi, const float *xq, const float *h,
+                        size_t ntaps, float& yi, float& yq)
+{
+    auto si = _mm_setzero_ps();
+    auto sq = _mm_setzero_ps();
+    size_t k = 0;
+    for (; k + 4 <= ntaps; k += 4) {
+        auto c = _mm_loadu_ps(h + k);
+        si = _mm_add_ps(si, _mm_mul_ps(c, _mm_loadu_ps(xi + k)));
+        sq = _mm_add_ps(sq, _mm_mul_ps(c, _mm_loadu_ps(xq + k)));
+    }
+    alignas(16) float si_lanes[4];
+    alignas(16) float sq_lanes[4];
+    _mm_store_ps(si_lanes, si);
+    _mm_store_ps(sq_lanes, sq);
+    fir_iq_scalar(xi + k, xq + k, h + k, ntaps - k, yi, yq);
+    for (int j = 0; j < 4; j++) {
+        yi += si_lanes[j];
+        yq += sq_lanes[j];
+    }
+}
+
+__attribute__((target("avx2")))
+static void fir_iq_avx2(const float *xi, const float *xq, const float *h,
+                        size_t ntaps, float& yi, float& yq)
+{
+    auto si = _mm256_setzero_ps();
+    auto sq = _mm256_setzero_ps();
+    size_t k = 0;
+    for (; k + 8 <= ntaps; k += 8) {
+        auto c = _mm256_loadu_ps(h + k);
+        si = _mm256_add_ps(si, _mm256_mul_ps(c, _mm256_loadu_ps(xi + k)));
+        sq = _mm256_add_ps(sq, _mm256_mul_ps(c, _mm256_loadu_ps(xq + k)));
+    }
+    alignas(32) float si_lanes[8];
+    alignas(32) float sq_lanes[8];
+    _mm256_store_ps(si_lanes, si);
+    _mm256_store_ps(sq_lanes, sq);
+    fir_iq_scalar(xi + k, xq + k, h + k, ntaps - k, yi, yq);
+    for (int j = 0; j < 8; j++) {
+        yi += si_lanes[j];
+        yq += sq_lanes[j];
+    }
+}
+
+__attribute__((target("avx512f")))
+static void fir_iq_avx512(const float *xi, const float *xq, const float *h,
+                          size_t ntaps, float& yi, float& yq)
+{
+    auto si = _mm512_setzero_ps();
+    auto sq = _mm512_setzero_ps();
+    size_t k = 0;
+    for (; k + 16 <= ntaps; k += 16) {
+        auto c = _mm512_loadu_ps(h + k);
+        si = _mm512_fmadd_ps(c, _mm512_loadu_ps(xi + k), si);
+        sq = _mm512_fmadd_ps(c, _mm512_loadu_ps(xq + k), sq);
+    }
+    // _mm512_reduce_add_ps() trips -Wuninitialized in the GCC 12 headers
+    alignas(64) float si_lanes[16];
+    alignas(64) float sq_lanes[16];
+    _mm512_store_ps(si_lanes, si);
+    _mm512_store_ps(sq_lanes, sq);
+    fir_iq_scalar(xi + k, xq + k, h + k, ntaps - k, yi, yq);
+    for (int j = 0; j < 16; j++) {
+        yi += si_lanes[j];
+        yq += sq_lanes[j];
+    }
+}
+
+// one madd with [16384, 0] gives I, one with [c2, c1] gives Q for each
+// frame; packs + unpack put the saturated results back in I/Q order
+__attribute__((target("sse2")))
+static void iq_correct_sse2(short (*out)[2], const short (*in)[2], size_t count,
+                            int c1, int c2, int offset_i, int offset_q)
+{
+    const auto ci = _mm_set1_epi32(16384);
+    const auto cq = _mm_set1_epi32((c1 << 16) | (c2 & 0xffff));
+    const auto oi = _mm_set1_epi32(offset_i);
+    const auto oq = _mm_set1_epi32(offset_q);
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + k));
+        auto i = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(x, ci), oi), 14);
+        auto q = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(x, cq), oq), 14);
+        auto iq = _mm_packs_epi32(i, q);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + k),
+                         _mm_unpacklo_epi16(iq, _mm_srli_si128(iq, 8)));
+    }
+    iq_correct_scalar(out + k, in + k, count - k, c1, c2, offset_i, offset_q);
+}
+
+__attribute__((target("avx2")))
+static void iq_correct_avx2(short (*out)[2], const short (*in)[2], size_t count,
+                            int c1, int c2, int offset_i, int offset_q)
+{
+    const auto ci = _mm256_set1_epi32(16384);
+    const auto cq = _mm256_set1_epi32((c1 << 16) | (c2 & 0xffff));
+    const auto oi = _mm256_set1_epi32(offset_i);
+    const auto oq = _mm256_set1_epi32(offset_q);
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + k));
+        auto i = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(x, ci), oi), 14);
+        auto q = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(x, cq), oq), 14);
+        // packs and unpack both stay within each 128 bit lane, so the
+        // frames come out in order
+        auto iq = _mm256_packs_epi32(i, q);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + k),
+                            _mm256_unpacklo_epi16(iq, _mm256_srli_si256(iq, 8)));
+    }
+    iq_correct_sse2(out + k, in + k, count - k, c1, c2, offset_i, offset_q);
+}
+
+// complex multiply of interleaved [re, im] floats:
+// [a.re * b.re - a.im * b.im, a.im * b.re + a.re * b.im]
+__attribute__((target("sse2")))
+static inline __m128 cmul_sse2(__m128 a, __m128 b)
+{
+    const auto sign = _mm_castsi128_ps(_mm_set_epi32(0, 0x80000000, 0, 0x80000000));
+    auto b_re = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 0, 0));
+    auto b_im = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 1, 1));
+    auto a_swap = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_add_ps(_mm_mul_ps(a, b_re), _mm_xor_ps(_mm_mul_ps(a_swap, b_im), sign));
+}
+
+__attribute__((target("sse2")))
+static inline __m128 renormalize_sse2(__m128 p)
+{
+    auto p2 = _mm_mul_ps(p, p);
+    auto norm = _mm_add_ps(p2, _mm_shuffle_ps(p2, p2, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_mul_ps(p, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(_mm_set1_ps(0.5f), norm)));
+}
+
+__attribute__((target("sse2")))
+static void nco_mix_sse2(short (*out)[2], const short (*in)[2], size_t count,
+                         double phase, double increment)
+{
+    // frames 0-1 and 2-3 of each group of 4
+    alignas(16) float p[8];
+    for (int j = 0; j < 4; j++) {
+        p[2 * j] = cos(phase + j * increment);
+        p[2 * j + 1] = sin(phase + j * increment);
+    }
+    auto p01 = _mm_load_ps(p);
+    auto p23 = _mm_load_ps(p + 4);
+    const float r = cos(4 * increment);
+    const float s = sin(4 * increment);
+    const auto rotation = _mm_setr_ps(r, s, r, s);
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + k));
+        auto x01 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+        auto x23 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+        auto y01 = _mm_cvtps_epi32(cmul_sse2(x01, p01));
+        auto y23 = _mm_cvtps_epi32(cmul_sse2(x23, p23));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + k), _mm_packs_epi32(y01, y23));
+        p01 = renormalize_sse2(cmul_sse2(p01, rotation));
+        p23 = renormalize_sse2(cmul_sse2(p23, rotation));
+    }
+    nco_mix_scalar(out + k, in + k, count - k, phase + k * increment, increment);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 cmul_avx2(__m256 a, __m256 b)
+{
+    auto b_re = _mm256_moveldup_ps(b);
+    auto b_im = _mm256_movehdup_ps(b);
+    auto a_swap = _mm256_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm256_addsub_ps(_mm256_mul_ps(a, b_re), _mm256_mul_ps(a_swap, b_im));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 renormalize_avx2(__m256 p)
+{
+    auto p2 = _mm256_mul_ps(p, p);
+    auto norm = _mm256_add_ps(p2, _mm256_permute_ps(p2, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm256_mul_ps(p, _mm256_sub_ps(_mm256_set1_ps(1.5f), _mm256_mul_ps(_mm256_set1_ps(0.5f), norm)));
+}
+
+__attribute__((target("avx2")))
+static void nco_mix_avx2(short (*out)[2], const short (*in)[2], size_t count,
+                         double phase, double increment)
+{
+    // frames 0-3 and 4-7 of each group of 8
+    alignas(32) float p[16];
+    for (int j = 0; j < 8; j++) {
+        p[2 * j] = cos(phase + j * increment);
+        p[2 * j + 1] = sin(phase + j * increment);
+    }
+    auto p0 = _mm256_load_ps(p);
+    auto p1 = _mm256_load_ps(p + 8);
+    const float r = cos(8 * increment);
+    const float s = sin(8 * increment);
+    const auto rotation = _mm256_setr_ps(r, s, r, s, r, s, r, s);
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + k));
+        auto x0 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(x)));
+        auto x1 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1)));
+        auto y0 = _mm256_cvtps_epi32(cmul_avx2(x0, p0));
+        auto y1 = _mm256_cvtps_epi32(cmul_avx2(x1, p1));
+        // packs works within each 128 bit lane; put the frames back in order
+        auto y = _mm256_permute4x64_epi64(_mm256_packs_epi32(y0, y1), 0xd8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + k), y);
+        p0 = renormalize_avx2(cmul_avx2(p0, rotation));
+        p1 = renormalize_avx2(cmul_avx2(p1, rotation));
+    }
+    nco_mix_sse2(out + k, in + k, count - k, phase + k * increment, increment);
+}
+
+// the butterflies of one group are independent, so the vectors run across them
+__attribute__((target("sse2")))
+static void fft_pass_sse2(float *re, float *im, const float *wr, const float *wi,
+                          size_t n, size_t half)
+{
+    if (half % 4 != 0) {
+        fft_pass_scalar(re, im, wr, wi, n, half);
+        return;
+    }
+    for (size_t start = 0; start < n; start += 2 * half) {
+        float *ar = re + start;
+        float *ai = im + start;
+        float *br = ar + half;
+        float *bi = ai + half;
+        for (size_t k = 0; k < half; k += 4) {
+            auto xr = _mm_loadu_ps(br + k);
+            auto xi = _mm_loadu_ps(bi + k);
+            auto cr = _mm_loadu_ps(wr + k);
+            auto ci = _mm_loadu_ps(wi + k);
+            auto tr = _mm_sub_ps(_mm_mul_ps(xr, cr), _mm_mul_ps(xi, ci));
+            auto ti = _mm_add_ps(_mm_mul_ps(xr, ci), _mm_mul_ps(xi, cr));
+            auto yr = _mm_loadu_ps(ar + k);
+            auto yi = _mm_loadu_ps(ai + k);
+            _mm_storeu_ps(br + k, _mm_sub_ps(yr, tr));
+            _mm_storeu_ps(bi + k, _mm_sub_ps(yi, ti));
+            _mm_storeu_ps(ar + k, _mm_add_ps(yr, tr));
+            _mm_storeu_ps(ai + k, _mm_add_ps(yi, ti));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void fft_pass_avx2(float *re, float *im, const float *wr, const float *wi,
+                          size_t n, size_t half)
+{
+    if (half % 8 != 0) {
+        fft_pass_sse2(re, im, wr, wi, n, half);
+        return;
+    }
+    for (size_t start = 0; start < n; start += 2 * half) {
+        float *ar = re + start;
+        float *ai = im + start;
+        float *br = ar + half;
+        float *bi = ai + half;
+        for (size_t k = 0; k < half; k += 8) {
+            auto xr = _mm256_loadu_ps(br + k);
+            auto xi = _mm256_loadu_ps(bi + k);
+            auto cr = _mm256_loadu_ps(wr + k);
+            auto ci = _mm256_loadu_ps(wi + k);
+            auto tr = _mm256_sub_ps(_mm256_mul_ps(xr, cr), _mm256_mul_ps(xi, ci));
+            auto ti = _mm256_add_ps(_mm256_mul_ps(xr, ci), _mm256_mul_ps(xi, cr));
+            auto yr = _mm256_loadu_ps(ar + k);
+            auto yi = _mm256_loadu_ps(ai + k);
+            _mm256_storeu_ps(br + k, _mm256_sub_ps(yr, tr));
+            _mm256_storeu_ps(bi + k, _mm256_sub_ps(yi, ti));
+            _mm256_storeu_ps(ar + k, _mm256_add_ps(yr, tr));
+            _mm256_storeu_ps(ai + k, _mm256_add_ps(yi, ti));
+        }
+    }
+}
+
+// the branches are independent, so the vectors run across them
+__attribute__((target("sse2")))
+static void polyphase_iq_sse2(const float *xi, const float *xq, const float *h,
+                              size_t m, size_t ntaps, float *yi, float *yq)
+{
+    if (m % 4 != 0) {
+        polyphase_iq_scalar(xi, xq, h, m, ntaps, yi, yq);
+        return;
+    }
+    for (size_t i = 0; i < m; i += 4) {
+        auto si = _mm_setzero_ps();
+        auto sq = _mm_setzero_ps();
+        for (size_t r = 0; r < ntaps; r++) {
+            auto c = _mm_loadu_ps(h + r * m + i);
+            si = _mm_add_ps(si, _mm_mul_ps(c, _mm_loadu_ps(xi + i - r * m)));
+            sq = _mm_add_ps(sq, _mm_mul_ps(c, _mm_loadu_ps(xq + i - r * m)));
+        }
+        _mm_storeu_ps(yi + i, si);
+        _mm_storeu_ps(yq + i, sq);
+    }
+}
+
+__attribute__((target("avx2")))
+static void polyphase_iq_avx2(const float *xi, const float *xq, const float *h,
+                              size_t m, size_t ntaps, float *yi, float *yq)
+{
+    if (m % 8 != 0) {
+        polyphase_iq_sse2(xi, xq, h, m, ntaps, yi, yq);
+        return;
+    }
+    for (size_t i = 0; i < m; i += 8) {
+        auto si = _mm256_setzero_ps();
+        auto sq = _mm256_setzero_ps();
+        for (size_t r = 0; r < ntaps; r++) {
+            auto c = _mm256_loadu_ps(h + r * m + i);
+            si = _mm256_add_ps(si, _mm256_mul_ps(c, _mm256_loadu_ps(xi + i - r * m)));
+            sq = _mm256_add_ps(sq, _mm256_mul_ps(c, _mm256_loadu_ps(xq + i - r * m)));
+        }
+        _mm256_storeu_ps(yi + i, si);
+        _mm256_storeu_ps(yq + i, sq);
+    }
+}
+
+// these compute several consecutive outputs at once, so all the loads
+// are contiguous and there is no horizontal sum
+__attribute__((target("sse2")))
+static void halfband_decimate_sse2(const float *even, const float *odd,
+                                   const float *h, size_t nh, float center,
+                                   float *out, size_t count)
+{
+    const auto c = _mm_set1_ps(center);
+    size_t n = 0;
+    for (; n + 4 <= count; n += 4) {
+        auto y = _mm_mul_ps(c, _mm_loadu_ps(odd + n + nh - 1));
+        for (size_t i = 0; i < nh; i++) {
+            auto pair = _mm_add_ps(_mm_loadu_ps(even + n + i),
+                                   _mm_loadu_ps(even + n + 2 * nh - 1 - i));
+            y = _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(h[i]), pair));
+        }
+        _mm_storeu_ps(out + n, y);
+    }
+    halfband_decimate_scalar(even + n, odd + n, h, nh, center, out + n, count - n);
+}
+
+__attribute__((target("avx2")))
+static void halfband_decimate_avx2(const float *even, const float *odd,
+                                   const float *h, size_t nh, float center,
+                                   float *out, size_t count)
+{
+    const auto c = _mm256_set1_ps(center);
+    size_t n = 0;
+    for (; n + 8 <= count; n += 8) {
+        auto y = _mm256_mul_ps(c, _mm256_loadu_ps(odd + n + nh - 1));
+        for (size_t i = 0; i < nh; i++) {
+            auto pair = _mm256_add_ps(_mm256_loadu_ps(even + n + i),
+                                      _mm256_loadu_ps(even + n + 2 * nh - 1 - i));
+            y = _mm256_add_ps(y, _mm256_mul_ps(_mm256_set1_ps(h[i]), pair));
+        }
+        _mm256_storeu_ps(out + n, y);
+    }
+    halfband_decimate_scalar(even + n, odd + n, h, nh, center, out + n, count - n);
+}
+
+__attribute__((target("avx512f")))
+static void halfband_decimate_avx512(const float *even, const float *odd,
+                                     const float *h, size_t nh, float center,
+                                     float *out, size_t count)
+{
+    const auto c = _mm512_set1_ps(center);
+    size_t n = 0;
+    for (; n + 16 <= count; n += 16) {
+        auto y = _mm512_mul_ps(c, _mm512_loadu_ps(odd + n + nh - 1));
+        for (size_t i = 0; i < nh; i++) {
+            auto pair = _mm512_add_ps(_mm512_loadu_ps(even + n + i),
+                                      _mm512_loadu_ps(even + n + 2 * nh - 1 - i));
+            y = _mm512_fmadd_ps(_mm512_set1_ps(h[i]), pair, y);
+        }
+        _mm512_storeu_ps(out + n, y);
+    }
+    halfband_decimate_scalar(even + n, odd + n, h, nh, center, out + n, count - n);
+}
+
+// SSE2 has no 16 -> 32 bit sign extension: unpack each word into the
+// high half of a lane and shift it back down
+__attribute__((target("sse2")))
+static void convert_f32_sse2(float *out, const short *in, size_t count, float scale)
+{
+    const auto s = _mm_set1_ps(scale);
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + k));
+        auto lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        auto hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(out + k, _mm_mul_ps(_mm_cvtepi32_ps(lo), s));
+        _mm_storeu_ps(out + k + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), s));
+    }
+    convert_f32_scalar(out + k, in + k, count - k, scale);
+}
+
+__attribute__((target("sse2")))
+static void convert_s32_sse2(int32_t *out, const short *in, size_t count,
+                             float scale, float min, float max)
+{
+    const auto s = _mm_set1_ps(scale);
+    const auto hi_limit = _mm_set1_ps(max);
+    const auto lo_limit = _mm_set1_ps(min);
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + k));
+        auto lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16)), s);
+        auto hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16)), s);
+        lo = _mm_min_ps(_mm_max_ps(lo, lo_limit), hi_limit);
+        hi = _mm_min_ps(_mm_max_ps(hi, lo_limit), hi_limit);
+        auto dst = reinterpret_cast<__m128i *>(out + k);
+        _mm_storeu_si128(dst, _mm_cvtps_epi32(lo));
+        _mm_storeu_si128(dst + 1, _mm_cvtps_epi32(hi));
+    }
+    convert_s32_scalar(out + k, in + k, count - k, scale, min, max);
+}
+
+__attribute__((target("avx2")))
+static void convert_f32_avx2(float *out, const short *in, size_t count, float scale)
+{
+    const auto s = _mm256_set1_ps(scale);
+    size_t k = 0;
+    for (; k + 16 <= count; k += 16) {
+        auto lo = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + k)));
+        auto hi = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + k + 8)));
+        _mm256_storeu_ps(out + k, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), s));
+        _mm256_storeu_ps(out + k + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), s));
+    }
+    convert_f32_sse2(out + k, in + k, count - k, scale);
+}
+
+__attribute__((target("avx2")))
+static void convert_s32_avx2(int32_t *out, const short *in, size_t count,
+                             float scale, float min, float max)
+{
+    const auto s = _mm256_set1_ps(scale);
+    const auto hi_limit = _mm256_set1_ps(max);
+    const auto lo_limit = _mm256_set1_ps(min);
+    size_t k = 0;
+    for (; k + 16 <= count; k += 16) {
+        auto lo = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + k)));
+        auto hi = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + k + 8)));
+        auto flo = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(lo), s), lo_limit), hi_limit);
+        auto fhi = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(hi), s), lo_limit), hi_limit);
+        auto dst = reinterpret_cast<__m256i *>(out + k);
+        _mm256_storeu_si256(dst, _mm256_cvtps_epi32(flo));
+        _mm256_storeu_si256(dst + 1, _mm256_cvtps_epi32(fhi));
+    }
+    convert_s32_sse2(out + k, in + k, count - k, scale, min, max);
+}
+
+// drop the top byte of each lane within each 128 bit half, then move the
+// two 12 byte halves next to each other
+__attribute__((target("avx2")))
+static void pack_s24_avx2(unsigned char *out, const int32_t *in, size_t count)
+{
+    const auto shuffle = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                          0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const auto compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + k));
+        auto y = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(x, shuffle), compact);
+        auto dst = out + 3 * k;
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm256_castsi256_si128(y));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + 16), _mm256_extracti128_si256(y, 1));
+    }
+    pack_s24_scalar(out + 3 * k, in + k, count - k);
+}
+#endif
+
+#ifdef SIMD_NEON
+static void interleave_neon(short (*out)[2], const short *xi,
+                            const short *xq, size_t count)
+{
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        int16x8x2_t iq = { vld1q_s16(xi + k), vld1q_s16(xq + k) };
+        vst2q_s16(&out[k][0], iq);
+    }
+    interleave_scalar(out + k, xi + k, xq + k, count - k);
+}
+
+static void max_abs_iq_neon(const short (*in)[2], size_t count, int threshold,
+                            int& max_iq, int& above_threshold)
+{
+    const auto low_half = vdupq_n_u32(0xffff);
+    const auto thr = vdupq_n_s32(threshold);
+    auto vmax = vdupq_n_u16(0);
+    auto above = vdupq_n_u32(0);
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        auto a = vreinterpretq_u16_s16(vabsq_s16(vld1q_s16(&in[k][0])));
+        auto m = vmaxq_u16(a, vrev32q_u16(a));
+        vmax = vmaxq_u16(vmax, m);
+        auto iq = vreinterpretq_s32_u32(vandq_u32(vreinterpretq_u32_u16(m), low_half));
+        above = vsubq_u32(above, vcgtq_s32(iq, thr));
+    }
+    unsigned short vmax_lanes[8];
+    unsigned int above_lanes[4];
+    vst1q_u16(vmax_lanes, vmax);
+    vst1q_u32(above_lanes, above);
+    max_abs_iq_scalar(in + k, count - k, threshold, max_iq, above_threshold);
+    for (auto lane : vmax_lanes)
+        max_iq = std::max(max_iq, static_cast<int>(lane));
+    for (auto lane : above_lanes)
+        above_threshold += lane;
+}
+
+static void fir_iq_neon(const float *xi, const float *xq, const float *h,
+                        size_t ntaps, float& yi, float& yq)
+{
+    auto si = vdupq_n_f32(0);
+    auto sq = vdupq_n_f32(0);
+    size_t k = 0;
+    for (; k + 4 <= ntaps; k += 4) {
+        auto c = vld1q_f32(h + k);
+        si = vmlaq_f32(si, c, vld1q_f32(xi + k));
+        sq = vmlaq_f32(sq, c, vld1q_f32(xq + k));
+    }
+    float si_lanes[4];
+    float sq_lanes[4];
+    vst1q_f32(si_lanes, si);
+    vst1q_f32(sq_lanes, sq);
+    fir_iq_scalar(xi + k, xq + k, h + k, ntaps - k, yi, yq);
+    for (int j = 0; j < 4; j++) {
+        yi += si_lanes[j];
+        yq += sq_lanes[j];
+    }
+}
+
+static void iq_correct_neon(short (*out)[2], const short (*in)[2], size_t count,
+                            int c1, int c2, int offset_i, int offset_q)
+{
+    const auto oi = vdupq_n_s32(offset_i);
+    const auto oq = vdupq_n_s32(offset_q);
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        auto x = vld2_s16(&in[k][0]);
+        auto i = vmlal_n_s16(oi, x.val[0], 16384);
+        auto q = vmlal_n_s16(vmlal_n_s16(oq, x.val[0], c2), x.val[1], c1);
+        int16x4x2_t y = { vqmovn_s32(vshrq_n_s32(i, 14)), vqmovn_s32(vshrq_n_s32(q, 14)) };
+        vst2_s16(&out[k][0], y);
+    }
+    iq_correct_scalar(out + k, in + k, count - k, c1, c2, offset_i, offset_q);
+}
+
+// vld2 deinterleaves, so the phasors are kept as separate cos/sin vectors
+static void nco_mix_neon(short (*out)[2], const short (*in)[2], size_t count,
+                         double phase, double increment)
+{
+    float c[4], s[4];
+    for (int j = 0; j < 4; j++) {
+        c[j] = cos(phase + j * increment);
+        s[j] = sin(phase + j * increment);
+    }
+    auto pc = vld1q_f32(c);
+    auto ps = vld1q_f32(s);
+    const float r = cos(4 * increment);
+    const float t = sin(4 * increment);
+    const auto sign = vdupq_n_u32(0x80000000);
+    const auto half = vdupq_n_f32(0.5f);
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        auto x = vld2_s16(&in[k][0]);
+        auto xi = vcvtq_f32_s32(vmovl_s16(x.val[0]));
+        auto xq = vcvtq_f32_s32(vmovl_s16(x.val[1]));
+        auto yi = vmlsq_f32(vmulq_f32(xi, pc), xq, ps);
+        auto yq = vmlaq_f32(vmulq_f32(xi, ps), xq, pc);
+        // round half away from zero (vcvtnq is ARMv8 only)
+        yi = vaddq_f32(yi, vbslq_f32(sign, yi, half));
+        yq = vaddq_f32(yq, vbslq_f32(sign, yq, half));
+        int16x4x2_t y = { vqmovn_s32(vcvtq_s32_f32(yi)), vqmovn_s32(vcvtq_s32_f32(yq)) };
+        vst2_s16(&out[k][0], y);
+        auto nc = vmlsq_n_f32(vmulq_n_f32(pc, r), ps, t);
+        ps = vmlaq_n_f32(vmulq_n_f32(ps, r), pc, t);
+        auto g = vmlsq_n_f32(vdupq_n_f32(1.5f), vmlaq_f32(vmulq_f32(nc, nc), ps, ps), 0.5f);
+        pc = vmulq_f32(nc, g);
+        ps = vmulq_f32(ps, g);
+    }
+    nco_mix_scalar(out + k, in + k, count - k, phase + k * increment, increment);
+}
+
+static void polyphase_iq_neon(const float *xi, const float *xq, const float *h,
+                              size_t m, size_t ntaps, float *yi, float *yq)
+{
+    if (m % 4 != 0) {
+        polyphase_iq_scalar(xi, xq, h, m, ntaps, yi, yq);
+        return;
+    }
+    for (size_t i = 0; i < m; i += 4) {
+        auto si = vdupq_n_f32(0);
+        auto sq = vdupq_n_f32(0);
+        for (size_t r = 0; r < ntaps; r++) {
+            auto c = vld1q_f32(h + r * m + i);
+            si = vmlaq_f32(si, c, vld1q_f32(xi + i - r * m));
+            sq = vmlaq_f32(sq, c, vld1q_f32(xq + i - r * m));
+        }
+        vst1q_f32(yi + i, si);
+        vst1q_f32(yq + i, sq);
+    }
+}
+
+static void fft_pass_neon(float *re, float *im, const float *wr, const float *wi,
+                          size_t n, size_t half)
+{
+    if (half % 4 != 0) {
+        fft_pass_scalar(re, im, wr, wi, n, half);
+        return;
+    }
+    for (size_t start = 0; start < n; start += 2 * half) {
+        float *ar = re + start;
+        float *ai = im + start;
+        float *br = ar + half;
+        float *bi = ai + half;
+        for (size_t k = 0; k < half; k += 4) {
+            auto xr = vld1q_f32(br + k);
+            auto xi = vld1q_f32(bi + k);
+            auto cr = vld1q_f32(wr + k);
+            auto ci = vld1q_f32(wi + k);
+            auto tr = vmlsq_f32(vmulq_f32(xr, cr), xi, ci);
+            auto ti = vmlaq_f32(vmulq_f32(xr, ci), xi, cr);
+            auto yr = vld1q_f32(ar + k);
+            auto yi = vld1q_f32(ai + k);
+            vst1q_f32(br + k, vsubq_f32(yr, tr));
+            vst1q_f32(bi + k, vsubq_f32(yi, ti));
+            vst1q_f32(ar + k, vaddq_f32(yr, tr));
+            vst1q_f32(ai + k, vaddq_f32(yi, ti));
+        }
+    }
+}
+
+static void halfband_decimate_neon(const float *even, const float *odd,
+                                   const float *h, size_t nh, float center,
+                                   float *out, size_t count)
+{
+    size_t n = 0;
+    for (; n + 4 <= count; n += 4) {
+        auto y = vmulq_n_f32(vld1q_f32(odd + n + nh - 1), center);
+        for (size_t i = 0; i < nh; i++) {
+            auto pair = vaddq_f32(vld1q_f32(even + n + i),
+                                  vld1q_f32(even + n + 2 * nh - 1 - i));
+            y = vmlaq_n_f32(y, pair, h[i]);
+        }
+        vst1q_f32(out + n, y);
+    }
+    halfband_decimate_scalar(even + n, odd + n, h, nh, center, out + n, count - n);
+}
+
+static void convert_f32_neon(float *out, const short *in, size_t count, float scale)
+{
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        auto x = vld1q_s16(in + k);
+        vst1q_f32(out + k, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), scale));
+        vst1q_f32(out + k + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), scale));
+    }
+    convert_f32_scalar(out + k, in + k, count - k, scale);
+}
+
+static void convert_s32_neon(int32_t *out, const short *in, size_t count,
+                             float scale, float min, float max)
+{
+    const auto hi_limit = vdupq_n_f32(max);
+    const auto lo_limit = vdupq_n_f32(min);
+    const auto sign = vdupq_n_u32(0x80000000);
+    const auto half = vdupq_n_f32(0.5f);
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        auto x = vld1q_s16(in + k);
+        auto lo = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), scale);
+        auto hi = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), scale);
+        lo = vminq_f32(vmaxq_f32(lo, lo_limit), hi_limit);
+        hi = vminq_f32(vmaxq_f32(hi, lo_limit), hi_limit);
+        // round half away from zero (vcvtnq is ARMv8 only)
+        lo = vaddq_f32(lo, vbslq_f32(sign, lo, half));
+        hi = vaddq_f32(hi, vbslq_f32(sign, hi, half));
+        vst1q_s32(out + k, vcvtq_s32_f32(lo));
+        vst1q_s32(out + k + 4, vcvtq_s32_f32(hi));
+    }
+    convert_s32_scalar(out + k, in + k, count - k, scale, min, max);
+}
+
+// vld4 splits the (little endian) lanes into byte planes; vst3 writes
+// back all but the top one
+static void pack_s24_neon(unsigned char *out, const int32_t *in, size_t count)
+{
+    size_t k = 0;
+    for (; k + 16 <= count; k += 16) {
+        auto x = vld4q_u8(reinterpret_cast<const uint8_t *>(in + k));
+        uint8x16x3_t y = { x.val[0], x.val[1], x.val[2] };
+        vst3q_u8(out + 3 * k, y);
+    }
+    pack_s24_scalar(out + 3 * k, in + k, count - k);
+}
+#endif
+
+
+// run time dispatch
+enum SimdIsa { ISA_SCALAR, ISA_SSE2, ISA_AVX2, ISA_AVX512, ISA_NEON };
+
+static SimdIsa detect_isa()
+{
+#if defined(SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return ISA_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return ISA_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return ISA_SSE2;
+#elif defined(SIMD_NEON)
+    return ISA_NEON;
+#endif
+    return ISA_SCALAR;
+}
+
+static const SimdIsa isa = detect_isa();
+
+typedef void (*interleave_fn)(short (*)[2], const short *, const short *, size_t);
+
+static interleave_fn select_interleave()
+{
+    switch (isa) {
+#if defined(SIMD_X86)
+        case ISA_AVX512: return interleave_avx512;
+        case ISA_AVX2:   return interleave_avx2;
+        case ISA_SSE2:   return interleave_sse2;
+#elif defined(SIMD_NEON)
+        case ISA_NEON:   return interleave_neon;
+#endif
+        default:         return interleave_scalar;
+    }
+}
+
+static const interleave_fn interleave_impl = select_interleave();
+
+void interleave(short (*out)[2], const short *xi, const short *xq, size_t count)
+{
+    interleave_impl(out, xi, xq, count);
+}
+
+typedef void (*max_abs_iq_fn)(const short (*)[2], size_t, int, int&, int&);
+
+static max_abs_iq_fn select_max_abs_iq()
+{
+    switch (isa) {
+#if defined(SIMD_X86)
+        case ISA_AVX512:
+        case ISA_AVX2:   return max_abs_iq_avx2;
+        case ISA_SSE2:   return max_abs_iq_sse2;
+#elif defined(SIMD_NEON)
+        case ISA_NEON:   return max_abs_iq_neon;
+#endif
+        default:         return max_abs_iq_scalar;
+    }
+}
+
+static const max_abs_iq_fn max_abs_iq_impl = select_max_abs_iq();
+
+void max_abs_iq(const short (*in)[2], size_t count, int threshold,
+                int& max_iq, int& above_threshold)
+{
+    max_abs_iq_impl(in, count, threshold, max_iq, above_threshold);
+}
+
+typedef void (*fir_iq_fn)(const float *, const float *, const float *, size_t, float&, float&);
+
+static fir_iq_fn select_fir_iq()
+{
+    switch (isa) {
+#if defined(SIMD_X86)
+        case ISA_AVX512: return fir_iq_avx512;
+        case ISA_AVX2:   return fir_iq_avx2;
+        case ISA_SSE2:   return fir_iq_sse2;
+#elif defined(SIMD_NEON)
+        case ISA_NEON:   return fir_iq_neon;
+#endif
+        default:         return fir_iq_scalar;
+    }
+}
+
+static const fir_iq_fn fir_iq_impl = select_fir_iq();
+
+void fir_iq(const float *xi, const float *xq, const float *h, size_t ntaps,
+            float& yi, float& yq)
+{
+    fir_iq_impl(xi, xq, h, ntaps, yi, yq);
+}
+
+typedef void (*halfband_decimate_fn)(const float *, const float *, const float *, size_t, float, float *, size_t);
+
+static halfband_decimate_fn select_halfband_decimate()
+{
+    switch (isa) {
+#if defined(SIMD_X86)
+        case ISA_AVX512: return halfband_decimate_avx512;
+        case ISA_AVX2:   return halfband_decimate_avx2;
+        case ISA_SSE2:   return halfband_decimate_sse2;
+#elif defined(SIMD_NEON)
+        case ISA_NEON:   return halfband_decimate_neon;
+#endif
+        default:         return halfband_decimate_scalar;
+    }
+}
+
+static const halfband_decimate_fn halfband_decimate_impl = select_halfband_decimate();
+
+void halfband_decimate(const float *even, const float *odd, const float *h,
+                       size_t nh, float center, float *out, size_t count)
+{
+    halfband_decimate_impl(even, odd, h, nh, center, out, count);
+}
+
+typedef void (*iq_correct_fn)(short (*)[2], const short (*)[2], size_t, int, int, int, int);
+
+static iq_correct_fn select_iq_correct()
+{
+    switch (isa) {
+#if defined(SIMD_X86)
+        case ISA_AVX512:
+        case ISA_AVX2:   return iq_correct_avx2;
+        case ISA_SSE2:   return iq_correct_sse2;
+#elif defined(SIMD_NEON)
+        case ISA_NEON:   return iq_correct_neon;
+#endif
+        default:         return iq_correct_scalar;
+    }
+}
+
+static const iq_correct_fn iq_correct_impl = select_iq_correct();
+
+void iq_correct(short (*out)[2], const short (*in)[2], size_t count,
+                int c1, int c2, int offset_i, int offset_q)
+{
+    iq_correct_impl(out, in, count, c1, c2, offset_i, offset_q);
+}
+
+typedef void (*nco_mix_fn)(short (*)[2], const short (*)[2], size_t, double, double);
+
+static nco_mix_fn select_nco_mix()
+{
+    switch (isa) {
+#if defined(SIMD_X86)
+        case ISA_AVX512:
+        case ISA_AVX2:   return nco_mix_avx2;
+        case ISA_SSE2:   return nco_mix_sse2;
+#elif defined(SIMD_NEON)
+        case ISA_NEON:   return nco_mix_neon;
+#endif
+        default:         return nco_mix_scalar;
+    }
+}
+
+static const nco_mix_fn nco_mix_impl = select_nco_mix();
+
+void nco_mix(short (*out)[2], const short (*in)[2], size_t count,
+             double& phase, double increment)
+{
+    nco_mix_impl(out, in, count, phase, increment);
+    phase = std::remainder(phase + count * increment, 2 * M_PI);
+}
+
+typedef void (*polyphase_iq_fn)(const float *, const float *, const float *, size_t, size_t, float *, float *);
+
+static polyphase_iq_fn select_polyphase_iq()
+{
+    switch (isa) {
+#if defined(SIMD_X86)
+        case ISA_AVX512:
+        case ISA_AVX2:   return polyphase_iq_avx2;
+        case ISA_SSE2:   return polyphase_iq_sse2;
+#elif defined(SIMD_NEON)
+        case ISA_NEON:   return polyphase_iq_neon;
+#endif
+        default:         return polyphase_iq_scalar;
+    }
+}
+
+static const polyphase_iq_fn polyphase_iq_impl = select_polyphase_iq();
+
+void polyphase_iq(const float *xi, const float *xq, const float *h,
+                  size_t m, size_t ntaps, float *yi, float *yq)
+{
+    polyphase_iq_impl(xi, xq, h, m, ntaps, yi, yq);
+}
+
+typedef void (*fft_pass_fn)(float *, float *, const float *, const float *, size_t, size_t);
+
+static fft_pass_fn select_fft_pass()
+{
+    switch (isa) {
+#if defined(SIMD_X86)
+        case ISA_AVX512:
+        case ISA_AVX2:   return fft_pass_avx2;
+        case ISA_SSE2:   return fft_pass_sse2;
+#elif defined(SIMD_NEON)
+        case ISA_NEON:   return fft_pass_neon;
+#endif
+        default:         return fft_pass_scalar;
+    }
+}
+
+static const fft_pass_fn fft_pass_impl = select_fft_pass();
+
+void fft_pass(float *re, float *im, const float *wr, const float *wi,
+              size_t n, size_t half)
+{
+    fft_pass_impl(re, im, wr, wi, n, half);
+}
+
+typedef void (*convert_f32_fn)(float *, const short *, size_t, float);
+
+static convert_f32_fn select_convert_f32()
+{
+    switch (isa) {
+#if defined(SIMD_X86)
+        case ISA_AVX512:
+        case ISA_AVX2:   return convert_f32_avx2;
+        case ISA_SSE2:   return convert_f32_sse2;
+#elif defined(SIMD_NEON)
+        case ISA_NEON:   return convert_f32_neon;
+#endif
+        default:         return convert_f32_scalar;
+    }
+}
+
+static const convert_f32_fn convert_f32_impl = select_convert_f32();
+
+void convert_f32(float *out, const short *in, size_t count, float scale)
+{
+    convert_f32_impl(out, in, count, scale);
+}
+
+typedef void (*convert_s32_fn)(int32_t *, const short *, size_t, float, float, float);
+
+static convert_s32_fn select_convert_s32()
+{
+    switch (isa) {
+#if defined(SIMD_X86)
+        case ISA_AVX512:
+        case ISA_AVX2:   return convert_s32_avx2;
+        case ISA_SSE2:   return convert_s32_sse2;
+#elif defined(SIMD_NEON)
+        case ISA_NEON:   return convert_s32_neon;
+#endif
+        default:         return convert_s32_scalar;
+    }
+}
+
+static const convert_s32_fn convert_s32_impl = select_convert_s32();
+
+void convert_s32(int32_t *out, const short *in, size_t count, float scale, float min, float max)
+{
+    convert_s32_impl(out, in, count, scale, min, max);
+}
+
+typedef void (*pack_s24_fn)(unsigned char *, const int32_t *, size_t);
+
+static pack_s24_fn select_pack_s24()
+{
+    switch (isa) {
+#if defined(SIMD_X86)
+        case ISA_AVX512:
+        case ISA_AVX2:   return pack_s24_avx2;
+#elif defined(SIMD_NEON)
+        case ISA_NEON:   return pack_s24_neon;
+#endif
+        default:         return pack_s24_scalar;
+    }
+}
+
+static const pack_s24_fn pack_s24_impl = select_pack_s24();
+
+void pack_s24(unsigned char *out, const int32_t *in, size_t count)
+{
+    pack_s24_impl(out, in, count);
+}
+
+const char *simd_isa()
+{
+    switch (isa) {
+        case ISA_SSE2:   return "SSE2";
+        case ISA_AVX2:   return "AVX2";
+        case ISA_AVX512: return "AVX-512";
+        case ISA_NEON:   return "NEON";
+        default:         return "scalar";
+    }
+}
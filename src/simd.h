@@ -0,0 +1,69 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_SIMD_H
+#define INCLUDED_RSP_SND_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+// vectorized kernels for the streaming hot paths
+// the best implementation for the CPU is selected at run time
+
+// xi[], xq[] -> out[][2]
+void interleave(short (*out)[2], const short *xi, const short *xq, size_t count);
+
+// max(|I|, |Q|) over in[], and how many samples have max(|I|, |Q|) > threshold
+void max_abs_iq(const short (*in)[2], size_t count, int threshold,
+                int& max_iq, int& above_threshold);
+
+// FIR dot product on deinterleaved I/Q: yi = sum(h[k] * xi[k]), yq = sum(h[k] * xq[k])
+void fir_iq(const float *xi, const float *xq, const float *h, size_t ntaps,
+            float& yi, float& yq);
+
+// half-band decimation by 2, with the input split in even and odd samples
+// out[n] = center * odd[n + nh - 1] + sum(h[i] * (even[n + i] + even[n + 2 * nh - 1 - i]))
+// (only the non zero taps of one half of the symmetric filter are in h[])
+void halfband_decimate(const float *even, const float *odd, const float *h,
+                       size_t nh, float center, float *out, size_t count);
+
+// DC and I/Q imbalance correction in Q14 fixed point (saturated):
+// out[k][0] = (16384 * in[k][0] + offset_i) >> 14
+// out[k][1] = (c2 * in[k][0] + c1 * in[k][1] + offset_q) >> 14
+// |c1| + |c2| must be < 65536 and the offsets small enough not to overflow
+void iq_correct(short (*out)[2], const short (*in)[2], size_t count,
+                int c1, int c2, int offset_i, int offset_q);
+
+// frequency shift: out[k] = in[k] * exp(j * (phase + k * increment))
+// (rounded and saturated); phase is advanced by count * increment
+void nco_mix(short (*out)[2], const short (*in)[2], size_t count,
+             double& phase, double increment);
+
+// polyphase filter bank front end on deinterleaved I/Q, one output per branch:
+// yi[i] = sum(h[r * m + i] * xi[i - r * m]), r < ntaps (same for Q)
+void polyphase_iq(const float *xi, const float *xq, const float *h,
+                  size_t m, size_t ntaps, float *yi, float *yq);
+
+// one radix-2 pass of an in-place FFT on split real/imaginary arrays: for
+// each group of 2 * half points, a = x[k], b = x[k + half] * w[k],
+// x[k] = a + b, x[k + half] = a - b (k < half)
+void fft_pass(float *re, float *im, const float *wr, const float *wi,
+              size_t n, size_t half);
+
+// sample format conversions (count is in values, i.e. 2 per I/Q frame):
+// out[k] = in[k] * scale
+void convert_f32(float *out, const short *in, size_t count, float scale);
+// out[k] = in[k] * scale, limited to [min, max] and rounded (max must be
+// below 2^31 as a float)
+void convert_s32(int32_t *out, const short *in, size_t count, float scale, float min, float max);
+// low 3 bytes of each in[k], little endian
+void pack_s24(unsigned char *out, const int32_t *in, size_t count);
+
+// name of the instruction set selected at run time (for verbose output)
+const char *simd_isa();
+
+#endif /* INCLUDED_RSP_SND_SIMD_H */
@@ -5,13 +5,32 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#include "affinity.h"
 #include "ringbuffer.h"
 #include "snd.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 
 
+static snd_pcm_format_t get_pcm_format(SampleFormat format)
+{
+    switch (format) {
+        case SAMPLE_S24_3LE: return SND_PCM_FORMAT_S24_3LE;
+        case SAMPLE_S32:     return SND_PCM_FORMAT_S32_LE;
+        case SAMPLE_CF32:    return SND_PCM_FORMAT_FLOAT_LE;
+        default:             return SND_PCM_FORMAT_S16_LE;
+    }
+}
+
 Snd::Snd(const SndConfig& config, int verbose):
-    Out(verbose)
+    Out(verbose),
+    mmap_access(config.mmap),
+    overrun_policy(config.overrun_policy),
+    converter(config.format, config.scale)
 {
     auto err = snd_pcm_open(&pcm, config.name.c_str(), SND_PCM_STREAM_PLAYBACK, 0);
     if (err < 0) {
@@ -25,14 +44,50 @@ Snd::Snd(const SndConfig& config, int verbose):
         throw Snd::Exception("snd_pcm_nonblock() failed");
     }
 
-    err = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16_LE,
-                             SND_PCM_ACCESS_RW_INTERLEAVED, 2,
-                             config.sample_rate, 0, config.latency);
+    if (mmap_access) {
+        err = snd_pcm_set_params(pcm, get_pcm_format(config.format),
+                                 SND_PCM_ACCESS_MMAP_INTERLEAVED, 2,
+                                 config.sample_rate, 0, config.latency);
+        if (err < 0) {
+            std::cerr << "snd mmap access not supported (" << snd_strerror(err) << ") - using snd_pcm_writei()" << std::endl;
+            mmap_access = false;
+        }
+    }
+    if (!mmap_access)
+        err = snd_pcm_set_params(pcm, get_pcm_format(config.format),
+                                 SND_PCM_ACCESS_RW_INTERLEAVED, 2,
+                                 config.sample_rate, 0, config.latency);
     if (err < 0) {
         std::cerr << "snd_pcm_set_params() failed: " << snd_strerror(err) << std::endl;
         throw Snd::Exception("snd_pcm_set_params() failed");
     }
 
+    // the writer thread wakes up once per period
+    snd_pcm_uframes_t buffer_size;
+    err = snd_pcm_get_params(pcm, &buffer_size, &period_size);
+    if (err < 0) {
+        std::cerr << "snd_pcm_get_params() failed: " << snd_strerror(err) << std::endl;
+        throw Snd::Exception("snd_pcm_get_params() failed");
+    }
+    period_time_ms = static_cast<unsigned int>(ceil(1000.0 * period_size / config.sample_rate));
+    if (verbose >= 1)
+        std::cerr << "snd buffer_size: " << buffer_size << " - period_size: " << period_size << " - access: " << (mmap_access ? "mmap" : "writei") << std::endl;
+
+    // with mmap access the writer thread waits in poll() for room
+    if (mmap_access) {
+        auto count = snd_pcm_poll_descriptors_count(pcm);
+        if (count <= 0) {
+            std::cerr << "snd_pcm_poll_descriptors_count() failed: " << snd_strerror(count) << std::endl;
+            throw Snd::Exception("snd_pcm_poll_descriptors_count() failed");
+        }
+        poll_fds.resize(count);
+        err = snd_pcm_poll_descriptors(pcm, poll_fds.data(), count);
+        if (err < 0) {
+            std::cerr << "snd_pcm_poll_descriptors() failed: " << snd_strerror(err) << std::endl;
+            throw Snd::Exception("snd_pcm_poll_descriptors() failed");
+        }
+    }
+
     err = snd_pcm_prepare(pcm);
     if (err < 0) {
         std::cerr << "snd_pcm_prepare() failed: " << snd_strerror(err) << std::endl;
@@ -53,6 +108,7 @@ void Snd::start(RingBuffer<short[2]> *buffer)
 {
     run = true;
     thread = std::thread([this, buffer] { write_loop(buffer); });
+    pin_thread(thread, cpu, "snd sink", verbose);
 }
 
 void Snd::stop()
@@ -68,26 +124,132 @@ static constexpr int MAX_WRITEI_TRIES = 4;
 
 void Snd::write_loop(RingBuffer<short[2]> *buffer)
 {
-    auto read_ptr = buffer->next_read_ptr(nullptr);
+    auto reader = buffer->add_reader(overrun_policy);
+    buffer->set_watermark(reader, period_size, period_time_ms);
+    auto read_ptr = buffer->next_read_ptr(reader);
+    reader_id.store(reader, std::memory_order_release);
     while (run) {
-        auto max_read_size = buffer->next_read_max_size(read_ptr, true);
-        auto err = snd_pcm_writei(pcm, read_ptr, max_read_size);
+        auto max_read_size = buffer->next_read_max_size(reader, true);
+        // an overrun moves the read pointer
+        read_ptr = buffer->next_read_ptr(reader);
+        if (mmap_access) {
+            auto written = write_mmap(read_ptr, max_read_size);
+            read_ptr = buffer->next_read_ptr(reader, written);
+            continue;
+        }
+        auto data = converter.convert(read_ptr, max_read_size);
+        auto write_start = std::chrono::steady_clock::now();
+        auto err = snd_pcm_writei(pcm, data, max_read_size);
+        if (stats != nullptr)
+            stats->snd_write_latency.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - write_start).count());
         if (err == -EAGAIN) {
-            read_ptr = buffer->next_read_ptr(read_ptr, max_read_size);
+            read_ptr = buffer->next_read_ptr(reader, max_read_size);
             continue;
         }
         if (err != -EPIPE)
             std::cerr << "snd_pcm_writei() failed: " << snd_strerror(err) << std::endl;
+        else if (stats != nullptr)
+            stats->snd_xruns.add(1);
 
         err = snd_pcm_prepare(pcm);
         if (err < 0)
             std::cerr << "snd_pcm_prepare() failed: " << snd_strerror(err) << std::endl;
         // try again
         for (int i = 0; i < MAX_WRITEI_TRIES; i++) {
-            err = snd_pcm_writei(pcm, read_ptr, max_read_size);
+            err = snd_pcm_writei(pcm, data, max_read_size);
             if (err < 0)
                 std::cerr << " snd_pcm_writei() failed: " << snd_strerror(err) << std::endl;
         }
-        read_ptr = buffer->next_read_ptr(read_ptr, max_read_size);
+        read_ptr = buffer->next_read_ptr(reader, max_read_size);
+    }
+    reader_id.store(-1, std::memory_order_release);
+    buffer->remove_reader(reader);
+}
+
+// writes up to 'count' frames into the ALSA buffer (up to its end, where
+// it wraps); returns the number of frames written, 0 if none were
+size_t Snd::write_mmap(const short (*in)[2], size_t count)
+{
+    if (count == 0)
+        return 0;
+    auto avail = wait_avail(count);
+    if (avail <= 0)
+        return 0;
+
+    auto write_start = std::chrono::steady_clock::now();
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset;
+    snd_pcm_uframes_t frames = std::min(count, static_cast<size_t>(avail));
+    auto err = snd_pcm_mmap_begin(pcm, &areas, &offset, &frames);
+    if (err < 0) {
+        recover(err, "snd_pcm_mmap_begin()");
+        return 0;
+    }
+    // interleaved: both channels share the first area
+    auto out = static_cast<unsigned char *>(areas[0].addr) + areas[0].first / 8 + offset * (areas[0].step / 8);
+    converter.convert(out, in, frames);
+    auto committed = snd_pcm_mmap_commit(pcm, offset, frames);
+    if (stats != nullptr)
+        stats->snd_write_latency.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - write_start).count());
+    if (committed < 0 || static_cast<snd_pcm_uframes_t>(committed) != frames) {
+        recover(committed < 0 ? committed : -EPIPE, "snd_pcm_mmap_commit()");
+        return 0;
+    }
+    return frames;
+}
+
+// waits until there is room in the ALSA buffer for 'count' frames, or for
+// a period if 'count' is larger; returns the room in frames, or 0 when the
+// thread is stopping or the device could not be recovered
+static constexpr int SND_POLL_TIMEOUT_MS = 100;
+
+snd_pcm_sframes_t Snd::wait_avail(size_t count)
+{
+    auto min_avail = static_cast<snd_pcm_sframes_t>(std::min(count, static_cast<size_t>(period_size)));
+    while (run) {
+        auto avail = snd_pcm_avail_update(pcm);
+        if (avail < 0) {
+            if (recover(avail, "snd_pcm_avail_update()") < 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(period_time_ms));
+                return 0;
+            }
+            continue;
+        }
+        if (avail >= min_avail)
+            return avail;
+        // the buffer is full: start playing, as snd_pcm_writei() does
+        // when it reaches the start threshold
+        if (snd_pcm_state(pcm) == SND_PCM_STATE_PREPARED) {
+            auto err = snd_pcm_start(pcm);
+            if (err < 0)
+                recover(err, "snd_pcm_start()");
+            continue;
+        }
+        auto ready = poll(poll_fds.data(), poll_fds.size(), SND_POLL_TIMEOUT_MS);
+        if (ready < 0 && errno != EINTR) {
+            std::cerr << "snd poll() failed: " << strerror(errno) << std::endl;
+            return 0;
+        }
+        // an xrun or a suspend shows up in the next snd_pcm_avail_update()
+        if (ready > 0) {
+            unsigned short revents;
+            snd_pcm_poll_descriptors_revents(pcm, poll_fds.data(), poll_fds.size(), &revents);
+        }
     }
+    return 0;
+}
+
+// xruns (EPIPE) are counted, anything else is reported
+int Snd::recover(int err, const char *where)
+{
+    if (err == -EPIPE) {
+        if (stats != nullptr)
+            stats->snd_xruns.add(1);
+    } else {
+        std::cerr << where << " failed: " << snd_strerror(err) << std::endl;
+    }
+    err = snd_pcm_recover(pcm, err, 1);
+    if (err < 0)
+        std::cerr << "snd_pcm_recover() failed: " << snd_strerror(err) << std::endl;
+    return err;
 }
@@ -10,18 +10,31 @@
 
 #include "out.h"
 #include "ringbuffer.h"
+#include "sample_format.h"
 #include <alsa/asoundlib.h>
+#include <poll.h>
 #include <stdexcept>
 #include <string>
 #include <thread>
+#include <vector>
 
 class SndConfig {
 public:
     std::string name;
     double sample_rate;
     unsigned int latency;
+    OverrunPolicy overrun_policy;
+    SampleFormat format;
+    double scale;                   // applied to S24, S32 and CF32
+    bool mmap;                      // write straight into the ALSA buffer (mmap access)
 };
 
+// sound card output
+// with mmap access the samples are converted straight from the ring
+// buffer into the ALSA buffer (snd_pcm_mmap_begin()/snd_pcm_mmap_commit()),
+// and the writer thread sleeps in poll() on the PCM descriptors while the
+// ALSA buffer is full; otherwise they go through snd_pcm_writei(), which
+// copies them once more; devices without mmap access fall back to it
 class Snd: public Out {
 
 public:
@@ -39,8 +52,17 @@ public:
 
 private:
     void write_loop(RingBuffer<short[2]> *buffer);
+    size_t write_mmap(const short (*in)[2], size_t count);
+    snd_pcm_sframes_t wait_avail(size_t count);
+    int recover(int err, const char *where);
 
     snd_pcm_t *pcm;
+    bool mmap_access;
+    std::vector<struct pollfd> poll_fds;
+    snd_pcm_uframes_t period_size;
+    unsigned int period_time_ms;
+    OverrunPolicy overrun_policy;
+    SampleConverter converter;
     std::thread thread;
     bool run = false;
 };
@@ -0,0 +1,202 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "spectrum.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+// how long stop() may have to wait for a sleeping spectrum thread
+static constexpr auto SPECTRUM_MAX_SLEEP = std::chrono::milliseconds(100);
+static constexpr float FULL_SCALE = 32768;
+
+// the ring buffer watermark must stay below half the ring buffer size
+static constexpr unsigned int SPECTRUM_MAX_FFT_SIZE = 16384;
+
+static size_t align_frame(size_t bytes)
+{
+    return (bytes + alignof(SpectrumFrame) - 1) / alignof(SpectrumFrame) * alignof(SpectrumFrame);
+}
+
+Spectrum::Spectrum(const SpectrumConfig& config, double sample_rate,
+                   double center_frequency, int verbose):
+    name(config.name),
+    fft_size(config.fft_size),
+    averaging(config.averaging),
+    frame_rate(config.frame_rate),
+    verbose(verbose),
+    fft(config.fft_size),
+    window(config.fft_size),
+    re(config.fft_size),
+    im(config.fft_size),
+    power(config.fft_size),
+    page(nullptr),
+    page_size(0),
+    frames(0)
+{
+    if (fft_size > SPECTRUM_MAX_FFT_SIZE)
+        throw Spectrum::Exception("invalid spectrum FFT size");
+    if (averaging < 1)
+        throw Spectrum::Exception("invalid spectrum averaging");
+    if (frame_rate <= 0)
+        throw Spectrum::Exception("invalid spectrum frame rate");
+
+    // 4 term Blackman-Harris: -92dB sidelobes
+    double sum = 0;
+    for (unsigned int n = 0; n < fft_size; n++) {
+        double x = 2 * M_PI * n / fft_size;
+        window[n] = static_cast<float>(0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2 * x) - 0.01168 * cos(3 * x));
+        sum += window[n];
+    }
+    scale = static_cast<float>(1 / ((FULL_SCALE * sum) * (FULL_SCALE * sum)));
+
+    auto header_bytes = align_frame(sizeof(SpectrumPage));
+    auto frame_bytes = align_frame(sizeof(SpectrumFrame) + fft_size * sizeof(float));
+    page_size = header_bytes + 2 * frame_bytes;
+    auto fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw Spectrum::Exception("shm_open(spectrum_file) failed");
+    if (ftruncate(fd, page_size) < 0) {
+        close(fd);
+        throw Spectrum::Exception("ftruncate(spectrum_file) failed");
+    }
+    auto addr = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        throw Spectrum::Exception("mmap(spectrum_file) failed");
+    page = static_cast<SpectrumPage*>(addr);
+    page->version = SPECTRUM_VERSION;
+    page->size = page_size;
+    page->fft_size = fft_size;
+    page->sample_rate = sample_rate;
+    page->center_frequency = center_frequency;
+    page->averaging = averaging;
+    page->frame_rate = static_cast<float>(frame_rate);
+    page->frame_offset[0] = header_bytes;
+    page->frame_offset[1] = header_bytes + frame_bytes;
+    page->latest = 0;
+    // written last, so a reader never sees a valid magic with a bad header
+    std::atomic_thread_fence(std::memory_order_release);
+    page->magic = SPECTRUM_MAGIC;
+    if (verbose >= 1)
+        std::cerr << "spectrum " << name << " - " << fft_size << " points - " << averaging << " averages - " << frame_rate << " frames/s - size: " << page_size << " bytes" << std::endl;
+}
+
+Spectrum::~Spectrum()
+{
+    if (page != nullptr)
+        munmap(page, page_size);
+    shm_unlink(name.c_str());
+}
+
+
+// streaming
+void Spectrum::start(RingBuffer<short[2]> *buffer)
+{
+    run = true;
+    thread = std::thread([this, buffer] { spectrum_loop(buffer); });
+}
+
+void Spectrum::stop()
+{
+    if (run) {
+        run = false;
+        if (thread.joinable())
+            thread.join();
+    }
+    if (verbose >= 1)
+        std::cerr << "spectrum frames: " << frames << " - cpu time: " << cpu_time << "s" << std::endl;
+}
+
+void Spectrum::spectrum_loop(RingBuffer<short[2]> *buffer)
+{
+    auto reader = buffer->add_reader(OVERRUN_SKIP_TO_NEWEST);
+    buffer->set_watermark(reader, fft_size);
+    auto period = std::chrono::nanoseconds(static_cast<int64_t>(1e9 / frame_rate));
+    auto next_frame = std::chrono::steady_clock::now();
+    bool stopped = false;
+    while (run && !stopped) {
+        // jumping to the newest samples is not an overrun
+        auto read_ptr = buffer->reset_read_ptr(reader);
+        std::fill(power.begin(), power.end(), 0.0f);
+        unsigned int nffts = 0;
+        while (nffts < averaging) {
+            auto read_size = buffer->next_read_max_size(reader, true);
+            // an overrun moves the read pointer
+            read_ptr = buffer->next_read_ptr(reader);
+            if (read_size < fft_size) {
+                // only when the ring buffer has been stopped
+                stopped = true;
+                break;
+            }
+            for (; read_size >= fft_size && nffts < averaging; read_size -= fft_size, nffts++) {
+                accumulate(read_ptr);
+                read_ptr = buffer->next_read_ptr(reader, fft_size);
+            }
+        }
+        if (nffts > 0)
+            publish(nffts);
+
+        next_frame += period;
+        auto now = std::chrono::steady_clock::now();
+        if (next_frame < now)
+            next_frame = now;
+        while (run && now < next_frame) {
+            std::this_thread::sleep_until(std::min(next_frame, now + SPECTRUM_MAX_SLEEP));
+            now = std::chrono::steady_clock::now();
+        }
+    }
+    buffer->remove_reader(reader);
+
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        cpu_time = ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+void Spectrum::accumulate(const short (*in)[2])
+{
+    for (unsigned int n = 0; n < fft_size; n++) {
+        re[n] = window[n] * in[n][0];
+        im[n] = window[n] * in[n][1];
+    }
+    fft.forward(re.data(), im.data());
+    for (unsigned int k = 0; k < fft_size; k++)
+        power[k] += re[k] * re[k] + im[k] * im[k];
+}
+
+void Spectrum::publish(unsigned int nffts)
+{
+    auto base = reinterpret_cast<unsigned char *>(page);
+    auto index = 1 - page->latest.load(std::memory_order_relaxed);
+    auto frame = reinterpret_cast<SpectrumFrame *>(base + page->frame_offset[index]);
+    auto bins = reinterpret_cast<float *>(frame + 1);
+
+    auto seq = frame->seq.load(std::memory_order_relaxed);
+    frame->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // FFT bin k is at frequency k (k < N/2) or k - N; the frame starts at -N/2
+    auto half = fft_size / 2;
+    float frame_scale = scale / nffts;
+    for (unsigned int i = 0; i < fft_size; i++) {
+        auto p = power[(i + half) % fft_size] * frame_scale;
+        bins[i] = 10 * log10f(std::max(p, 1e-20f));
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    frame->frame_number = frames++;
+    frame->timestamp_ns = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+
+    frame->seq.store(seq + 2, std::memory_order_release);
+    page->latest.store(index, std::memory_order_release);
+}
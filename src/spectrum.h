@@ -0,0 +1,109 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_SPECTRUM_H
+#define INCLUDED_RSP_SND_SPECTRUM_H
+
+#include "fft.h"
+#include "ringbuffer.h"
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// power spectrum frames published in a shared memory segment
+// there are two frame buffers, each with its own sequence number (odd
+// while the frame is being written); the writer fills the buffer that
+// is not 'latest', then flips 'latest'. A reader:
+//   i = latest (acquire); s1 = frames[i].seq (acquire)
+//   copy the frame; acquire fence; s2 = frames[i].seq
+//   and retries if s1 is odd or s1 != s2 (only possible if the writer
+//   went through both buffers while the frame was being copied)
+
+static constexpr uint32_t SPECTRUM_MAGIC = 0x46505352;   // "RSPF"
+static constexpr uint32_t SPECTRUM_VERSION = 1;
+
+struct SpectrumPage {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                          // bytes in the segment
+    uint32_t fft_size;
+    double sample_rate;                     // Hz
+    double center_frequency;                // Hz (0 if unknown)
+    uint32_t averaging;                     // FFTs per frame
+    float frame_rate;                       // frames per second
+    uint32_t frame_offset[2];               // bytes from the start of the segment
+    std::atomic<uint32_t> latest;           // last complete frame buffer
+};
+
+// followed by fft_size floats: power in dBFS from -sample_rate/2 to
+// +sample_rate/2 (bin fft_size/2 is the center frequency)
+struct alignas(64) SpectrumFrame {
+    std::atomic<uint64_t> seq;
+    uint64_t frame_number;
+    int64_t timestamp_ns;                   // CLOCK_REALTIME at the end of the frame
+};
+
+class SpectrumConfig {
+public:
+    std::string name;                       // shared memory name ("" = off)
+    unsigned int fft_size;                  // power of 2
+    unsigned int averaging;                 // FFTs per frame
+    double frame_rate;                      // frames per second
+};
+
+// spectrum tap on the I/Q ring buffer
+// once per frame period it jumps to the newest samples, averages the power
+// of 'averaging' consecutive Blackman-Harris windowed FFTs, and publishes
+// the result; the samples in between are not looked at
+class Spectrum {
+
+public:
+    Spectrum(const SpectrumConfig& config, double sample_rate,
+             double center_frequency, int verbose = 0);
+    ~Spectrum();
+
+    // getters
+    double getCpuTime() const { return cpu_time; }  // s (after stop())
+
+    // streaming
+    void start(RingBuffer<short[2]> *buffer);
+    void stop();
+
+    class Exception: public std::runtime_error {
+    public:
+        Exception(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+private:
+    void spectrum_loop(RingBuffer<short[2]> *buffer);
+    void accumulate(const short (*in)[2]);
+    void publish(unsigned int nffts);
+
+    std::string name;
+    unsigned int fft_size;
+    unsigned int averaging;
+    double frame_rate;
+    int verbose;
+    Fft fft;
+    std::vector<float> window;
+    float scale;                            // 1 / (full scale * sum(window))^2
+    std::vector<float> re;
+    std::vector<float> im;
+    std::vector<float> power;               // accumulated |X|^2
+    SpectrumPage *page;
+    size_t page_size;
+    uint64_t frames;
+
+    std::thread thread;
+    bool run = false;
+    double cpu_time = 0;
+};
+
+#endif /* INCLUDED_RSP_SND_SPECTRUM_H */
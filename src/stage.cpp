@@ -0,0 +1,153 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "affinity.h"
+#include "stage.h"
+#include <algorithm>
+#include <ctime>
+#include <iostream>
+
+
+// wake up for at least this many samples, but don't sit on them too long
+static constexpr size_t STAGE_MIN_READ_SIZE = 1024;
+static constexpr unsigned int STAGE_MAX_WAIT_MS = 5;
+static constexpr size_t STAGE_MAX_CHUNK = 8192;
+
+// streaming
+void Stage::start(RingBuffer<short[2]> *input, RingBuffer<short[2]> *output)
+{
+    run = true;
+    total_input = 0;
+    total_output = 0;
+    this->output = output;
+    // a fused stage is driven by its upstream stage, which must be
+    // started after it
+    if (is_fused) {
+        open_metadata();
+        return;
+    }
+    thread = std::thread([this, input] { process_loop(input); });
+    pin_thread(thread, cpu, "stage", verbose);
+}
+
+void Stage::stop()
+{
+    if (run) {
+        run = false;
+        if (thread.joinable())
+            thread.join();
+    }
+    if (verbose >= 1)
+        std::cerr << "stage total input samples: " << total_input << " - output samples: " << total_output << " - cpu time: " << cpu_time << "s" << (is_fused ? " (fused)" : "") << std::endl;
+}
+
+void Stage::process_loop(RingBuffer<short[2]> *input)
+{
+    auto reader = input->add_reader(OVERRUN_RESYNC);
+    input->set_watermark(reader, STAGE_MIN_READ_SIZE, STAGE_MAX_WAIT_MS);
+    auto read_ptr = input->next_read_ptr(reader);
+    open_metadata();
+    uint64_t lost_samples = 0;
+    while (run) {
+        auto input_stopped = input->is_stopped();
+        auto max_read_size = input->next_read_max_size(reader, true);
+        // end of stream: the input is stopped and everything has been read
+        if (max_read_size == 0 && input_stopped)
+            break;
+        // an overrun moves the read pointer
+        read_ptr = input->next_read_ptr(reader);
+
+        // an overrun is a discontinuity for the filters too
+        auto lost = input->get_lost_samples(reader);
+        if (lost != lost_samples) {
+            reset();
+            lost_samples = lost;
+        }
+
+        size_t chunk = std::min(max_read_size, STAGE_MAX_CHUNK);
+        if (chunk == 0)
+            continue;
+        push(read_ptr, chunk, input->get_read_seq(reader));
+        read_ptr = input->next_read_ptr(reader, chunk);
+    }
+    close_output();
+    input->remove_reader(reader);
+
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        cpu_time = ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// process 'count' input frames starting at sequence number input_seq, and
+// hand each chunk of output to the fused stages
+void Stage::push(const short (*in)[2], size_t count, uint64_t input_seq)
+{
+    while (count > 0) {
+        // the output of one chunk must fit in the output ring buffer
+        size_t chunk = count;
+        while (chunk > 1 && max_output(chunk) > output->next_write_max_size() / 2)
+            chunk /= 2;
+
+        auto output_seq = output->get_write_seq();
+        auto write_ptr = output->next_write_ptr();
+        auto nout = process(in, chunk, write_ptr);
+        forward_metadata(input_seq, input_seq + chunk, output_seq, nout);
+        if (nout > 0) {
+            output->next_write_ptr(nout);
+            // nothing else writes to the output, so the samples stay put
+            for (auto stage : fused)
+                stage->push(write_ptr, nout, output_seq);
+        }
+        total_input += chunk;
+        total_output += nout;
+        in += chunk;
+        input_seq += chunk;
+        count -= chunk;
+    }
+}
+
+void Stage::open_metadata()
+{
+    if (input_metadata != nullptr && output_metadata != nullptr) {
+        metadata_reader = input_metadata->add_reader();
+        metadata_read_ptr = input_metadata->next_read_ptr(metadata_reader);
+    }
+}
+
+// end of stream for this stage and the stages fused onto it
+void Stage::close_output()
+{
+    if (metadata_reader >= 0) {
+        input_metadata->remove_reader(metadata_reader);
+        metadata_reader = -1;
+    }
+    for (auto stage : fused)
+        stage->close_output();
+    output->stop();
+}
+
+// only the position of the blocks is mapped to the output ring buffer;
+// their sample counts stay in input samples, so the checks on the hardware
+// sample numbers still hold downstream
+void Stage::forward_metadata(uint64_t input_seq, uint64_t input_end,
+                             uint64_t output_seq, size_t output_count)
+{
+    if (metadata_reader < 0)
+        return;
+    auto nblocks = input_metadata->next_read_max_size(metadata_reader);
+    // an overrun moves the read pointer
+    metadata_read_ptr = input_metadata->next_read_ptr(metadata_reader);
+    size_t k = 0;
+    for (; k < nblocks && metadata_read_ptr[k].seq < input_end; k++) {
+        auto block = metadata_read_ptr[k];
+        uint64_t offset = block.seq > input_seq ? block.seq - input_seq : 0;
+        block.seq = output_seq + offset * output_count / (input_end - input_seq);
+        *output_metadata->next_write_ptr() = block;
+        output_metadata->next_write_ptr(1);
+    }
+    metadata_read_ptr = input_metadata->next_read_ptr(metadata_reader, k);
+}
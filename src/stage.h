@@ -0,0 +1,84 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_STAGE_H
+#define INCLUDED_RSP_SND_STAGE_H
+
+#include "metadata.h"
+#include "ringbuffer.h"
+#include "stats.h"
+#include <thread>
+#include <vector>
+
+// processing stage between two ring buffers
+// a stage registers as a reader of its input ring buffer, runs its own
+// thread, and is the producer of its output ring buffer; block
+// descriptors are forwarded with their positions mapped to the output
+// a stage can also be fused onto its upstream stage: it then has no
+// thread and no reader, and processes each chunk of the upstream output
+// right after it has been written, while it is still in the cache
+class Stage {
+
+public:
+    Stage(int verbose = 0): verbose(verbose) {}
+    virtual ~Stage() {}
+
+    // setters
+    void setStats(StatsPage *stats) { this->stats = stats; }
+    void setMetadata(RingBuffer<BlockInfo> *input_metadata,
+                     RingBuffer<BlockInfo> *output_metadata)
+    {
+        this->input_metadata = input_metadata;
+        this->output_metadata = output_metadata;
+    }
+    void setCpu(int cpu) { this->cpu = cpu; }
+    // run 'stage' on this stage's thread (before start())
+    void addFused(Stage *stage) { fused.push_back(stage); stage->is_fused = true; }
+
+    // getters
+    virtual double getSamplerate() const = 0;    // output sample rate
+    double getCpuTime() const { return cpu_time; }  // s (after stop()), including the fused stages
+
+    // streaming
+    void start(RingBuffer<short[2]> *input, RingBuffer<short[2]> *output);
+    void stop();
+
+protected:
+    // process 'count' input frames; returns the number of output frames
+    // written to out[] (at most max_output(count))
+    virtual size_t process(const short (*in)[2], size_t count, short (*out)[2]) = 0;
+    virtual size_t max_output(size_t count) const = 0;
+    // forget the filter history (after a discontinuity)
+    virtual void reset() {}
+
+    int verbose;
+    StatsPage *stats = nullptr;
+    RingBuffer<BlockInfo> *input_metadata = nullptr;
+    RingBuffer<BlockInfo> *output_metadata = nullptr;
+
+private:
+    void process_loop(RingBuffer<short[2]> *input);
+    void push(const short (*in)[2], size_t count, uint64_t input_seq);
+    void open_metadata();
+    void close_output();
+    void forward_metadata(uint64_t input_seq, uint64_t input_end,
+                          uint64_t output_seq, size_t output_count);
+
+    std::thread thread;
+    bool run = false;
+    int cpu = -1;
+    bool is_fused = false;
+    std::vector<Stage *> fused;
+    RingBuffer<short[2]> *output = nullptr;
+    int metadata_reader = -1;
+    BlockInfo *metadata_read_ptr = nullptr;
+    uint64_t total_input = 0;
+    uint64_t total_output = 0;
+    double cpu_time = 0;
+};
+
+#endif /* INCLUDED_RSP_SND_STAGE_H */
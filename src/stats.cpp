@@ -0,0 +1,49 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "stats.h"
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+Stats::Stats(const std::string& name, int verbose):
+    page(nullptr),
+    name(name),
+    verbose(verbose)
+{
+    auto fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw Stats::Exception("shm_open(stats_file) failed");
+    // ftruncate() zero fills the segment, which resets all the counters
+    if (ftruncate(fd, sizeof(StatsPage)) < 0) {
+        close(fd);
+        throw Stats::Exception("ftruncate(stats_file) failed");
+    }
+    auto addr = mmap(NULL, sizeof(StatsPage), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        throw Stats::Exception("mmap(stats_file) failed");
+    page = static_cast<StatsPage*>(addr);
+    page->version = STATS_VERSION;
+    page->size = sizeof(StatsPage);
+    page->max_readers = STATS_MAX_READERS;
+    // written last, so a monitor never sees a valid magic with a bad header
+    std::atomic_thread_fence(std::memory_order_release);
+    page->magic = STATS_MAGIC;
+    if (verbose >= 1)
+        std::cerr << "stats page " << name << " - size: " << sizeof(StatsPage) << " bytes - version: " << STATS_VERSION << std::endl;
+}
+
+Stats::~Stats()
+{
+    if (page != nullptr)
+        munmap(page, sizeof(StatsPage));
+    shm_unlink(name.c_str());
+}
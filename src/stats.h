@@ -0,0 +1,111 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_STATS_H
+#define INCLUDED_RSP_SND_STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+// performance telemetry published in a shared memory segment
+// every field is a 64 bit atomic counter, so an external monitor can read
+// the page at any time without stopping the stream; some fields have more
+// than one writer (the output fields are shared by all the pipeline sinks,
+// and by the rotation thread of a file sink), so they are updated with
+// atomic read-modify-write operations
+
+static constexpr uint32_t STATS_MAGIC = 0x53505352;   // "RSPS"
+static constexpr uint32_t STATS_VERSION = 2;
+static constexpr int STATS_HISTOGRAM_BUCKETS = 64;
+static constexpr int STATS_MAX_READERS = 16;
+static constexpr int STATS_MAX_SINKS = 16;
+
+// log2 histogram: bucket 0 counts zeros, bucket i counts values
+// in [2^(i-1), 2^i)
+struct StatsHistogram {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+    std::atomic<uint64_t> buckets[STATS_HISTOGRAM_BUCKETS];
+
+    inline void add(uint64_t value) {
+        int bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+        if (bucket >= STATS_HISTOGRAM_BUCKETS)
+            bucket = STATS_HISTOGRAM_BUCKETS - 1;
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+        auto current = max.load(std::memory_order_relaxed);
+        while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+            ;
+        count.fetch_add(1, std::memory_order_release);
+    }
+};
+
+struct StatsCounter {
+    std::atomic<uint64_t> value;
+
+    inline void add(uint64_t n) {
+        value.fetch_add(n, std::memory_order_relaxed);
+    }
+};
+
+struct StatsPage {
+    // header
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                          // sizeof(StatsPage)
+    uint32_t max_readers;
+    double sample_rate;
+
+    // RSP stream callback
+    StatsHistogram callback_duration;       // ns
+    StatsHistogram callback_gap;            // ns between callbacks
+    StatsHistogram callback_samples;        // samples per callback
+    StatsCounter total_samples;
+    StatsCounter dropped_samples;           // not written to the ring buffer
+
+    // ring buffer readers
+    StatsHistogram ring_fill[STATS_MAX_READERS];    // samples
+    StatsCounter ring_overruns[STATS_MAX_READERS];
+    StatsCounter ring_lost_samples[STATS_MAX_READERS];
+
+    // outputs
+    StatsHistogram snd_write_latency;       // ns in snd_pcm_writei() or the mmap copy
+    StatsCounter snd_xruns;
+    StatsHistogram file_write_latency;      // ns in write()
+    StatsCounter file_write_errors;         // failed or incomplete writes
+
+    // pipeline sinks, in config order (version 2)
+    StatsHistogram sink_lag[STATS_MAX_SINKS];       // samples behind the writer
+    StatsCounter sink_overruns[STATS_MAX_SINKS];
+    StatsCounter sink_lost_samples[STATS_MAX_SINKS];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "the stats page requires lock-free 64 bit atomics");
+
+class Stats {
+
+public:
+    Stats(const std::string& name, int verbose = 0);
+    ~Stats();
+
+    StatsPage *page;
+
+    class Exception: public std::runtime_error {
+    public:
+        Exception(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+private:
+    std::string name;
+    int verbose;
+};
+
+#endif /* INCLUDED_RSP_SND_STATS_H */
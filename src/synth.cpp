@@ -0,0 +1,166 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "ringbuffer.h"
+#include "synth.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+
+static constexpr double MAX_SAMPLE_RATE = 10.66e6;
+static constexpr double FULL_SCALE = 32767.0;
+static constexpr unsigned int RENORMALIZE_INTERVAL = 1024;
+
+static inline double dbfs_to_amplitude(double dbfs)
+{
+    return FULL_SCALE * pow(10.0, dbfs / 20.0);
+}
+
+Synth::Synth(const SynthConfig& config, int verbose):
+    In(verbose),
+    buffer(nullptr),
+    sample_rate(config.sample_rate),
+    realtime(config.realtime),
+    block_size(config.block_size),
+    tone_amplitude(dbfs_to_amplitude(config.tone_level)),
+    noise_amplitude(dbfs_to_amplitude(config.noise_level)),
+    burst_amplitude(dbfs_to_amplitude(config.burst_level)),
+    burst_period(static_cast<uint64_t>(config.burst_period * config.sample_rate)),
+    burst_length(static_cast<uint64_t>(config.burst_length * config.sample_rate)),
+    reference_gRdB(config.gRdB),
+    gRdB(config.gRdB),
+    gain(1.0),
+    rng_state(0x9e3779b97f4a7c15ULL)
+{
+    if (sample_rate <= 0 || sample_rate > MAX_SAMPLE_RATE)
+        throw Synth::Exception("invalid sample rate");
+    if (block_size == 0)
+        throw Synth::Exception("invalid block size");
+    for (auto tone : config.tones) {
+        if (std::abs(tone) >= sample_rate / 2)
+            throw Synth::Exception("invalid tone frequency");
+        phasors.push_back(1.0);
+        rotators.push_back(std::polar(1.0, 2.0 * M_PI * tone / sample_rate));
+    }
+    if (verbose >= 1)
+        std::cerr << "synth source - sample rate: " << sample_rate << " - tones: " << phasors.size() << " - realtime: " << realtime << std::endl;
+}
+
+Synth::~Synth()
+{
+}
+
+
+// setters
+void Synth::setIFGainReduction(int gRdB, bool /* wait */)
+{
+    this->gRdB = gRdB;
+    gain.store(pow(10.0, (reference_gRdB - gRdB) / 20.0), std::memory_order_relaxed);
+}
+
+
+// getters
+double Synth::getSamplerate() const
+{
+    return sample_rate;
+}
+
+int Synth::getIFGainReduction() const
+{
+    return gRdB;
+}
+
+
+// streaming
+void Synth::start(RingBuffer<short[2]> *buffer)
+{
+    this->buffer = buffer;
+    total_samples = 0;
+    run = true;
+    thread = std::thread([this, buffer] { generate_loop(buffer); });
+}
+
+void Synth::stop()
+{
+    if (run) {
+        run = false;
+        if (thread.joinable())
+            thread.join();
+    }
+
+    if (buffer != nullptr)
+        buffer->stop();
+
+    if (verbose >= 1)
+        std::cerr << "synth source total_samples: " << total_samples << std::endl;
+}
+
+void Synth::generate_loop(RingBuffer<short[2]> *buffer)
+{
+    auto start_time = std::chrono::steady_clock::now();
+    auto write_ptr = buffer->next_write_ptr();
+    while (run) {
+        generate(write_ptr, block_size);
+        auto first_seq = buffer->get_write_seq();
+        write_ptr = buffer->next_write_ptr(block_size);
+        if (metadata != nullptr) {
+            auto block = metadata->next_write_ptr();
+            block->seq = first_seq;
+            block->timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            block->first_sample_num = static_cast<uint32_t>(total_samples);
+            block->num_samples = block_size;
+            block->dropped_samples = 0;
+            block->flags = 0;
+            metadata->next_write_ptr(1);
+        }
+        total_samples += block_size;
+        if (realtime) {
+            auto elapsed = std::chrono::nanoseconds(static_cast<int64_t>(1e9 * total_samples / sample_rate));
+            std::this_thread::sleep_until(start_time + elapsed);
+        }
+    }
+}
+
+// uniform noise in [-1, 1) - xorshift64*
+inline double Synth::noise()
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    auto r = rng_state * 0x2545f4914f6cdd1dULL;
+    return static_cast<int64_t>(r) * (1.0 / 9223372036854775808.0);
+}
+
+static inline short saturate(double x)
+{
+    return static_cast<short>(std::max(-32768.0, std::min(32767.0, std::round(x))));
+}
+
+void Synth::generate(short (*out)[2], unsigned int count)
+{
+    double gain = this->gain.load(std::memory_order_relaxed);
+    for (unsigned int k = 0; k < count; k++) {
+        std::complex<double> x = 0;
+        for (size_t t = 0; t < phasors.size(); t++) {
+            x += phasors[t];
+            phasors[t] *= rotators[t];
+        }
+        x *= tone_amplitude;
+        double noise_amp = noise_amplitude;
+        if (burst_period > 0 && (total_samples + k) % burst_period < burst_length)
+            noise_amp += burst_amplitude;
+        x += std::complex<double>(noise_amp * noise(), noise_amp * noise());
+        x *= gain;
+        out[k][0] = saturate(x.real());
+        out[k][1] = saturate(x.imag());
+    }
+    // keep the recursive oscillators on the unit circle
+    if ((total_samples / block_size) % RENORMALIZE_INTERVAL == 0)
+        for (auto& phasor : phasors)
+            phasor /= std::abs(phasor);
+}
@@ -0,0 +1,85 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_SYNTH_H
+#define INCLUDED_RSP_SND_SYNTH_H
+
+#include "in.h"
+#include "ringbuffer.h"
+#include <atomic>
+#include <complex>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+class SynthConfig {
+public:
+    double sample_rate;
+    bool realtime;                   // pace the output to sample_rate
+    unsigned int block_size;         // samples per block (like a USB callback)
+    std::vector<double> tones;       // tone frequencies (Hz, relative to DC)
+    double tone_level;               // dBFS (each tone)
+    double noise_level;              // dBFS
+    double burst_level;              // dBFS (noise bursts)
+    double burst_period;             // s (0 = no bursts)
+    double burst_length;             // s
+    int gRdB;                        // emulated IF gain reduction
+};
+
+// synthetic I/Q generator (tones, noise, and noise bursts)
+class Synth: public In {
+
+public:
+    Synth(const SynthConfig& config, int verbose = 0);
+    ~Synth();
+
+    // setters
+    void setIFGainReduction(int gRdB, bool wait = false) override;
+
+    // getters
+    double getSamplerate() const override;
+    int getIFGainReduction() const override;
+
+    // streaming
+    void start(RingBuffer<short[2]> *buffer) override;
+    void stop() override;
+
+    class Exception: public std::runtime_error {
+    public:
+        Exception(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+private:
+    void generate_loop(RingBuffer<short[2]> *buffer);
+    void generate(short (*out)[2], unsigned int count);
+    inline double noise();
+
+    RingBuffer<short[2]> *buffer;
+    double sample_rate;
+    bool realtime;
+    unsigned int block_size;
+    double tone_amplitude;
+    double noise_amplitude;
+    double burst_amplitude;
+    uint64_t burst_period;
+    uint64_t burst_length;
+    int reference_gRdB;
+    // set by the AGC thread, taken by the generator once per block
+    std::atomic<int> gRdB;
+    std::atomic<double> gain;
+
+    std::vector<std::complex<double>> phasors;
+    std::vector<std::complex<double>> rotators;
+    uint64_t rng_state;
+
+    std::thread thread;
+    bool run = false;
+    uint64_t total_samples = 0;
+};
+
+#endif /* INCLUDED_RSP_SND_SYNTH_H */
@@ -0,0 +1,239 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "uring_writer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+static inline int io_uring_setup(unsigned entries, io_uring_params *params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static inline int io_uring_enter(int ring_fd, unsigned to_submit,
+                                 unsigned min_complete, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                   flags, nullptr, 0);
+}
+
+
+UringWriter::UringWriter(int fd, size_t buffer_size, unsigned int queue_depth,
+                         size_t extent_size, int verbose):
+    fd(fd),
+    buffer_size((buffer_size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT),
+    extent_size(extent_size),
+    verbose(verbose),
+    current(0),
+    in_flight(0),
+    offset(0),
+    allocated(0),
+    write_errors(0)
+{
+    if (this->buffer_size == 0 || queue_depth < 2)
+        throw UringWriter::Exception("invalid buffer size or queue depth");
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd = io_uring_setup(queue_depth, &params);
+    if (ring_fd < 0) {
+        std::cerr << "io_uring_setup() failed: " << strerror(errno) << std::endl;
+        throw UringWriter::Exception("io_uring_setup() failed");
+    }
+
+    // the submission and completion rings share one mapping on newer kernels
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED)
+        throw UringWriter::Exception("mmap() SQ ring failed");
+    cq_ring = sq_ring;
+    if (!single_mmap) {
+        cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED)
+            throw UringWriter::Exception("mmap() CQ ring failed");
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe *>(mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+    if (sqes == MAP_FAILED)
+        throw UringWriter::Exception("mmap() SQEs failed");
+
+    auto sq = static_cast<unsigned char *>(sq_ring);
+    sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    auto cq = static_cast<unsigned char *>(cq_ring);
+    cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    // one buffer per submission queue entry, so the queue is never full
+    buffers.resize(queue_depth);
+    for (auto& buffer : buffers) {
+        void *data;
+        if (posix_memalign(&data, ALIGNMENT, this->buffer_size) != 0)
+            throw UringWriter::Exception("posix_memalign() failed");
+        buffer = { static_cast<unsigned char *>(data), 0, 0, 0, false };
+    }
+
+    preallocate(this->extent_size);
+    if (verbose >= 1)
+        std::cerr << "io_uring file writer - buffers: " << queue_depth << " x " << this->buffer_size << " bytes - preallocation extent: " << this->extent_size << " bytes" << std::endl;
+}
+
+UringWriter::~UringWriter()
+{
+    while (in_flight > 0)
+        reap(1);
+    for (auto& buffer : buffers)
+        free(buffer.data);
+    munmap(sqes, sqes_size);
+    if (cq_ring != sq_ring)
+        munmap(cq_ring, cq_ring_size);
+    munmap(sq_ring, sq_ring_size);
+    close(ring_fd);
+}
+
+
+void UringWriter::write(const void *data, size_t count)
+{
+    auto src = static_cast<const unsigned char *>(data);
+    while (count > 0) {
+        // all the buffers are on their way to the disk: wait for this one
+        while (buffers[current].in_flight)
+            reap(1);
+        auto& buffer = buffers[current];
+        auto n = std::min(count, buffer_size - buffer.length);
+        memcpy(buffer.data + buffer.length, src, n);
+        buffer.length += n;
+        src += n;
+        count -= n;
+        if (buffer.length == buffer_size) {
+            buffer.offset = offset;
+            offset += buffer_size;
+            submit(current);
+            current = (current + 1) % buffers.size();
+        }
+    }
+    reap(0);
+}
+
+void UringWriter::flush()
+{
+    auto& buffer = buffers[current];
+    uint64_t size = offset + buffer.length;
+    // O_DIRECT can only write whole blocks; the padding is truncated below
+    if (buffer.length > 0) {
+        auto padded = (buffer.length + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        memset(buffer.data + buffer.length, 0, padded - buffer.length);
+        buffer.length = padded;
+        buffer.offset = offset;
+        offset += padded;
+        submit(current);
+        current = (current + 1) % buffers.size();
+    }
+    while (in_flight > 0)
+        reap(1);
+    // this also releases the preallocated blocks past the end
+    if (ftruncate(fd, size) < 0)
+        std::cerr << "ftruncate() failed: " << strerror(errno) << std::endl;
+    offset = size;
+    if (verbose >= 1)
+        std::cerr << "io_uring file writer - bytes written: " << size << " - write errors: " << write_errors << std::endl;
+}
+
+
+void UringWriter::submit(int index)
+{
+    auto& buffer = buffers[index];
+    preallocate(buffer.offset + buffer.length);
+
+    // only this thread touches the tail
+    auto tail = *sq_tail;
+    auto slot = tail & *sq_mask;
+    auto sqe = &sqes[slot];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer.data + buffer.done);
+    sqe->len = buffer.length - buffer.done;
+    sqe->off = buffer.offset + buffer.done;
+    sqe->user_data = index;
+    sq_array[slot] = slot;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    buffer.in_flight = true;
+    in_flight++;
+
+    int ret;
+    do {
+        ret = io_uring_enter(ring_fd, 1, 0, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0)
+        std::cerr << "io_uring_enter() failed: " << strerror(errno) << std::endl;
+}
+
+void UringWriter::reap(unsigned int min_complete)
+{
+    if (min_complete > 0) {
+        auto ret = io_uring_enter(ring_fd, 0, min_complete, IORING_ENTER_GETEVENTS);
+        if (ret < 0 && errno != EINTR)
+            std::cerr << "io_uring_enter() failed: " << strerror(errno) << std::endl;
+    }
+    auto head = *cq_head;
+    auto tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        const auto& cqe = cqes[head & *cq_mask];
+        auto index = static_cast<int>(cqe.user_data);
+        auto& buffer = buffers[index];
+        buffer.in_flight = false;
+        in_flight--;
+        if (cqe.res > 0 && buffer.done + cqe.res < buffer.length) {
+            // short write: send the rest
+            buffer.done += cqe.res;
+            submit(index);
+            continue;
+        }
+        if (cqe.res <= 0) {
+            std::cerr << "io_uring write at offset " << buffer.offset + buffer.done << " failed: " << (cqe.res < 0 ? strerror(-cqe.res) : "no progress") << std::endl;
+            write_errors++;
+            if (stats != nullptr)
+                stats->file_write_errors.add(1);
+        }
+        buffer.length = 0;
+        buffer.done = 0;
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+}
+
+// FALLOC_FL_KEEP_SIZE: the file size still follows the writes
+void UringWriter::preallocate(uint64_t end)
+{
+    while (extent_size > 0 && allocated < end) {
+        if (fallocate(fd, FALLOC_FL_KEEP_SIZE, allocated, extent_size) < 0) {
+            std::cerr << "fallocate() failed: " << strerror(errno) << " - no more preallocation" << std::endl;
+            extent_size = 0;
+            return;
+        }
+        allocated += extent_size;
+    }
+}
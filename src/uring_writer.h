@@ -0,0 +1,98 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_URING_WRITER_H
+#define INCLUDED_RSP_SND_URING_WRITER_H
+
+#include "stats.h"
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// sequential file writer for O_DIRECT file descriptors
+// the data is copied into aligned staging buffers, and each full buffer
+// is submitted as one io_uring write; up to queue_depth writes are in
+// flight, and write() only blocks when all the buffers are waiting for
+// the disk. The file is preallocated ahead of the writes in large extents
+// with fallocate(), so the writes don't have to allocate blocks
+// (the io_uring system calls are used directly; there is no dependency
+// on liburing)
+class UringWriter {
+
+public:
+    UringWriter(int fd, size_t buffer_size, unsigned int queue_depth,
+                size_t extent_size, int verbose = 0);
+    ~UringWriter();
+
+    // setters
+    void setStats(StatsPage *stats) { this->stats = stats; }
+
+    // getters
+    uint64_t getWriteErrors() const { return write_errors; }
+
+    // copy count bytes to the staging buffers (never short)
+    void write(const void *data, size_t count);
+    // write out the partial last buffer, wait for all the writes, and set
+    // the file size to the number of bytes written
+    void flush();
+
+    // O_DIRECT offsets, lengths, and buffer addresses must be multiples of this
+    static constexpr size_t ALIGNMENT = 4096;
+
+    class Exception: public std::runtime_error {
+    public:
+        Exception(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+private:
+    struct Buffer {
+        unsigned char *data;
+        uint64_t offset;             // in the file
+        size_t length;               // bytes to write
+        size_t done;                 // bytes written so far
+        bool in_flight;
+    };
+
+    void submit(int index);
+    void reap(unsigned int min_complete);
+    void preallocate(uint64_t end);
+
+    int fd;
+    size_t buffer_size;
+    size_t extent_size;
+    int verbose;
+    StatsPage *stats = nullptr;
+
+    // io_uring
+    int ring_fd;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    io_uring_cqe *cqes;
+
+    std::vector<Buffer> buffers;
+    int current;                     // buffer being filled
+    unsigned int in_flight;
+    uint64_t offset;                 // file offset of the current buffer
+    uint64_t allocated;              // preallocated up to here
+    uint64_t write_errors;
+};
+
+#endif /* INCLUDED_RSP_SND_URING_WRITER_H */
@@ -0,0 +1,148 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "wav.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+
+// chunk offsets in the header block
+static constexpr size_t WAV_RIFF_SIZE = 4;
+static constexpr size_t WAV_DS64 = 12;
+static constexpr size_t WAV_DS64_SIZE = 28;
+static constexpr size_t WAV_FMT = WAV_DS64 + 8 + WAV_DS64_SIZE;
+static constexpr size_t WAV_FMT_SIZE = 16;
+static constexpr size_t WAV_AUXI = WAV_FMT + 8 + WAV_FMT_SIZE;
+static constexpr size_t WAV_AUXI_SIZE = 164;
+static constexpr size_t WAV_PAD = WAV_AUXI + 8 + WAV_AUXI_SIZE;
+static constexpr size_t WAV_DATA = WavHeader::SIZE - 8;
+
+static constexpr uint16_t WAVE_FORMAT_PCM = 1;
+static constexpr uint16_t WAVE_FORMAT_IEEE_FLOAT = 3;
+static constexpr uint32_t WAV_SIZE_UNKNOWN = 0xffffffff;
+
+static void put_u16(unsigned char *p, uint16_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static void put_u32(unsigned char *p, uint32_t value)
+{
+    put_u16(p, value);
+    put_u16(p + 2, value >> 16);
+}
+
+static void put_u64(unsigned char *p, uint64_t value)
+{
+    put_u32(p, value);
+    put_u32(p + 4, value >> 32);
+}
+
+static void put_chunk(unsigned char *p, const char *id, uint32_t size)
+{
+    memcpy(p, id, 4);
+    put_u32(p + 4, size);
+}
+
+// Windows SYSTEMTIME (UTC)
+static void put_systemtime(unsigned char *p,
+                           std::chrono::system_clock::time_point now = std::chrono::system_clock::now())
+{
+    auto t = std::chrono::system_clock::to_time_t(now);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    put_u16(p, tm.tm_year + 1900);
+    put_u16(p + 2, tm.tm_mon + 1);
+    put_u16(p + 4, tm.tm_wday);
+    put_u16(p + 6, tm.tm_mday);
+    put_u16(p + 8, tm.tm_hour);
+    put_u16(p + 10, tm.tm_min);
+    put_u16(p + 12, tm.tm_sec);
+    put_u16(p + 14, ms);
+}
+
+
+WavHeader::WavHeader(SampleFormat format, double sample_rate, double frequency,
+                     int gain_reduction, int lna_state):
+    frame_size(SampleConverter(format).getFrameSize()),
+    is_rf64(false)
+{
+    void *p;
+    if (posix_memalign(&p, SIZE, SIZE) != 0)
+        throw std::bad_alloc();
+    block = static_cast<unsigned char *>(p);
+    memset(block, 0, SIZE);
+
+    put_chunk(block, "RIFF", WAV_SIZE_UNKNOWN);
+    memcpy(block + 8, "WAVE", 4);
+    put_chunk(block + WAV_DS64, "JUNK", WAV_DS64_SIZE);
+
+    auto fmt = block + WAV_FMT;
+    auto rate = static_cast<uint32_t>(sample_rate + 0.5);
+    put_chunk(fmt, "fmt ", WAV_FMT_SIZE);
+    put_u16(fmt + 8, format == SAMPLE_CF32 ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+    put_u16(fmt + 10, 2);
+    put_u32(fmt + 12, rate);
+    put_u32(fmt + 16, rate * frame_size);
+    put_u16(fmt + 20, frame_size);
+    put_u16(fmt + 22, frame_size * 4);
+
+    auto auxi = block + WAV_AUXI;
+    put_chunk(auxi, "auxi", WAV_AUXI_SIZE);
+    put_systemtime(auxi + 8);
+    put_systemtime(auxi + 24);
+    put_u32(auxi + 40, static_cast<uint32_t>(frequency + 0.5));
+    put_u32(auxi + 44, rate);
+    put_u32(auxi + 48, 0);                          // IF frequency
+    put_u32(auxi + 52, 0);                          // bandwidth
+    put_u32(auxi + 56, 0);                          // I/Q offset
+    put_u32(auxi + 60, gain_reduction);
+    put_u32(auxi + 64, lna_state);
+
+    put_chunk(block + WAV_PAD, "JUNK", WAV_DATA - WAV_PAD - 8);
+    put_chunk(block + WAV_DATA, "data", WAV_SIZE_UNKNOWN);
+}
+
+WavHeader::~WavHeader()
+{
+    free(block);
+}
+
+
+void WavHeader::setStartTime(std::chrono::system_clock::time_point start_time)
+{
+    put_systemtime(block + WAV_AUXI + 8, start_time);
+}
+
+
+void WavHeader::update(uint64_t data_bytes)
+{
+    uint64_t riff_size = SIZE - 8 + data_bytes;
+    if (!is_rf64 && riff_size >= WAV_SIZE_UNKNOWN) {
+        memcpy(block, "RF64", 4);
+        put_chunk(block + WAV_DS64, "ds64", WAV_DS64_SIZE);
+        put_u32(block + WAV_RIFF_SIZE, WAV_SIZE_UNKNOWN);
+        put_u32(block + WAV_DATA + 4, WAV_SIZE_UNKNOWN);
+        is_rf64 = true;
+    }
+    if (is_rf64) {
+        auto ds64 = block + WAV_DS64 + 8;
+        put_u64(ds64, riff_size);
+        put_u64(ds64 + 8, data_bytes);
+        put_u64(ds64 + 16, data_bytes / frame_size);
+        put_u32(ds64 + 24, 0);                      // table length
+    } else {
+        put_u32(block + WAV_RIFF_SIZE, riff_size);
+        put_u32(block + WAV_DATA + 4, data_bytes);
+    }
+    put_systemtime(block + WAV_AUXI + 24);
+}
@@ -0,0 +1,57 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_RSP_SND_WAV_H
+#define INCLUDED_RSP_SND_WAV_H
+
+#include "sample_format.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// output file containers
+enum FileContainer { CONTAINER_RAW, CONTAINER_WAV, CONTAINER_COMPRESSED };
+
+// WAV/RF64 header for I/Q recordings
+// the header is one 4096 byte block, so the samples start on a block
+// boundary and the header can be rewritten in place with a single aligned
+// pwrite(), also on O_DIRECT files; the chunks are:
+//   RIFF/RF64 - JUNK/ds64 - fmt - auxi - JUNK (padding) - data
+// the sizes start as 0xFFFFFFFF (unknown length, the convention for
+// streams), so a recording that was never updated is read to the end of
+// the file; once the RIFF size no longer fits in 32 bits the header turns
+// into RF64 (EBU Tech 3306), and the reserved JUNK chunk into ds64
+// the auxi chunk has the SpectraVue/HDSDR layout: start and stop time
+// (UTC), center frequency, and sample rate; rsp_snd also stores the IF gain
+// reduction and the LNA state in the first two unused fields
+class WavHeader {
+
+public:
+    WavHeader(SampleFormat format, double sample_rate, double frequency,
+              int gain_reduction, int lna_state);
+    ~WavHeader();
+
+    // getters
+    const void *data() const { return block; }
+
+    // setters
+    // time of the first sample (the default is when the header is created)
+    void setStartTime(std::chrono::system_clock::time_point start_time);
+
+    // set the sizes for data_bytes bytes of samples, and the stop time
+    // to now
+    void update(uint64_t data_bytes);
+
+    static constexpr size_t SIZE = 4096;
+
+private:
+    unsigned char *block;
+    size_t frame_size;
+    bool is_rf64;
+};
+
+#endif /* INCLUDED_RSP_SND_WAV_H */
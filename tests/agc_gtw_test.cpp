@@ -0,0 +1,232 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// check that AgcGtw makes the same gain changes, on the same blocks, as
+// the original per-sample AGC GTW loop (reference model below)
+// the samples are written one block at a time, and only after the AGC has
+// caught up with the previous one, so the outcome is deterministic
+
+#include "agc_gtw.h"
+#include "in.h"
+#include "ringbuffer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+struct GainChange {
+    size_t block;
+    int gain_reduction;
+    bool operator==(const GainChange& other) const {
+        return block == other.block && gain_reduction == other.gain_reduction;
+    }
+};
+
+class FakeIn: public In {
+
+public:
+    FakeIn(double samplerate, int gain_reduction):
+        samplerate(samplerate), gain_reduction(gain_reduction) {}
+
+    void setIFGainReduction(int gRdB, bool /* wait */ = false) override {
+        gain_reduction = gRdB;
+        changes.push_back({block, gRdB});
+    }
+    double getSamplerate() const override { return samplerate; }
+    int getIFGainReduction() const override { return gain_reduction; }
+    void start(RingBuffer<short[2]> * /* buffer */) override {}
+    void stop() override {}
+
+    std::atomic<size_t> block{0};
+    std::vector<GainChange> changes;
+
+private:
+    double samplerate;
+    int gain_reduction;
+};
+
+// the per-sample loop AgcGtw::agc_loop() started from
+class ReferenceAgc {
+
+public:
+    ReferenceAgc(const AgcGtwConfig& config, int samples_per_millis, int gain_reduction):
+        config(config),
+        gain_reduction(gain_reduction),
+        current_gain_reduction(gain_reduction),
+        samples_per_millis(samples_per_millis),
+        samples_left(samples_per_millis) {}
+
+    void process(size_t block, const short (*samples)[2], size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            if (--samples_left == 0) {
+                millis_since_last_agc_check++;
+                millis_since_last_gain_change++;
+                samples_left = samples_per_millis;
+            }
+            auto iq = std::max(abs(samples[i][0]), abs(samples[i][1]));
+
+            max_iq = std::max(iq, max_iq);
+
+            if (iq > config.agc1_increase_threshold) {
+                if (millis_iq_above_threshold < INT_MAX)
+                    millis_iq_above_threshold++;
+            }
+
+            if (millis_since_last_agc_check <= config.agc3_min_time_ms)
+                continue;
+
+            if (millis_since_last_gain_change > config.agc5_b && millis_iq_above_threshold > config.agc4_a) {
+                gain_reduction += config.gainstep_inc;
+                gain_reduction = std::min(config.max_gain_reduction, gain_reduction);
+            } else if (millis_since_last_gain_change > config.agc6_c && max_iq < config.agc2_decrease_threshold) {
+                gain_reduction -= config.gainstep_dec;
+                gain_reduction = std::max(config.min_gain_reduction, gain_reduction);
+            }
+
+            millis_since_last_agc_check = 0;
+            max_iq = 0;
+            millis_iq_above_threshold = 0;
+
+            if (gain_reduction != current_gain_reduction) {
+                current_gain_reduction = gain_reduction;
+                changes.push_back({block, gain_reduction});
+                millis_since_last_gain_change = 0;
+                break;
+            }
+        }
+    }
+
+    std::vector<GainChange> changes;
+
+private:
+    AgcGtwConfig config;
+    int gain_reduction;
+    int current_gain_reduction;
+    int samples_per_millis;
+    int samples_left;
+    int millis_since_last_agc_check = 0;
+    int millis_since_last_gain_change = 0;
+    int millis_iq_above_threshold = 0;
+    int max_iq = 0;
+};
+
+// bursts of strong signal between stretches of weak signal, with
+// full-scale (-32768) samples thrown in
+static std::vector<short> make_signal(size_t nsamples, std::mt19937& rng)
+{
+    std::vector<short> signal(2 * nsamples);
+    size_t i = 0;
+    while (i < nsamples) {
+        size_t length = 100 + rng() % 20000;
+        int amplitude = rng() % 4 == 0 ? 32768 : 1000 + rng() % 20000;
+        for (size_t k = 0; k < length && i < nsamples; k++, i++) {
+            for (int c = 0; c < 2; c++) {
+                int x = static_cast<int>(rng() % (2 * amplitude)) - amplitude;
+                signal[2 * i + c] = static_cast<short>(std::clamp(x, -32768, 32767));
+            }
+        }
+    }
+    return signal;
+}
+
+static bool run_test(const char *name, const AgcGtwConfig& config, unsigned int seed)
+{
+    const double samplerate = 48000;
+    const int samples_per_millis = 48;
+    const int initial_gain_reduction = 40;
+    std::mt19937 rng(seed);
+    auto signal = make_signal(4000000, rng);
+    auto samples = reinterpret_cast<const short (*)[2]>(signal.data());
+    size_t nsamples = signal.size() / 2;
+
+    // block sizes around a millisecond, so the blocks end both before and
+    // after the millisecond boundaries
+    std::vector<size_t> block_sizes;
+    for (size_t n = 0; n < nsamples; ) {
+        size_t size = std::min(nsamples - n, static_cast<size_t>(samples_per_millis + rng() % (3 * samples_per_millis)));
+        block_sizes.push_back(size);
+        n += size;
+    }
+
+    ReferenceAgc reference(config, samples_per_millis, initial_gain_reduction);
+    size_t offset = 0;
+    for (size_t block = 0; block < block_sizes.size(); block++) {
+        reference.process(block, samples + offset, block_sizes[block]);
+        offset += block_sizes[block];
+    }
+
+    FakeIn in(samplerate, initial_gain_reduction);
+    RingBuffer<short[2]> buffer(1 << 16);
+    AgcGtw agc(config);
+    agc.setIn(&in);
+    agc.setup();
+    agc.start(&buffer);
+    // the AGC is the only reader
+    const int reader = 0;
+    while (!buffer.is_active(reader))
+        std::this_thread::yield();
+    offset = 0;
+    for (size_t block = 0; block < block_sizes.size(); block++) {
+        in.block = block;
+        auto write_ptr = buffer.next_write_ptr();
+        memcpy(write_ptr, samples + offset, block_sizes[block] * sizeof(short[2]));
+        buffer.next_write_ptr(block_sizes[block]);
+        offset += block_sizes[block];
+        while (buffer.get_lag(reader) != 0)
+            std::this_thread::yield();
+    }
+    buffer.stop();
+    agc.stop();
+
+    if (in.changes == reference.changes && !reference.changes.empty()) {
+        std::cout << name << ": OK - " << in.changes.size() << " gain changes" << std::endl;
+        return true;
+    }
+    std::cerr << name << ": FAILED - " << in.changes.size() << " gain changes (expected " << reference.changes.size() << ")" << std::endl;
+    size_t n = std::min(in.changes.size(), reference.changes.size());
+    for (size_t k = 0; k < n; k++) {
+        if (!(in.changes[k] == reference.changes[k])) {
+            std::cerr << "  first difference at change " << k << ": block " << in.changes[k].block << " gain_reduction " << in.changes[k].gain_reduction << " (expected block " << reference.changes[k].block << " gain_reduction " << reference.changes[k].gain_reduction << ")" << std::endl;
+            break;
+        }
+    }
+    return false;
+}
+
+int main()
+{
+    AgcGtwConfig config;
+    config.agc1_increase_threshold = 16384;
+    config.agc2_decrease_threshold = 8192;
+    config.agc3_min_time_ms = 5;
+    config.min_gain_reduction = 30;
+    config.max_gain_reduction = 59;
+    config.gainstep_dec = 1;
+    config.gainstep_inc = 2;
+    config.agc4_a = 100;
+    config.agc5_b = 20;
+    config.agc6_c = 50;
+
+    bool ok = true;
+    ok = run_test("min_time_5ms", config, 1) && ok;
+    // with a check every millisecond, agc4_a has to be less than the
+    // samples in a millisecond
+    config.agc3_min_time_ms = 0;
+    config.agc4_a = 10;
+    ok = run_test("min_time_0ms", config, 2) && ok;
+    // a negative agc3_min_time_ms checks at every sample
+    config.agc3_min_time_ms = -1;
+    config.agc4_a = 0;
+    ok = run_test("min_time_negative", config, 3) && ok;
+    return ok ? 0 : 1;
+}
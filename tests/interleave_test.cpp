@@ -0,0 +1,73 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// compare every interleave() kernel the CPU supports against the scalar
+// loop, over odd lengths and unaligned buffers
+// (simd.cpp is included directly to get to its static kernels)
+
+#include "simd.cpp"
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+typedef void (*InterleaveFunc)(short (*)[2], const short *, const short *, size_t);
+
+static int check(const char *name, InterleaveFunc func)
+{
+    std::mt19937 rng(1);
+    int failures = 0;
+    for (size_t count : {0, 1, 2, 3, 7, 8, 9, 15, 16, 17, 31, 33, 63, 65, 127, 129, 1001, 4099}) {
+        for (size_t offset = 0; offset < 4; offset++) {
+            std::vector<short> xi(count + offset);
+            std::vector<short> xq(count + offset);
+            for (auto& x : xi)
+                x = static_cast<short>(rng());
+            for (auto& x : xq)
+                x = static_cast<short>(rng());
+            if (count + offset >= 2) {
+                xi[offset] = -32768;
+                xq[count + offset - 1] = 32767;
+            }
+
+            // one guard element past the end to catch overruns
+            std::vector<short> expected(2 * (count + offset + 1), 0x5555);
+            std::vector<short> actual(2 * (count + offset + 1), 0x5555);
+            interleave_scalar(reinterpret_cast<short (*)[2]>(expected.data()) + offset,
+                              xi.data() + offset, xq.data() + offset, count);
+            func(reinterpret_cast<short (*)[2]>(actual.data()) + offset,
+                 xi.data() + offset, xq.data() + offset, count);
+            if (actual != expected) {
+                std::cerr << name << ": mismatch - count=" << count << " offset=" << offset << std::endl;
+                failures++;
+            }
+        }
+    }
+    return failures;
+}
+
+int main()
+{
+    int failures = 0;
+    failures += check("dispatch", interleave);
+    std::cout << "dispatched ISA: " << simd_isa() << std::endl;
+#ifdef SIMD_X86
+    failures += check("sse2", interleave_sse2);
+    if (__builtin_cpu_supports("avx2"))
+        failures += check("avx2", interleave_avx2);
+    else
+        std::cout << "avx2: not supported - skipped" << std::endl;
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        failures += check("avx512", interleave_avx512);
+    else
+        std::cout << "avx512: not supported - skipped" << std::endl;
+#endif
+#ifdef SIMD_NEON
+    failures += check("neon", interleave_neon);
+#endif
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2022 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// encode -> rsp_snd_decode round trip of .rspz files: the decoded samples
+// must be byte identical to the input, for random, full-scale and silent
+// input, and also for a file truncated before its block index (the
+// decoder then has to go through the block headers)
+// usage: rspz_test path/to/rsp_snd_decode
+
+#include "compress.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// the same steps as FileSegment: header, blocks, index and trailer
+static std::vector<unsigned char> encode(const std::vector<short>& samples,
+                                         size_t block_size, int lpc_order,
+                                         unsigned int threads,
+                                         std::vector<RspzIndexEntry>& index)
+{
+    std::vector<unsigned char> file(RSPZ_HEADER_SIZE);
+    RspzHeader header = { static_cast<uint32_t>(block_size), 2e6, 10e6 };
+    rspz_write_header(file.data(), header);
+    index.clear();
+    Compressor compressor(block_size, lpc_order, threads,
+                          [&](const std::vector<unsigned char>& block, uint64_t first_frame) {
+                              index.push_back({ file.size(), first_frame });
+                              file.insert(file.end(), block.begin(), block.end());
+                          });
+    // in uneven pieces, as they come out of the ring buffer
+    auto frames = reinterpret_cast<const short (*)[2]>(samples.data());
+    size_t nframes = samples.size() / 2;
+    for (size_t n = 0, k = 0; n < nframes; k++) {
+        size_t count = std::min(nframes - n, 1000 + 777 * (k % 5));
+        compressor.add(frames + n, count);
+        n += count;
+    }
+    compressor.finish();
+    std::vector<unsigned char> trailer;
+    rspz_write_index(trailer, index, file.size());
+    file.insert(file.end(), trailer.begin(), trailer.end());
+    return file;
+}
+
+static bool write_file(const std::string& name, const unsigned char *data, size_t size)
+{
+    auto f = fopen(name.c_str(), "wb");
+    if (f == nullptr)
+        return false;
+    bool ok = fwrite(data, 1, size, f) == size;
+    return fclose(f) == 0 && ok;
+}
+
+static bool read_file(const std::string& name, std::vector<short>& samples)
+{
+    auto f = fopen(name.c_str(), "rb");
+    if (f == nullptr)
+        return false;
+    samples.clear();
+    short buf[4096];
+    size_t n;
+    while ((n = fread(buf, sizeof(short), 4096, f)) > 0)
+        samples.insert(samples.end(), buf, buf + n);
+    fclose(f);
+    return true;
+}
+
+// decode 'file' with rsp_snd_decode and compare with the first
+// 'expected_frames' frames of the input
+static bool check_decode(const char *decoder, const std::string& name,
+                         const std::vector<unsigned char>& file, size_t size,
+                         const std::vector<short>& samples, size_t expected_frames)
+{
+    std::string rspz_name = "rspz_test_" + name + ".rspz";
+    std::string raw_name = "rspz_test_" + name + ".raw";
+    if (!write_file(rspz_name, file.data(), size)) {
+        std::cerr << name << ": writing " << rspz_name << " failed" << std::endl;
+        return false;
+    }
+    std::string command = std::string(decoder) + " " + rspz_name + " " + raw_name;
+    if (system(command.c_str()) != 0) {
+        std::cerr << name << ": " << command << " failed" << std::endl;
+        return false;
+    }
+    std::vector<short> decoded;
+    if (!read_file(raw_name, decoded)) {
+        std::cerr << name << ": reading " << raw_name << " failed" << std::endl;
+        return false;
+    }
+    remove(rspz_name.c_str());
+    remove(raw_name.c_str());
+    if (decoded.size() != 2 * expected_frames ||
+        !std::equal(decoded.begin(), decoded.end(), samples.begin())) {
+        std::cerr << name << ": FAILED - decoded " << decoded.size() / 2 << " samples (expected " << expected_frames << ")" << std::endl;
+        for (size_t i = 0; i < std::min(decoded.size(), 2 * expected_frames); i++) {
+            if (decoded[i] != samples[i]) {
+                std::cerr << "  first difference at sample " << i / 2 << std::endl;
+                break;
+            }
+        }
+        return false;
+    }
+    std::cout << name << ": OK - " << expected_frames << " samples - " << size << " bytes" << std::endl;
+    return true;
+}
+
+static bool run_test(const char *decoder, const std::string& name,
+                     const std::vector<short>& samples, int lpc_order)
+{
+    const size_t block_size = 4096;
+    std::vector<RspzIndexEntry> index;
+    auto file = encode(samples, block_size, lpc_order, 3, index);
+    size_t nframes = samples.size() / 2;
+    bool ok = check_decode(decoder, name, file, file.size(), samples, nframes);
+    if (index.empty())
+        return ok;
+
+    // interrupted recording: no index and trailer
+    size_t index_size = 8 + 16 * index.size() + RSPZ_TRAILER_SIZE;
+    ok = check_decode(decoder, name + "_no_index", file, file.size() - index_size,
+                      samples, nframes) && ok;
+    // ... and also the last block cut short
+    ok = check_decode(decoder, name + "_partial_block", file, file.size() - index_size - 1,
+                      samples, index.back().first_frame) && ok;
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " rsp_snd_decode" << std::endl;
+        return 1;
+    }
+    const char *decoder = argv[1];
+    std::mt19937 rng(1);
+    // not a multiple of the block size
+    const size_t nframes = 10 * 4096 + 1234;
+    bool ok = true;
+
+    std::vector<short> random(2 * nframes);
+    for (auto& x : random)
+        x = static_cast<short>(rng());
+    ok = run_test(decoder, "random", random, 8) && ok;
+
+    // a noisy tone, which the predictors can actually work on
+    std::vector<short> tone(2 * nframes);
+    for (size_t i = 0; i < nframes; i++) {
+        tone[2 * i] = static_cast<short>(10000 * cos(0.01 * i) + static_cast<int>(rng() % 64) - 32);
+        tone[2 * i + 1] = static_cast<short>(10000 * sin(0.01 * i) + static_cast<int>(rng() % 64) - 32);
+    }
+    ok = run_test(decoder, "tone", tone, 8) && ok;
+    ok = run_test(decoder, "tone_fixed", tone, 0) && ok;
+
+    // full scale: alternating -32768/32767, and stuck at either end
+    std::vector<short> full_scale(2 * nframes);
+    for (size_t i = 0; i < nframes; i++) {
+        size_t block = i / 4096;
+        short x = block % 3 == 0 ? ((i & 1) ? 32767 : -32768) : block % 3 == 1 ? -32768 : 32767;
+        full_scale[2 * i] = x;
+        full_scale[2 * i + 1] = (rng() & 1) ? 32767 : -32768;
+    }
+    ok = run_test(decoder, "full_scale", full_scale, 8) && ok;
+
+    std::vector<short> silent(2 * nframes, 0);
+    ok = run_test(decoder, "silent", silent, 8) && ok;
+
+    ok = run_test(decoder, "empty", std::vector<short>(), 8) && ok;
+
+    return ok ? 0 : 1;
+}